@@ -106,6 +106,21 @@ static inline int unsigned short cksum(unsigned short *buf, int nbytes)
 	return (uint16_t) ~ sum;
 }
 
+/**
+ * cksum_replace - update IP checksum @sum when a 16 bits word
+ *                 changes from @old to @new (RFC1624, eqn. 3)
+ */
+static inline uint16_t cksum_replace(uint16_t sum, uint16_t old, uint16_t new)
+{
+	uint32_t s;
+
+	s = (uint16_t) ~ sum + (uint16_t) ~ old + new;
+	s = (s >> 16) + (s & 0xffff);
+	s += (s >> 16);
+
+	return (uint16_t) ~ s;
+}
+
 /**
  * mystrtoul - convert a string to an unsigned long int
  */
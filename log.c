@@ -22,13 +22,61 @@
 /* ISO C */
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <time.h>
 
 /* POSIX */
 #include <syslog.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include "common.h"
 
+/* queued messages, power of 2 */
+#define LOG_RING_SIZE	256
+#define LOG_RING_MASK	(LOG_RING_SIZE - 1)
+#define LOG_MSG_MAX	512
+
+#define LOG_JOURNALD_PATH	"/run/systemd/journal/socket"
+#define LOG_SYSLOG_PATH		"/dev/log"
+
+/**
+ * log_entry - preformatted message waiting in log ring
+ */
+struct log_entry {
+	int priority;
+	time_t time;
+	char msg[LOG_MSG_MAX];
+};
+
+/**
+ * log_sink - destination of queued messages
+ */
+enum log_sink {
+	LOG_SINK_LIBC,		/* syslog(3), may block */
+	LOG_SINK_SYSLOG,	/* datagram on /dev/log */
+	LOG_SINK_JOURNALD,	/* journald native protocol */
+};
+
+/* single producer (log_it) single consumer (log_flush) ring */
+static struct log_entry log_ring[LOG_RING_SIZE];
+static unsigned int log_head = 0;
+static unsigned int log_tail = 0;
+
+/* messages lost, ring full or sink error, and already reported */
+static uint64_t log_drops = 0;
+static uint64_t log_drops_seen = 0;
+
+static int log_queued = 0;
+static enum log_sink log_sink = LOG_SINK_LIBC;
+static int log_fd = -1;
+static int log_perror = 0;
+static char log_ident[32] = "-";
+
 #ifdef DEBUG
 int __log_trigger = LOG_DEBUG;
 #else
@@ -68,20 +116,217 @@ int log_trigger(char const *level)
 
 void log_open(char const *app, char const *level)
 {
-	openlog(app ? app : "-", LOG_PERROR | LOG_PID, LOG_DAEMON);
+	snprintf(log_ident, sizeof(log_ident), "%s", app ? app : "-");
+	openlog(log_ident, LOG_PERROR | LOG_PID, LOG_DAEMON);
 	log_trigger(level);
 }
 
+/**
+ * log_connect() - connect a non blocking datagram socket to a local
+ *                 log daemon
+ *
+ * @return fd, -1 on error
+ */
+static int log_connect(const char *path)
+{
+	struct sockaddr_un addr = { 0 };
+	int fd;
+
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+	fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd == -1)
+		return -1;
+
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/**
+ * log_sink_open() - open native sink, journald if stderr is already
+ *                   connected to the journal (started by systemd),
+ *                   syslog daemon else
+ */
+static void log_sink_open(void)
+{
+	if (getenv("JOURNAL_STREAM") != NULL) {
+		log_fd = log_connect(LOG_JOURNALD_PATH);
+		if (log_fd != -1) {
+			log_sink = LOG_SINK_JOURNALD;
+			return;
+		}
+	}
+
+	log_fd = log_connect(LOG_SYSLOG_PATH);
+	if (log_fd != -1) {
+		log_sink = LOG_SINK_SYSLOG;
+		log_perror = isatty(STDERR_FILENO);
+		return;
+	}
+
+	log_sink = LOG_SINK_LIBC;
+}
+
+/**
+ * log_write() - send a message to sink
+ *
+ * @return 0 if sent or dropped, -1 if sink is busy (retry later)
+ */
+static int log_write(const struct log_entry *e)
+{
+	char buf[LOG_MSG_MAX + 256];
+	struct tm tm;
+	char date[32];
+	int len;
+
+	if (log_sink == LOG_SINK_LIBC) {
+		syslog(e->priority, "%s", e->msg);
+		return 0;
+	}
+
+	localtime_r(&e->time, &tm);
+	strftime(date, sizeof(date), "%b %e %T", &tm);
+
+	if (log_sink == LOG_SINK_JOURNALD)
+		len = snprintf(buf, sizeof(buf),
+			       "PRIORITY=%d\nSYSLOG_FACILITY=%d\n"
+			       "SYSLOG_IDENTIFIER=%s\nSYSLOG_PID=%d\n"
+			       "SYSLOG_TIMESTAMP=%s\nMESSAGE=%s\n",
+			       e->priority, LOG_DAEMON >> 3, log_ident,
+			       (int) getpid(), date, e->msg);
+	else
+		len = snprintf(buf, sizeof(buf), "<%d>%s %s[%d]: %s",
+			       e->priority | LOG_DAEMON, date, log_ident,
+			       (int) getpid(), e->msg);
+
+	if ((size_t) len >= sizeof(buf))
+		len = sizeof(buf) - 1;
+
+	if (send(log_fd, buf, len, MSG_NOSIGNAL) == -1) {
+		if ((errno == EAGAIN) || (errno == ENOBUFS))
+			return -1;
+
+		/* log daemon restarted, reconnect once */
+		close(log_fd);
+		log_fd = log_connect(log_sink == LOG_SINK_JOURNALD ?
+				     LOG_JOURNALD_PATH : LOG_SYSLOG_PATH);
+
+		if ((log_fd == -1)
+		    || (send(log_fd, buf, len, MSG_NOSIGNAL) == -1))
+			__atomic_add_fetch(&log_drops, 1, __ATOMIC_RELAXED);
+	}
+
+	if (log_perror)
+		dprintf(STDERR_FILENO, "%s[%d]: %s\n", log_ident,
+			(int) getpid(), e->msg);
+
+	return 0;
+}
+
+void log_async(void)
+{
+	if (log_queued)
+		return;
+
+	log_sink_open();
+	log_queued = 1;
+}
+
+int log_flush(void)
+{
+	struct log_entry report;
+	unsigned int tail = log_tail;
+	uint64_t drops;
+
+	while (tail != __atomic_load_n(&log_head, __ATOMIC_ACQUIRE)) {
+		if (log_write(&log_ring[tail & LOG_RING_MASK]) == -1)
+			return -1;
+
+		__atomic_store_n(&log_tail, ++tail, __ATOMIC_RELEASE);
+	}
+
+	drops = __atomic_load_n(&log_drops, __ATOMIC_RELAXED);
+	if (drops == log_drops_seen)
+		return 0;
+
+	report.priority = LOG_WARNING;
+	report.time = time(NULL);
+	snprintf(report.msg, sizeof(report.msg),
+		 "warning::log_flush %lu messages dropped",
+		 (unsigned long) (drops - log_drops_seen));
+
+	if (log_write(&report) == -1)
+		return -1;
+
+	log_drops_seen = drops;
+
+	return 0;
+}
+
+unsigned long log_dropped(void)
+{
+	return __atomic_load_n(&log_drops, __ATOMIC_RELAXED);
+}
+
 void log_close(void)
 {
+	if (log_queued) {
+		/* last messages, blocking is fine now */
+		if (log_fd != -1)
+			fcntl(log_fd, F_SETFL, 0);
+
+		log_flush();
+		log_queued = 0;
+
+		if (log_fd != -1)
+			close(log_fd);
+		log_fd = -1;
+		log_sink = LOG_SINK_LIBC;
+	}
+
 	closelog();
 }
 
 void log_it(int priority, char const *format, ...)
 {
+	struct log_entry *e;
+	unsigned int head;
 	va_list ap;
+	int len;
 
 	va_start(ap, format);
-	vsyslog(priority, format, ap);
+
+	if (!log_queued) {
+		vsyslog(priority, format, ap);
+		va_end(ap);
+		return;
+	}
+
+	head = log_head;
+	if (head - __atomic_load_n(&log_tail, __ATOMIC_ACQUIRE) ==
+	    LOG_RING_SIZE) {
+		__atomic_add_fetch(&log_drops, 1, __ATOMIC_RELAXED);
+		va_end(ap);
+		return;
+	}
+
+	e = &log_ring[head & LOG_RING_MASK];
+	e->priority = priority;
+	e->time = time(NULL);
+	len = vsnprintf(e->msg, sizeof(e->msg), format, ap);
 	va_end(ap);
+
+	/* one line by message, journald fields are newline separated */
+	if (len > (int) sizeof(e->msg) - 1)
+		len = sizeof(e->msg) - 1;
+	for (int i = 0; i < len; ++i)
+		if (e->msg[i] == '\n')
+			e->msg[i] = ' ';
+
+	__atomic_store_n(&log_head, head + 1, __ATOMIC_RELEASE);
 }
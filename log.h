@@ -55,6 +55,28 @@ void log_open(char const *app, char const *level);
  */
 void log_close(void);
 
+/**
+ * log_async( void )
+ *  Queue next messages in a ring instead of calling syslog(3), they
+ *  are sent by log_flush() to journald (if started by systemd) or
+ *  syslog daemon, without blocking
+ */
+void log_async(void);
+
+/**
+ * log_flush( void )
+ *  Send queued messages until ring is empty or log daemon is busy.
+ *  Report messages dropped because ring was full
+ *  @return 0 if ring is empty, -1 if messages are left
+ */
+int log_flush(void);
+
+/**
+ * log_dropped( void )
+ *  @return count of messages dropped since log_async()
+ */
+unsigned long log_dropped(void);
+
 /**
  * log_it( int priority, char const *format, ...)
  *   Log message if priority is higher than level trigger
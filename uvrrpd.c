@@ -23,6 +23,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <signal.h>
+#include <sys/signalfd.h>
 #include <sys/file.h>
 #include <sys/mman.h>
 #ifdef _POSIX_PRIORITY_SCHEDULING
@@ -42,133 +43,167 @@
 #include "vrrp_options.h"
 #include "vrrp_exec.h"
 #include "vrrp_ctrl.h"
+#include "vrrp_loop.h"
+#include "vrrp_metrics.h"
+#include "vrrp_ctrl_sock.h"
+#include "vrrp_worker.h"
 
 #include "log.h"
 
 /* global constants */
 unsigned long reg = 0UL;
 int background = 1;
+int tx_ring = 0;
 char *loglevel = NULL;
 char *pidfile_name = NULL;
-char *ctrlfile_name = NULL;
+char *config_name = NULL;
+char *metrics_addr = NULL;
+char *ctrl_sock_path = NULL;
+
+/* VRRP instances table */
+static LIST_HEAD(instances);
 
 /* local methods */
-static void signal_handler(int sig);
-static void signal_setup(void);
+static void signal_handler(int fd, void *data);
+static int signal_setup(void);
 static int pidfile_init(int vrid);
 static void pidfile_unlink(void);
 static void pidfile_check(int vrid);
 static void pidfile(int vrid);
-static int ctrlfile_init(int vrid);
+static int ctrlfile_init(struct vrrp *vrrp);
 static void ctrlfile_unlink(void);
-static void ctrlfile(int vrid, int *fd);
+static void ctrlfile(struct vrrp *vrrp);
+static int uvrrpd_instance_init(struct vrrp_instance *inst);
+static void uvrrpd_instance_cleanup(struct vrrp_instance *inst);
 
 /**
  * main() - entry point
  *
- * Declare VRRP instance, init daemon
- * and launch state machine
+ * Declare VRRP instances, init daemon
+ * and launch state machines
  */
 int main(int argc, char *argv[])
 {
-	signal_setup();
+	struct vrrp_instance *inst, *n;
+	int sfd;
+
+	sfd = signal_setup();
+	if (sfd == -1)
+		exit(EXIT_FAILURE);
 
 	/* Current VRRP instance */
-	struct vrrp vrrp;
-	struct vrrp_net vnet;
+	inst = vrrp_instance_new();
+	if (inst == NULL)
+		exit(EXIT_FAILURE);
 
-	/* Init VRRP instance */
-	vrrp_init(&vrrp);
-	vrrp_net_init(&vnet);
+	list_add_tail(&inst->list, &instances);
 
 	/* cmdline options */
-	if (! !vrrp_options(&vrrp, &vnet, argc, argv))
+	if (! !vrrp_options(&inst->vrrp, &inst->vnet, argc, argv))
 		exit(EXIT_FAILURE);
 
+	/* VRRP instances from configuration file */
+	if (config_name != NULL) {
+		list_del(&inst->list);
+		vrrp_cleanup(&inst->vrrp);
+		vrrp_net_cleanup(&inst->vnet);
+		free(inst);
+
+		if (vrrp_options_config(&instances, config_name) != 0)
+			exit(EXIT_FAILURE);
+	}
+
+	inst = list_first_entry(&instances, struct vrrp_instance, list);
+
 	/* pidfile init && check */
-	if (pidfile_init(vrrp.vrid) != 0)
+	if (pidfile_init(inst->vrrp.vrid) != 0)
 		exit(EXIT_FAILURE);
 
-	pidfile_check(vrrp.vrid);
+	pidfile_check(inst->vrrp.vrid);
 
 	/* logs */
 	log_open("uvrrpd", (char const *) loglevel);
 
-	/* init and open control file fifo */
-	ctrlfile_init(vrrp.vrid);
-	ctrlfile(vrrp.vrid, &vrrp.ctrl.fd);
-	if (vrrp_ctrl_init(&vrrp.ctrl) != 0)
+	/* event loop */
+	if ((vrrp_loop_init() != 0)
+	    || (vrrp_loop_add(sfd, signal_handler, NULL) != 0))
 		exit(EXIT_FAILURE);
 
-	/* open sockets */
-	if ((vrrp_net_socket(&vnet) != 0) || (vrrp_net_socket_xmit(&vnet) != 0))
-		exit(EXIT_FAILURE);
+	/* init instances */
+	atexit(ctrlfile_unlink);
+	list_for_each_entry(inst, &instances, list) {
+		if (uvrrpd_instance_init(inst) != 0)
+			exit(EXIT_FAILURE);
+	}
 
-	/* hook script */
-	if (vrrp_exec_init(&vrrp) != 0)
+	/* OpenMetrics exporter */
+	if ((metrics_addr != NULL)
+	    && (vrrp_metrics_init(metrics_addr, &instances) != 0))
 		exit(EXIT_FAILURE);
 
-	/* advertisement pkt */
-	if (vrrp_adv_init(&vnet, &vrrp) != 0)
+	/* control socket */
+	if ((ctrl_sock_path != NULL)
+	    && (vrrp_ctrl_sock_init(ctrl_sock_path, &instances) != 0))
 		exit(EXIT_FAILURE);
 
-	/* net topology */
-	if (vnet.family == AF_INET) {
-		if (vrrp_arp_init(&vnet) != 0)
-			exit(EXIT_FAILURE);
-	}
-#ifdef HAVE_IP6
-	else if (vnet.family == AF_INET6) {
-		if (vrrp_na_init(&vnet) != 0)
-			exit(EXIT_FAILURE);
-	}
-#endif
+	inst = list_first_entry(&instances, struct vrrp_instance, list);
 
 	/* daemonize */
 	if (background) {
 		if (daemon(0, (log_trigger(NULL) > LOG_INFO)) != 0) {
-			log_error("vrid %d :: daemon - %m", vrrp.vrid);
+			log_error("vrid %d :: daemon - %m", inst->vrrp.vrid);
 			exit(EXIT_FAILURE);
 		}
 	}
 	else {
 		if (chdir("/") != 0) {
-			log_error("vrid %d :: chdir - %m", vrrp.vrid);
+			log_error("vrid %d :: chdir - %m", inst->vrrp.vrid);
 			exit(EXIT_FAILURE);
 		}
 	}
 
 	/* pidfile */
-	pidfile(vrrp.vrid);
+	pidfile(inst->vrrp.vrid);
+
+	/* hook worker, spawn scripts once uvrrpd is locked into RAM */
+	list_for_each_entry(inst, &instances, list) {
+		if (!inst->vrrp.netlink) {
+			if (vrrp_worker_init() != 0)
+				log_notice("no hook worker, uvrrpd spawns scripts");
+			break;
+		}
+	}
 
 	/* lock procress's virtual address space into RAM */
 	mlockall(MCL_CURRENT | MCL_FUTURE);
 	/* set SCHED_RR */
 	uvrrpd_sched_set();
 
+	/* from now, logs never block protocol loop */
+	log_async();
+
 	/* process */
-	set_bit(KEEP_GOING, &reg);
-	while (test_bit(KEEP_GOING, &reg) && !vrrp_process(&vrrp, &vnet));
+	vrrp_loop_run(&instances);
 
 	/* shutdown */
-	vrrp_adv_cleanup(&vnet);
-
-	if (vnet.family == AF_INET)
-		vrrp_arp_cleanup(&vnet);
-#ifdef HAVE_IP6
-	else	/* AF_INET6 */
-		vrrp_na_cleanup(&vnet);
-#endif
+	vrrp_loop_cleanup();
+	vrrp_metrics_cleanup();
+	vrrp_ctrl_sock_cleanup();
+	vrrp_worker_cleanup();
+	close(sfd);
+	ctrlfile_unlink();
 
-	vrrp_cleanup(&vrrp);
-	vrrp_exec_cleanup(&vrrp);
-	vrrp_ctrl_cleanup(&vrrp.ctrl);
-	vrrp_net_cleanup(&vnet);
+	list_for_each_entry_safe(inst, n, &instances, list) {
+		list_del(&inst->list);
+		uvrrpd_instance_cleanup(inst);
+	}
 
 	log_close();
 	free(loglevel);
+	free(config_name);
+	free(metrics_addr);
+	free(ctrl_sock_path);
 	pidfile_unlink();
-	ctrlfile_unlink();
 	free(pidfile_name);
 
 	munlockall();
@@ -176,88 +211,158 @@ int main(int argc, char *argv[])
 	return EXIT_SUCCESS;
 }
 
+/**
+ * uvrrpd_instance_init() - open control fifo and sockets,
+ *                          build pkt of a VRRP instance
+ */
+static int uvrrpd_instance_init(struct vrrp_instance *inst)
+{
+	struct vrrp *vrrp = &inst->vrrp;
+	struct vrrp_net *vnet = &inst->vnet;
+
+	/* init and open control file fifo */
+	if (ctrlfile_init(vrrp) != 0)
+		return -1;
+
+	ctrlfile(vrrp);
+	if (vrrp_ctrl_init(&vrrp->ctrl) != 0)
+		return -1;
+
+	/* statistics page, next to control fifo */
+	if (vrrp_stats_init(vnet, vrrp->ctrl.name) != 0)
+		return -1;
+
+	/* open sockets */
+	if ((vrrp_net_socket(vnet) != 0) || (vrrp_net_socket_xmit(vnet) != 0))
+		return -1;
+
+	/* hook script */
+	if (vrrp_exec_init(vrrp) != 0)
+		return -1;
+
+	/* advertisement pkt */
+	if (vrrp_adv_init(vnet, vrrp) != 0)
+		return -1;
+
+	/* net topology */
+	if (vnet->family == AF_INET) {
+		if (vrrp_arp_init(vnet) != 0)
+			return -1;
+	}
+#ifdef HAVE_IP6
+	else if (vnet->family == AF_INET6) {
+		if (vrrp_na_init(vnet) != 0)
+			return -1;
+	}
+#endif
+
+	/* event loop */
+	return vrrp_loop_register(inst);
+}
+
+/**
+ * uvrrpd_instance_cleanup() - free a VRRP instance
+ */
+static void uvrrpd_instance_cleanup(struct vrrp_instance *inst)
+{
+	struct vrrp_net *vnet = &inst->vnet;
+
+	vrrp_adv_cleanup(vnet);
+
+	if (vnet->family == AF_INET)
+		vrrp_arp_cleanup(vnet);
+#ifdef HAVE_IP6
+	else	/* AF_INET6 */
+		vrrp_na_cleanup(vnet);
+#endif
+
+	vrrp_cleanup(&inst->vrrp);
+	vrrp_exec_cleanup(&inst->vrrp);
+	vrrp_ctrl_cleanup(&inst->vrrp.ctrl);
+	vrrp_net_cleanup(vnet);
+
+	free(inst);
+}
+
 
 /**
- * signal_handler - Signal handler 
+ * signal_handler - Signal handler, read pending signals on signalfd
  */
-static void signal_handler(int sig)
+static void signal_handler(int fd, __attribute__ ((unused)) void *data)
 {
-	switch (sig) {
-	case SIGHUP:
-		log_notice("HUP to the init state");
-		set_bit(UVRRPD_RELOAD, &reg);
-		break;
-
-	case SIGUSR1:
-	case SIGUSR2:
-		set_bit(UVRRPD_DUMP, &reg);
-		break;
-
-	case SIGPIPE:
-		log_notice("this is not a SIGPIPE");
-		set_bit(UVRRPD_LOGOUT, &reg);
-		break;
-
-	case SIGINT:
-	case SIGTERM:
-	case SIGQUIT:
-		log_notice("%s - exit daemon", strsignal(sig));
-		set_bit(UVRRPD_RELOAD, &reg);
-		clear_bit(KEEP_GOING, &reg);
-		break;
-
-	case SIGCHLD:
-		/* bleh */
-		break;
-
-	default:
-		log_error("%s %d", strsignal(sig), sig);
-		break;
+	struct signalfd_siginfo si;
+	int sig;
+
+	while (read(fd, &si, sizeof(si)) == sizeof(si)) {
+		sig = si.ssi_signo;
+
+		switch (sig) {
+		case SIGHUP:
+			log_notice("HUP to the init state");
+			set_bit(UVRRPD_RELOAD, &reg);
+			break;
+
+		case SIGUSR1:
+		case SIGUSR2:
+			set_bit(UVRRPD_DUMP, &reg);
+			break;
+
+		case SIGPIPE:
+			log_notice("this is not a SIGPIPE");
+			set_bit(UVRRPD_LOGOUT, &reg);
+			break;
+
+		case SIGINT:
+		case SIGTERM:
+		case SIGQUIT:
+			log_notice("%s - exit daemon", strsignal(sig));
+			set_bit(UVRRPD_RELOAD, &reg);
+			clear_bit(KEEP_GOING, &reg);
+			break;
+
+		default:
+			log_error("%s %d", strsignal(sig), sig);
+			break;
+		}
 	}
 }
 
 /**
  * signal_setup
- *    - register signal handler
+ *    - block signals and get them from a signalfd read by event loop
  *    - SIGTERM: shutdown daemon
  *    - SIGHUP:  reload daemon (switch to init state)
- *    - SIGCHLD: notify end of task (vrrp_exec())
  *    - SIGUSR1: logs daemon context: vrrp_context()
  *    - SIGUSR2: todo, same as USR1 for the moment
  *    - SIGPIPE: socket write failure
  *
- *   - blocked signal, unblocked them on select() syscall vrrp_process()
+ *   SIGCHLD is left to vrrp_exec() which waits for its child
+ *
+ * @return signalfd, -1 on error
  */
-static void signal_setup(void)
+static int signal_setup(void)
 {
-	struct sigaction sa;
-
-	/* setup signal */
-	memset(&sa, 0x00, sizeof(sa));
-	sa.sa_handler = signal_handler;
-	sa.sa_flags = 0;
-
-	sigaction(SIGINT, &sa, NULL);
-	sigaction(SIGTERM, &sa, NULL);
-	sigaction(SIGQUIT, &sa, NULL);
-	sigaction(SIGHUP, &sa, NULL);
-	sigaction(SIGCHLD, &sa, NULL);
-	sigaction(SIGUSR1, &sa, NULL);
-	sigaction(SIGUSR2, &sa, NULL);
-	sigaction(SIGALRM, &sa, NULL);
-	sigaction(SIGPIPE, &sa, NULL);
-
-	/* setup signal mask */
-	sigemptyset(&sa.sa_mask);
-
-	sigaddset(&sa.sa_mask, SIGINT);
-	sigaddset(&sa.sa_mask, SIGTERM);
-	sigaddset(&sa.sa_mask, SIGQUIT);
-	sigaddset(&sa.sa_mask, SIGHUP);
-	sigaddset(&sa.sa_mask, SIGUSR1);
-	sigaddset(&sa.sa_mask, SIGUSR2);
-
-	sigprocmask(SIG_BLOCK, &sa.sa_mask, NULL);
+	sigset_t mask;
+	int fd;
+
+	sigemptyset(&mask);
+
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGQUIT);
+	sigaddset(&mask, SIGHUP);
+	sigaddset(&mask, SIGUSR1);
+	sigaddset(&mask, SIGUSR2);
+	sigaddset(&mask, SIGALRM);
+	sigaddset(&mask, SIGPIPE);
+
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+
+	fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (fd == -1)
+		log_error("signalfd - %m");
+
+	return fd;
 }
 
 /**
@@ -273,7 +378,11 @@ static int pidfile_init(int vrid)
 			return -1;
 		}
 
-		snprintf(pidfile_name, max_len, PIDFILE_NAME, vrid);
+		if (config_name != NULL)
+			snprintf(pidfile_name, max_len, "%s",
+				 PIDFILE_MULTI_NAME);
+		else
+			snprintf(pidfile_name, max_len, PIDFILE_NAME, vrid);
 	}
 
 	return 0;
@@ -380,54 +489,68 @@ static void pidfile(int vrid)
 /**
  * ctrlfile_init()
  */
-static int ctrlfile_init(int vrid)
+static int ctrlfile_init(struct vrrp *vrrp)
 {
+	struct vrrp_instance *inst;
 	int max_len = NAME_MAX + PATH_MAX;
-	if (ctrlfile_name == NULL) {
-		ctrlfile_name = malloc(max_len);
-		if (ctrlfile_name == NULL) {
-			log_error("vrid %d :: malloc - %m", vrid);
+
+	if (vrrp->ctrl.name == NULL) {
+		vrrp->ctrl.name = malloc(max_len);
+		if (vrrp->ctrl.name == NULL) {
+			log_error("vrid %d :: malloc - %m", vrrp->vrid);
 			return -1;
 		}
 
-		snprintf(ctrlfile_name, max_len, CTRLFILE_NAME, vrid);
+		snprintf(vrrp->ctrl.name, max_len, CTRLFILE_NAME, vrrp->vrid);
+	}
+
+	/* control fifo must be unique */
+	list_for_each_entry(inst, &instances, list) {
+		if (&inst->vrrp == vrrp)
+			break;
+
+		if (strcmp(inst->vrrp.ctrl.name, vrrp->ctrl.name) == 0) {
+			log_error("vrid %d :: control fifo %s already used, "
+				  "use option -C", vrrp->vrid, vrrp->ctrl.name);
+			return -1;
+		}
 	}
 
 	return 0;
 }
 
 /**
- * ctrlfile_unlink()
+ * ctrlfile_unlink() - remove control fifos and statistics files
  */
 static void ctrlfile_unlink()
 {
-	if (ctrlfile_name)
-		unlink(ctrlfile_name);
+	struct vrrp_instance *inst;
+
+	list_for_each_entry(inst, &instances, list) {
+		if ((inst->vrrp.ctrl.name != NULL) && (inst->vrrp.ctrl.fd != -1))
+			unlink(inst->vrrp.ctrl.name);
+		if (inst->vnet.stats_name != NULL)
+			unlink(inst->vnet.stats_name);
+	}
 }
 
 /**
  * ctrlfile()
  */
-static void ctrlfile(int vrid, int *fd)
+static void ctrlfile(struct vrrp *vrrp)
 {
-	if (fd == NULL) {
-		log_error("vrid %d :: invalid use of ctrlfile(), fd NULL", vrid);
+	unlink(vrrp->ctrl.name);
+	if (mkfifo(vrrp->ctrl.name, 0600) != 0) {
+		log_error("vrid %d :: error while creating control fifo %s: %m",
+			  vrrp->vrid, vrrp->ctrl.name);
 		exit(EXIT_FAILURE);
 	}
 
-	ctrlfile_unlink();
-	if (mkfifo(ctrlfile_name, 0600) != 0) {
-		log_error("vrid %d :: error while creating control fifo %s: %m", vrid,
-			  ctrlfile_name);
-		exit(EXIT_FAILURE);
-	}
-
-	atexit(ctrlfile_unlink);
-
-	*fd = open(ctrlfile_name, O_RDWR | O_NONBLOCK);
-	if (*fd == -1) {
-		log_error("vrid %d :: error while opening control fifo %s: %m", vrid,
-			  ctrlfile_name);
+	vrrp->ctrl.fd = open(vrrp->ctrl.name, O_RDWR | O_NONBLOCK);
+	if (vrrp->ctrl.fd == -1) {
+		log_error("vrid %d :: error while opening control fifo %s: %m",
+			  vrrp->vrid, vrrp->ctrl.name);
+		unlink(vrrp->ctrl.name);
 		exit(EXIT_FAILURE);
 	}
 }
@@ -25,21 +25,28 @@
 #include "bits.h"
 
 #define PIDFILE_NAME	stringify(PATHRUN) "/uvrrpd_%d.pid"
+#define PIDFILE_MULTI_NAME	stringify(PATHRUN) "/uvrrpd.pid"
 #define CTRLFILE_NAME	stringify(PATHRUN) "/uvrrpd_ctrl.%d"
 
 /** 
  * uvrrpd_control
- * Enum server control register flags
+ * Enum server control register flags, bit numbers for set_bit()
  */
 enum uvrrpd_control {
 	/* daemon keep going bit */
-	KEEP_GOING = BIT_MASK(0),
+	KEEP_GOING = 0,
 	/* daemon dump bit */
-	UVRRPD_DUMP = BIT_MASK(1),
+	UVRRPD_DUMP = 1,
 	/* daemon logout bit */
-	UVRRPD_LOGOUT = BIT_MASK(2),
+	UVRRPD_LOGOUT = 2,
 	/* daemon reload bit */
-	UVRRPD_RELOAD = BIT_MASK(3),
+	UVRRPD_RELOAD = 3,
+	/* daemon timeline dump bit */
+	UVRRPD_TIMELINE = 4,
+	/* instance priority, adv interval or preempt changed in place */
+	UVRRPD_RECONF = 5,
+	/* instance VIP set changed in place */
+	UVRRPD_RECONF_VIP = 6,
 };
 
 int uvrrpd_sched_set(void);
@@ -20,9 +20,7 @@
  */
 
 #include <stdio.h>
-/* pselect() */
-#include <sys/select.h>
-#include <signal.h>
+#include <sys/wait.h>
 
 #include "vrrp.h"
 #include "vrrp_timer.h"
@@ -35,8 +33,6 @@
 
 #include "log.h"
 
-extern unsigned long reg;
-
 /**
  * vrrp_init() - init struct vrrp with default values
  */
@@ -60,13 +56,50 @@ void vrrp_init(struct vrrp *vrrp)
 	/* script */
 	vrrp->scriptname = NULL;
 	vrrp->argv = NULL;
+	vrrp->netlink = FALSE;
+	vrrp->hook.pid = 0;
+	vrrp->hook.pidfd = -1;
+	vrrp->hook.worker = FALSE;
+	vrrp->hook.timeout = VRRP_SCRIPT_TIMEOUT;
+	vrrp->hook.head = 0;
+	vrrp->hook.len = 0;
+	vrrp->hook.status = 0;
+	vrrp->hook.duration = 0;
+	vrrp_timer_init(&vrrp->hook.timer, NULL, NULL);
+
+	/* control */
+	vrrp->ctrl.fd = -1;
+	vrrp->ctrl.name = NULL;
+	vrrp->ctrl.cmd = NULL;
+	vrrp->reg = 0UL;
 
 	/* timers */
 	vrrp->adv_int = 0;
 	vrrp->start_delay = 0;
 	vrrp->master_adv_int = 0;
-	vrrp_timer_clear(&vrrp->adv_timer);
-	vrrp_timer_clear(&vrrp->masterdown_timer);
+	vrrp_timer_init(&vrrp->adv_timer, NULL, NULL);
+	vrrp_timer_init(&vrrp->masterdown_timer, NULL, NULL);
+
+	vrrp_timeline_init(&vrrp->timeline);
+}
+
+/**
+ * vrrp_instance_new() - allocate a VRRP instance with default values
+ */
+struct vrrp_instance *vrrp_instance_new(void)
+{
+	struct vrrp_instance *inst = malloc(sizeof(struct vrrp_instance));
+
+	if (inst == NULL) {
+		log_error("malloc - %m");
+		return NULL;
+	}
+
+	vrrp_init(&inst->vrrp);
+	vrrp_net_init(&inst->vnet);
+	INIT_LIST_HEAD(&inst->list);
+
+	return inst;
 }
 
 /**
@@ -87,22 +120,52 @@ static void vrrp_context(struct vrrp *vrrp)
 }
 
 
+/**
+ * vrrp_hook_report() - log exit status and duration of hook script
+ */
+static void vrrp_hook_report(struct vrrp *vrrp)
+{
+	struct vrrp_hook *hook = &vrrp->hook;
+
+	if (WIFSIGNALED(hook->status))
+		log_warning("vrid %d :: hook %s killed by signal %d after %ld ms",
+			    vrrp->vrid, STR_STATE(hook->state),
+			    WTERMSIG(hook->status), hook->duration);
+	else if (WEXITSTATUS(hook->status) != 0)
+		log_warning("vrid %d :: hook %s exit %d after %ld ms",
+			    vrrp->vrid, STR_STATE(hook->state),
+			    WEXITSTATUS(hook->status), hook->duration);
+	else
+		log_info("vrid %d :: hook %s done in %ld ms", vrrp->vrid,
+			 STR_STATE(hook->state), hook->duration);
+}
+
 /**
  * vrrp_process() - vrrp control and state machine
+ *
+ * Feed @event to the current state of the instance
  */
-int vrrp_process(struct vrrp *vrrp, struct vrrp_net *vnet)
+int vrrp_process(struct vrrp *vrrp, struct vrrp_net *vnet,
+		 vrrp_event_t event)
 {
+	/* hook script terminated, status in vrrp->hook */
+	if (event == HOOK) {
+		vrrp_timeline_hook_done(&vrrp->timeline, vrrp->hook.state);
+		vrrp_hook_report(vrrp);
+		return 0;
+	}
+
 	switch (vrrp->state) {
 	case INIT:
 		vrrp_state_init(vrrp, vnet);
 		break;
 
 	case BACKUP:
-		vrrp_state_backup(vrrp, vnet);
+		vrrp_state_backup(vrrp, vnet, event);
 		break;
 
 	case MASTER:
-		vrrp_state_master(vrrp, vnet);
+		vrrp_state_master(vrrp, vnet, event);
 		break;
 
 	default:
@@ -111,96 +174,15 @@ int vrrp_process(struct vrrp *vrrp, struct vrrp_net *vnet)
 		break;
 	}
 
-	if (test_and_clear_bit(UVRRPD_DUMP, &reg))
+	if (test_and_clear_bit(UVRRPD_DUMP, &vrrp->reg))
 		vrrp_context(vrrp);
 
-	return 0;
-}
+	if (test_and_clear_bit(UVRRPD_TIMELINE, &vrrp->reg))
+		vrrp_timeline_dump(vrrp);
 
-/**
- * vrrp_listen() - Wait for a event (VRRP pkt, msg on fifo ...)
- *
- * @return vrrp_event_t
- *   TIMER if current timer is expired
- *   another event else
- */
-vrrp_event_t vrrp_listen(struct vrrp *vrrp, struct vrrp_net *vnet)
-{
-	struct vrrp_timer *vt;
-	int max_fd;
-
-	/* Check which timer is running
-	 * Advertisement timer or Masterdown timer ? 
-	 */
-	if (vrrp_timer_is_running(&vrrp->adv_timer)) {
-		log_debug("vrid %d :: adv_timer is running", vrrp->vrid);
-		vt = &vrrp->adv_timer;
-	}
-	else if (vrrp_timer_is_running(&vrrp->masterdown_timer)) {
-		log_debug("vrid %d :: masterdown_timer is running", vrrp->vrid);
-		vt = &vrrp->masterdown_timer;
-	}
-	else {	/* No timer ? ... exit */
-		log_error("vrid %d :: no timer running !", vrrp->vrid);
-		/* TODO die() */
-		exit(EXIT_FAILURE);
-	}
-
-	/* update timer before pselect() */
-	if (vrrp_timer_update(vt)) {
-		log_debug("vrid %d :: timer expired before pselect",
-			  vrrp->vrid);
-		/* timer expired or invalid */
-		return TIMER;
-	}
-
-	/* pselect */
-	fd_set readfds;
-	FD_ZERO(&readfds);
-	FD_SET(vnet->socket, &readfds);
-	FD_SET(vrrp->ctrl.fd, &readfds);
-	max_fd = max(vnet->socket, vrrp->ctrl.fd);
-
-	sigset_t emptyset;
-	sigemptyset(&emptyset);
-
-	/* Wait for packet or timer expiration */
-	if (pselect
-	    (max_fd + 1, &readfds, NULL, NULL,
-	     (const struct timespec *) &vt->delta, &emptyset) >= 0) {
-
-
-		/* Timer is expired */
-		if (vrrp_timer_is_expired(vt)) {
-			log_debug("vrid %d :: timer expired", vrrp->vrid);
-			return TIMER;
-		}
-
-		/* Else we have received a pkt */
-		log_debug("vrid %d :: VRRP pkt received", vrrp->vrid);
-
-		if (FD_ISSET(vnet->socket, &readfds)) 
-			/* check if received is valid or not */
-			return vrrp_net_recv(vnet, vrrp);
-
-		if (FD_ISSET(vrrp->ctrl.fd, &readfds)) {
-			return vrrp_ctrl_read(vrrp, vnet);
-		}
-	}
-	else {	/* Signal or pselect error */
-		if (errno == EINTR) {
-			log_debug("vrid %d :: signal caught", vrrp->vrid);
-
-			return SIGNAL;
-		}
-
-		log_error("vrid %d :: pselect - %m", vrrp->vrid);
-	}
-
-	return INVALID;
+	return 0;
 }
 
-
 /**
  * vrrp_cleanup() - clean before exiting
  */
@@ -208,4 +190,6 @@ void vrrp_cleanup(struct vrrp *vrrp)
 {
 	free(vrrp->scriptname);
 	free(vrrp->auth_data);
+	vrrp_timer_clear(&vrrp->adv_timer);
+	vrrp_timer_clear(&vrrp->masterdown_timer);
 }
@@ -24,12 +24,15 @@
 #define _VRRP_H_
 
 #include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
 
 #include "common.h"
 #include "vrrp_net.h"
 #include "vrrp_timer.h"
 #include "vrrp_state.h"
 #include "vrrp_ctrl.h"
+#include "vrrp_timeline.h"
 
 /* MAX values */
 #define VRID_MAX        255
@@ -44,6 +47,8 @@
 /* External script */
 #define VRRP_SCRIPT     stringify(PATH) "/vrrp_switch.sh"
 #define VRRP_SCRIPT_MAX sysconf(_SC_ARG_MAX)
+#define VRRP_SCRIPT_TIMEOUT 30	/* s */
+#define VRRP_SCRIPT_TIMEOUT_MAX 3600
 
 /* preemption */
 #define STR_PREEMPT(s) (s == TRUE ? "true" : "false")
@@ -71,6 +76,32 @@ typedef enum {
 	HMAC			/* not supported */
 } vrrp_authtype;
 
+/* hook states waiting for the running script */
+#define VRRP_HOOK_QUEUE 8
+
+/**
+ * vrrp_hook - hook script run asynchronously
+ */
+struct vrrp_hook {
+	pid_t pid;		/* running script, 0 if none */
+	int pidfd;
+	bool worker;		/* running script spawned by hook worker */
+	vrrp_state state;
+	struct timespec start;
+
+	/* kill script after timeout s, 0 to never kill it */
+	time_t timeout;
+	struct vrrp_timer timer;
+
+	vrrp_state queue[VRRP_HOOK_QUEUE];
+	int head;
+	int len;
+
+	/* last script exit status and duration (ms) */
+	int status;
+	long duration;
+};
+
 /**
  * vrrp - Main structure defining VRRP instance
  */
@@ -110,12 +141,20 @@ struct vrrp {
 
 	char *scriptname;
 	char **argv;
+	bool netlink;		/* rtnetlink backend instead of script */
+	struct vrrp_hook hook;
 
 	/* control cmd fifo */
 	struct vrrp_ctrl ctrl;
 
+	/* instance control register (enum uvrrpd_control) */
+	unsigned long reg;
+
 	struct vrrp_timer adv_timer;
 	struct vrrp_timer masterdown_timer;
+
+	/* last transitions */
+	struct vrrp_timeline timeline;
 };
 
 /**
@@ -127,14 +166,29 @@ enum _vrrp_event_type {
 	PKT,			/* valid packet */
 	SIGNAL,			/* signal catch */
 	CTRL_FIFO,		/* ctrl cmd event */
-	TIMER			/* timer expired */
+	TIMER,			/* timer expired */
+	HOOK			/* hook script terminated */
 };
 
 typedef enum _vrrp_event_type vrrp_event_t;
+
+/**
+ * vrrp_instance - VRRP instance and its net layer,
+ *                 as managed by the event loop
+ */
+struct vrrp_instance {
+	struct vrrp vrrp;
+	struct vrrp_net vnet;
+
+	/* instances table */
+	struct list_head list;
+};
+
 /* funcs */
 void vrrp_init(struct vrrp *vrrp);
 void vrrp_cleanup(struct vrrp *vrrp);
-int vrrp_process(struct vrrp *vrrp, struct vrrp_net *vnet);
-vrrp_event_t vrrp_listen(struct vrrp *vrrp, struct vrrp_net *vnet);
+struct vrrp_instance *vrrp_instance_new(void);
+int vrrp_process(struct vrrp *vrrp, struct vrrp_net *vnet,
+		 vrrp_event_t event);
 
 #endif /* _VRRP_H_ */
@@ -20,6 +20,7 @@
  */
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <linux/if_ether.h>	// ETH_P_IP = 0x0800, ETH_P_IPV6 = 0x86DD
@@ -32,6 +33,7 @@
 #include "log.h"
 #include "vrrp.h"
 #include "vrrp_net.h"
+#include "vrrp_probe.h"
 #include "vrrp_rfc.h"
 
 /* VRRP multicast group */
@@ -45,6 +47,13 @@
 
 #define VRRP_TYPE_ADV   1
 
+/* __adv[] index of priority 0 VRRP header */
+#define VRRP_ADV_ZERO   3
+
+/* 16 bits words of VRRP header holding priority and adv interval */
+#define VRRP_ADV_PRIO_WORD   offsetof(struct vrrphdr, priority)
+#define VRRP_ADV_ADVINT_WORD offsetof(struct vrrphdr, max_adv_int)
+
 /**
  * ether_header vrrp_adv_eth - VRRP ethernet header
  */
@@ -66,17 +75,12 @@ static struct ether_header vrrp_adv_eth = {
 /**
  * vrrp_adv_eth_build() - build VRRP adv ethernet header
  */
-static int vrrp_adv_eth_build(struct iovec *iov, const uint8_t vrid,
-			      const int family)
+static int vrrp_adv_eth_build(struct iovec *iov, void *buf,
+			      const uint8_t vrid, const int family)
 {
-	iov->iov_base = malloc(sizeof(struct ether_header));
+	iov->iov_base = buf;
 	struct ether_header *hdr = iov->iov_base;
 
-	if (hdr == NULL) {
-		log_error("vrid %d :: malloc - %m", vrid);
-		return -1;
-	}
-
 	memcpy(hdr, &vrrp_adv_eth, sizeof(struct ether_header));
 	hdr->ether_shost[5] = vrid;
 	if (family == AF_INET)
@@ -93,17 +97,13 @@ static int vrrp_adv_eth_build(struct iovec *iov, const uint8_t vrid,
 /**
  * vrrp_adv_ip4_build() - build VRRP IPv4 advertisement
  */
-static int vrrp_adv_ip4_build(struct iovec *iov, const struct vrrp_net *vnet)
+static int vrrp_adv_ip4_build(struct iovec *iov, void *buf,
+			      const struct vrrp_net *vnet)
 {
-	iov->iov_base = malloc(sizeof(struct iphdr));
+	iov->iov_base = buf;
 
 	struct iphdr *iph = iov->iov_base;
 
-	if (iph == NULL) {
-		log_error("vrid %d :: malloc - %m", vnet->vrid);
-		return -1;
-	}
-
 	iph->ihl = 0x5;
 	iph->version = IPVERSION;
 	iph->tos = 0x00;
@@ -128,17 +128,13 @@ static int vrrp_adv_ip4_build(struct iovec *iov, const struct vrrp_net *vnet)
  * vrrp_adv_ip6_build() - build VRRP IPv6 advertisement
  */
 #ifdef HAVE_IP6
-static int vrrp_adv_ip6_build(struct iovec *iov, const struct vrrp_net *vnet)
+static int vrrp_adv_ip6_build(struct iovec *iov, void *buf,
+			      const struct vrrp_net *vnet)
 {
-	iov->iov_base = malloc(sizeof(struct ip6_hdr));
+	iov->iov_base = buf;
 
 	struct ip6_hdr *ip6h = iov->iov_base;
 
-	if (ip6h == NULL) {
-		log_error("vrid %d :: malloc - %m", vnet->vrid);
-		return -1;
-	}
-
 	ip6h->ip6_flow = htonl((6 << 28) | (0 << 20) | 0);
 	ip6h->ip6_plen = htons(vnet->adv_getsize(vnet));
 	ip6h->ip6_nxt = IPPROTO_VRRP;
@@ -160,18 +156,13 @@ static int vrrp_adv_ip6_build(struct iovec *iov, const struct vrrp_net *vnet)
 /**
  * vrrp_net_adv_build() - build VRRP adv pkt
  */
-static int vrrp_adv_build(struct iovec *iov, const struct vrrp_net *vnet,
-			  const struct vrrp *vrrp)
+static int vrrp_adv_build(struct iovec *iov, void *buf,
+			  const struct vrrp_net *vnet, const struct vrrp *vrrp)
 {
-	iov->iov_base = malloc(vnet->adv_getsize(vnet));
+	iov->iov_base = buf;
 
 	struct vrrphdr *pkt = iov->iov_base;
 
-	if (pkt == NULL) {
-		log_error("vrid %d :: malloc - %m", vnet->vrid);
-		return -1;
-	}
-
 	pkt->version_type = (vrrp->version << 4) | VRRP_TYPE_ADV;
 	pkt->vrid = vnet->vrid;
 	pkt->priority = vrrp->priority;
@@ -224,7 +215,8 @@ static int vrrp_adv_build(struct iovec *iov, const struct vrrp_net *vnet,
 	}
 
 	/* chksum */
-	pkt->chksum = vnet->adv_checksum(vnet, pkt, NULL, NULL);
+	pkt->chksum = vnet->adv_checksum(vnet, pkt, vnet->adv_getsize(vnet),
+					 NULL, NULL);
 
 	/* iov_len */
 	iov->iov_len = vnet->adv_getsize(vnet);
@@ -232,12 +224,88 @@ static int vrrp_adv_build(struct iovec *iov, const struct vrrp_net *vnet,
 	return 0;
 }
 
+/**
+ * vrrp_adv_word() - read a 16 bits word of VRRP header
+ */
+static inline uint16_t vrrp_adv_word(const struct vrrphdr *pkt, size_t off)
+{
+	uint16_t word;
+
+	memcpy(&word, (const unsigned char *) pkt + off, sizeof(uint16_t));
+
+	return word;
+}
+
+/**
+ * vrrp_adv_prio() - set priority of VRRP header, update chksum
+ */
+static void vrrp_adv_prio(struct vrrphdr *pkt, uint8_t prio)
+{
+	uint16_t old = vrrp_adv_word(pkt, VRRP_ADV_PRIO_WORD);
+
+	pkt->priority = prio;
+	pkt->chksum = cksum_replace(pkt->chksum, old,
+				    vrrp_adv_word(pkt, VRRP_ADV_PRIO_WORD));
+}
+
+/**
+ * vrrp_adv_advint() - set adv interval of VRRP header, update chksum
+ */
+static void vrrp_adv_advint(struct vrrphdr *pkt, uint16_t adv_int)
+{
+	uint16_t old = vrrp_adv_word(pkt, VRRP_ADV_ADVINT_WORD);
+
+	if ((pkt->version_type >> 4) == RFC5798)
+		pkt->max_adv_int = htons(adv_int);
+	else
+		pkt->adv_int = adv_int;
+
+	pkt->chksum = cksum_replace(pkt->chksum, old,
+				    vrrp_adv_word(pkt, VRRP_ADV_ADVINT_WORD));
+}
+
+/**
+ * vrrp_adv_zero_build() - build VRRP adv frame with priority 0 from
+ *                         VRRP adv frame
+ */
+static int vrrp_adv_zero_build(struct vrrp_net *vnet)
+{
+	struct iovec *frame = &vnet->__adv_frame[0];
+	unsigned char *zero;
+
+	zero = vrrp_arena_frame(&vnet->__adv_arena, frame->iov_len);
+	if (zero == NULL)
+		return -1;
+
+	memcpy(zero, frame->iov_base, frame->iov_len);
+
+	vnet->__adv_frame[1].iov_base = zero;
+	vnet->__adv_frame[1].iov_len = frame->iov_len;
+
+	/* VRRP header, same offset as in adv frame */
+	vnet->__adv[VRRP_ADV_ZERO].iov_base = zero
+	    + ((unsigned char *) vnet->__adv[2].iov_base
+	       - (unsigned char *) frame->iov_base);
+	vnet->__adv[VRRP_ADV_ZERO].iov_len = vnet->__adv[2].iov_len;
+
+	vrrp_adv_prio(vnet->__adv[VRRP_ADV_ZERO].iov_base, 0);
+
+	return 0;
+}
+
 /**
  * vrrp_adv_send() - send VRRP adv pkt
  */
 int vrrp_adv_send(struct vrrp_net *vnet)
 {
-	return vrrp_net_send(vnet, vnet->__adv, ARRAY_SIZE(vnet->__adv));
+	if (vrrp_net_send(vnet, &vnet->__adv_frame[0], 1) == -1)
+		return -1;
+
+	vrrp_stats_inc(&vnet->stats->adv_sent);
+	VRRP_PROBE2(adv_send, vnet->vrid,
+		    ((struct vrrphdr *) vnet->__adv[2].iov_base)->priority);
+
+	return 0;
 }
 
 /**
@@ -245,45 +313,85 @@ int vrrp_adv_send(struct vrrp_net *vnet)
  */
 int vrrp_adv_send_zero(struct vrrp_net *vnet)
 {
-	/* get adv buffer */
-	struct iovec *iov = &vnet->__adv[2];
-	struct vrrphdr *pkt = iov->iov_base;
+	if (vrrp_net_send(vnet, &vnet->__adv_frame[1], 1) == -1)
+		return -1;
 
-	/* set priority to 0 and recompute checksum */
-	uint8_t priority = pkt->priority;
-	pkt->priority = 0;
-	uint16_t chksum = pkt->chksum;
+	vrrp_stats_inc(&vnet->stats->adv_sent);
+	VRRP_PROBE2(adv_send, vnet->vrid, 0);
 
-	/* chksum */
-	pkt->chksum = vnet->adv_checksum(vnet, pkt, NULL, NULL);
+	return 0;
+}
+
+/**
+ * vrrp_adv_set_priority() - set priority in emitted adv pkt
+ */
+void vrrp_adv_set_priority(struct vrrp_net *vnet, uint8_t prio)
+{
+	struct vrrphdr *pkt = vnet->__adv[2].iov_base;
 
-	/* send adv pkt */
-	int ret = vrrp_net_send(vnet, vnet->__adv, ARRAY_SIZE(vnet->__adv));
+	vrrp_adv_prio(pkt, prio);
 
-	/* restaure original priority and checksum */
-	pkt->priority = priority;
-	pkt->chksum = chksum;
+	log_notice("vrid %d :: new prio %d applied", vnet->vrid, pkt->priority);
+}
 
-	return ret;
+/**
+ * vrrp_adv_set_advint() - set adv interval in emitted adv pkt,
+ *                         priority 0 adv pkt included
+ */
+void vrrp_adv_set_advint(struct vrrp_net *vnet, uint16_t adv_int)
+{
+	vrrp_adv_advint(vnet->__adv[2].iov_base, adv_int);
+	vrrp_adv_advint(vnet->__adv[VRRP_ADV_ZERO].iov_base, adv_int);
 }
 
 /**
  * vrrp_adv_init() - init advertisement pkt to send 
+ *
+ * Advertisement and priority 0 advertisement are two contiguous
+ * frames of the same arena.
  */
 int vrrp_adv_init(struct vrrp_net *vnet, const struct vrrp *vrrp)
 {
+	struct vrrp_arena *arena = &vnet->__adv_arena;
+	unsigned char *frame;
+	size_t iphlen, len;
 	int status = -1;
 
-	status = vrrp_adv_eth_build(&vnet->__adv[0], vnet->vrid, vnet->family);
+	iphlen = IPHDR_SIZE;
+#ifdef HAVE_IP6
+	if (vnet->family == AF_INET6)
+		iphlen = sizeof(struct ip6_hdr);
+#endif /* HAVE_IP6 */
+
+	len = ETHDR_SIZE + iphlen + vnet->adv_getsize(vnet);
+
+	/* rebuilt in place when VIPs or primary address change */
+	if (vrrp_arena_reserve(arena, 2 * VRRP_ARENA_FRAME(len)) != 0)
+		return -1;
+
+	frame = vrrp_arena_frame(arena, len);
+
+	status = vrrp_adv_eth_build(&vnet->__adv[0], frame, vnet->vrid,
+				    vnet->family);
 
 	if (vnet->family == AF_INET)
-		status |= vrrp_adv_ip4_build(&vnet->__adv[1], vnet);
+		status |= vrrp_adv_ip4_build(&vnet->__adv[1],
+					     frame + ETHDR_SIZE, vnet);
 #ifdef HAVE_IP6
 	else /* AF_INET6 */
-		status |= vrrp_adv_ip6_build(&vnet->__adv[1], vnet);
+		status |= vrrp_adv_ip6_build(&vnet->__adv[1],
+					     frame + ETHDR_SIZE, vnet);
 #endif /* HAVE_IP6 */
 
-	status |= vrrp_adv_build(&vnet->__adv[2], vnet, vrrp);
+	status |= vrrp_adv_build(&vnet->__adv[2], frame + ETHDR_SIZE + iphlen,
+				 vnet, vrrp);
+
+	vnet->__adv_frame[0].iov_base = frame;
+	vnet->__adv_frame[0].iov_len = len;
+
+	/* shutdown or demotion adv pkt, sent without recomputing chksum */
+	if (status == 0)
+		status = vrrp_adv_zero_build(vnet);
 
 	return status;
 }
@@ -293,9 +401,9 @@ int vrrp_adv_init(struct vrrp_net *vnet, const struct vrrp *vrrp)
  */
 void vrrp_adv_cleanup(struct vrrp_net *vnet)
 {
-	/* clean iovec */
-	for (int i = 0; i < 3; ++i) {
-		struct iovec *iov = &vnet->__adv[i];
-		free(iov->iov_base);
-	}
+	/* all frames at once */
+	vrrp_arena_cleanup(&vnet->__adv_arena);
+
+	bzero(vnet->__adv, sizeof(vnet->__adv));
+	bzero(vnet->__adv_frame, sizeof(vnet->__adv_frame));
 }
@@ -27,6 +27,8 @@ int vrrp_adv_init(struct vrrp_net *vnet, const struct vrrp *vrrp);
 void vrrp_adv_cleanup(struct vrrp_net *vnet);
 int vrrp_adv_send(struct vrrp_net *vnet);
 int vrrp_adv_send_zero(struct vrrp_net *vnet);
+void vrrp_adv_set_priority(struct vrrp_net *vnet, uint8_t prio);
+void vrrp_adv_set_advint(struct vrrp_net *vnet, uint16_t adv_int);
 uint16_t vrrp_adv_chksum(struct vrrp_net *vnet, struct vrrphdr *pkt,
 			 uint32_t saddr, uint32_t daddr);
 #ifdef HAVE_IP6
@@ -39,7 +41,10 @@ uint16_t vrrp_adv_ip6_chksum(struct vrrp_net *vnet, struct vrrphdr *pkt,
  */
 static inline int vrrp_adv_get_version(const struct vrrp_net *vnet)
 {
-	return vnet->__pkt.adv.version_type;
+	if (vnet->__pkt == NULL)
+		return 0;
+
+	return vnet->__pkt->adv->version_type;
 }
 
 /**
@@ -47,21 +52,7 @@ static inline int vrrp_adv_get_version(const struct vrrp_net *vnet)
  */
 static inline int vrrp_adv_get_priority(const struct vrrp_net *vnet)
 {
-	return vnet->__pkt.adv.priority;
-}
-
-/**
- * vrrp_adv_set_priority() - set priority in emitted adv pkt
- */
-static inline void vrrp_adv_set_priority(struct vrrp_net *vnet, uint8_t prio)
-{
-	struct vrrphdr *pkt = vnet->__adv[2].iov_base;
-	pkt->priority = prio;
-
-	/* recompute chksum */
-	pkt->chksum = vnet->adv_checksum(vnet, pkt, NULL, NULL);
-
-	log_notice("vrid %d :: new prio %d applied", vnet->vrid, pkt->priority);
+	return vnet->__pkt->adv->priority;
 }
 
 /**
@@ -70,7 +61,7 @@ static inline void vrrp_adv_set_priority(struct vrrp_net *vnet, uint8_t prio)
  */
 static inline const char *vrrp_adv_addr_to_str(struct vrrp_net *vnet, char *dst)
 {
-	return vnet->ipx_to_str(&vnet->__pkt.s_ipx, dst);
+	return vnet->ipx_to_str(&vnet->__pkt->s_ipx, dst);
 }
 
 /**
@@ -79,7 +70,7 @@ static inline const char *vrrp_adv_addr_to_str(struct vrrp_net *vnet, char *dst)
  */
 static inline int vrrp_adv_addr_cmp(struct vrrp_net *vnet)
 {
-	return vnet->ipx_cmp(&vnet->__pkt.s_ipx, &vnet->vif.ipx);
+	return vnet->ipx_cmp(&vnet->__pkt->s_ipx, &vnet->vif.ipx);
 }
 
 /**
@@ -87,10 +78,10 @@ static inline int vrrp_adv_addr_cmp(struct vrrp_net *vnet)
  */
 static inline uint16_t vrrp_adv_get_advint(const struct vrrp_net *vnet)
 {
-	if (vnet->__pkt.adv.version_type >> 4 == RFC5798)
-		return ntohs(vnet->__pkt.adv.max_adv_int);
+	if (vnet->__pkt->adv->version_type >> 4 == RFC5798)
+		return ntohs(vnet->__pkt->adv->max_adv_int);
 
-	return vnet->__pkt.adv.adv_int;
+	return vnet->__pkt->adv->adv_int;
 
 }
 #endif /* _VRRP_ADV_H_ */
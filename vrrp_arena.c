@@ -0,0 +1,113 @@
+/*
+ * vrrp_arena.c - contiguous memory for pkt templates
+ *
+ * Advertisement and topology update pkt are built once, each frame
+ * (ethernet header, IP header and payload) is laid out contiguously
+ * on its own cache line(s), and sent as a single iovec.
+ *
+ * Copyright (C) 2017 Arnaud Andre 
+ *
+ * This file is part of uvrrpd.
+ *
+ * uvrrpd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * uvrrpd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with uvrrpd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "vrrp_arena.h"
+#include "log.h"
+
+/**
+ * vrrp_arena_init() - allocate a zeroed arena of size bytes
+ */
+int vrrp_arena_init(struct vrrp_arena *arena, size_t size)
+{
+	void *base;
+	int err;
+
+	err = posix_memalign(&base, VRRP_ARENA_ALIGN, size);
+	if (err != 0) {
+		errno = err;
+		log_error("posix_memalign - %m");
+		return -1;
+	}
+
+	memset(base, 0, size);
+
+	arena->base = base;
+	arena->size = size;
+	arena->used = 0;
+
+	return 0;
+}
+
+/**
+ * vrrp_arena_reserve() - empty arena for size bytes of frames, it is
+ *                        reused if large enough, else replaced by a
+ *                        new one once allocated
+ *
+ * Arena is left untouched on failure, so that frames built in it
+ * remain valid.
+ */
+int vrrp_arena_reserve(struct vrrp_arena *arena, size_t size)
+{
+	struct vrrp_arena larger;
+
+	if ((arena->base != NULL) && (arena->size >= size)) {
+		memset(arena->base, 0, arena->size);
+		arena->used = 0;
+		return 0;
+	}
+
+	if (vrrp_arena_init(&larger, size) != 0)
+		return -1;
+
+	vrrp_arena_cleanup(arena);
+	*arena = larger;
+
+	return 0;
+}
+
+/**
+ * vrrp_arena_frame() - get room for a frame of len bytes
+ *
+ * @return frame, NULL if arena is full
+ */
+void *vrrp_arena_frame(struct vrrp_arena *arena, size_t len)
+{
+	unsigned char *frame;
+
+	if (arena->used + VRRP_ARENA_FRAME(len) > arena->size) {
+		log_error("arena full, %zu bytes frame", len);
+		return NULL;
+	}
+
+	frame = arena->base + arena->used + VRRP_ARENA_IP_ALIGN;
+	arena->used += VRRP_ARENA_FRAME(len);
+
+	return frame;
+}
+
+/**
+ * vrrp_arena_cleanup() - free all frames of arena
+ */
+void vrrp_arena_cleanup(struct vrrp_arena *arena)
+{
+	free(arena->base);
+
+	arena->base = NULL;
+	arena->size = 0;
+	arena->used = 0;
+}
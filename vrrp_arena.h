@@ -0,0 +1,52 @@
+/*
+ * vrrp_arena.h - contiguous memory for pkt templates
+ *
+ * Copyright (C) 2017 Arnaud Andre 
+ *
+ * This file is part of uvrrpd.
+ *
+ * uvrrpd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * uvrrpd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with uvrrpd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _VRRP_ARENA_H_
+#define _VRRP_ARENA_H_
+
+#include <stddef.h>
+
+/* frames start on a cache line, shifted so that IP header following
+ * the 14 bytes ethernet header is 4 bytes aligned */
+#define VRRP_ARENA_ALIGN	64
+#define VRRP_ARENA_IP_ALIGN	2
+
+/* room taken in arena by a frame of len bytes */
+#define VRRP_ARENA_FRAME(len) \
+	(((len) + VRRP_ARENA_IP_ALIGN + VRRP_ARENA_ALIGN - 1) \
+	 & ~((size_t) VRRP_ARENA_ALIGN - 1))
+
+/**
+ * struct vrrp_arena - frames allocated from a single buffer, freed
+ *                     all at once
+ */
+struct vrrp_arena {
+	unsigned char *base;
+	size_t size;
+	size_t used;
+};
+
+int vrrp_arena_init(struct vrrp_arena *arena, size_t size);
+int vrrp_arena_reserve(struct vrrp_arena *arena, size_t size);
+void *vrrp_arena_frame(struct vrrp_arena *arena, size_t len);
+void vrrp_arena_cleanup(struct vrrp_arena *arena);
+
+#endif /* _VRRP_ARENA_H_ */
@@ -63,17 +63,12 @@ struct arphdr_eth {
 /**
  * vrrp_arp_eth_build() 
  */
-static int vrrp_arp_eth_build(struct iovec *iov, const uint8_t vrid)
+static int vrrp_arp_eth_build(struct iovec *iov, void *buf, const uint8_t vrid)
 {
-	iov->iov_base = malloc(sizeof(struct ether_header));
+	iov->iov_base = buf;
 
 	struct ether_header *hdr = iov->iov_base;
 
-	if (hdr == NULL) {
-		log_error("vrid %d :: malloc - %m", vrid);
-		return -1;
-	}
-
 	memcpy(hdr, &vrrp_arp_eth, sizeof(struct ether_header));
 
 	hdr->ether_shost[5] = vrid;
@@ -89,31 +84,19 @@ static int vrrp_arp_eth_build(struct iovec *iov, const uint8_t vrid)
  */
 int vrrp_arp_send(struct vrrp_net *vnet)
 {
-	struct vrrp_ip *vip_ptr = NULL;
-
-	/* we have to send one arp pkt by vip */
-	list_for_each_entry_reverse(vip_ptr, &vnet->vip_list, iplist) {
-		vrrp_net_send(vnet, vip_ptr->__topology,
-			      ARRAY_SIZE(vip_ptr->__topology));
-	}
-
-	return 0;
+	/* one arp pkt by vip, in a single burst */
+	return vrrp_net_send_topology(vnet);
 }
 
 /**
  * vrrp_arp_build() - Build arp header
  */
-static int vrrp_arp_build(struct iovec *iov, const uint8_t vrid)
+static int vrrp_arp_build(struct iovec *iov, void *buf)
 {
-	iov->iov_base = malloc(sizeof(struct arphdr));
+	iov->iov_base = buf;
 
 	struct arphdr *arph = iov->iov_base;
 
-	if (arph == NULL) {
-		log_error("vrid %d :: malloc - %m", vrid);
-		return -1;
-	}
-
 	arph->ar_hrd = htons(ARPHRD_ETHER);	/* Format of hardware address */
 	arph->ar_pro = htons(ETHERTYPE_IP);	/* Format of protocol address */
 	arph->ar_hln = ETH_ALEN;	/* Length of hardware address */
@@ -128,18 +111,13 @@ static int vrrp_arp_build(struct iovec *iov, const uint8_t vrid)
 /**
  * vrrp_arp_vrrp_build() - VRRP arp payload
  */
-static int vrrp_arp_vrrp_build(struct iovec *iov, struct vrrp_ip *vip,
-			       struct vrrp_net *vnet)
+static int vrrp_arp_vrrp_build(struct iovec *iov, void *buf,
+			       struct vrrp_ip *vip, struct vrrp_net *vnet)
 {
-	iov->iov_base = malloc(sizeof(struct arphdr_eth));
+	iov->iov_base = buf;
 
 	struct arphdr_eth *arpeth = iov->iov_base;
 
-	if (arpeth == NULL) {
-		log_error("vrid %d :: malloc - %m", vnet->vrid);
-		return -1;
-	}
-
 	arpeth->ar_sha[0] = 0x00;
 	arpeth->ar_sha[1] = 0x00;
 	arpeth->ar_sha[2] = 0x5e;
@@ -161,17 +139,34 @@ static int vrrp_arp_vrrp_build(struct iovec *iov, struct vrrp_ip *vip,
  */
 int vrrp_arp_init(struct vrrp_net *vnet)
 {
+	const size_t len = ETHDR_SIZE + sizeof(struct arphdr)
+	    + sizeof(struct arphdr_eth);
+	unsigned char *frame;
 	int status = -1;
 
-	/* we have to build one arp pkt by vip */
+	/* we have to build one arp pkt by vip, all in one arena */
 	struct vrrp_ip *vip_ptr = NULL;
 
+	if (vrrp_arena_reserve(&vnet->__topology_arena,
+			       vnet->naddr * VRRP_ARENA_FRAME(len)) != 0)
+		return -1;
+
 	list_for_each_entry_reverse(vip_ptr, &vnet->vip_list, iplist) {
-		status =
-		    vrrp_arp_eth_build(&vip_ptr->__topology[0], vnet->vrid);
-		status |= vrrp_arp_build(&vip_ptr->__topology[1], vnet->vrid);
-		status |=
-		    vrrp_arp_vrrp_build(&vip_ptr->__topology[2], vip_ptr, vnet);
+		frame = vrrp_arena_frame(&vnet->__topology_arena, len);
+		if (frame == NULL)
+			return -1;
+
+		status = vrrp_arp_eth_build(&vip_ptr->__topology[0], frame,
+					    vnet->vrid);
+		status |= vrrp_arp_build(&vip_ptr->__topology[1],
+					 frame + ETHDR_SIZE);
+		status |= vrrp_arp_vrrp_build(&vip_ptr->__topology[2],
+					      frame + ETHDR_SIZE
+					      + sizeof(struct arphdr),
+					      vip_ptr, vnet);
+
+		vip_ptr->__frame.iov_base = frame;
+		vip_ptr->__frame.iov_len = len;
 	}
 
 	return status;
@@ -182,15 +177,6 @@ int vrrp_arp_init(struct vrrp_net *vnet)
  */
 void vrrp_arp_cleanup(struct vrrp_net *vnet)
 {
-	/* clean arp buffer for each vrrp_ip addr */
-	struct vrrp_ip *vip_ptr = NULL;
-
-	list_for_each_entry(vip_ptr, &vnet->vip_list, iplist) {
-
-		/* clean iovec */
-		for (int i = 0; i < 3; ++i) {
-			struct iovec *iov = &vip_ptr->__topology[i];
-			free(iov->iov_base);
-		}
-	}
+	/* arp pkt of all vrrp_ip addr at once */
+	vrrp_arena_cleanup(&vnet->__topology_arena);
 }
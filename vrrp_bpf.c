@@ -0,0 +1,264 @@
+/*
+ * vrrp_bpf.c - in-kernel filter of VRRP listen sockets
+ *
+ * Copyright (C) 2017 Arnaud Andre 
+ *
+ * This file is part of uvrrpd.
+ *
+ * uvrrpd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * uvrrpd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with uvrrpd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * A classic BPF program is attached to each listen socket, so that
+ * pkt which would be dropped by vrrp_net_recv() don't wake up uvrrpd :
+ * - TTL (IPv4) or Hop Limit (IPv6) must be 255,
+ * - (version, VRID) must match one of the instances using the socket,
+ * - source address must not be blocked by flood protection,
+ * - source address must be in the peer list of the instance, if any.
+ *
+ * IPv4 raw sockets see pkt from IP header, IPv6 raw sockets from VRRP
+ * header, IPv6 header is read through SKF_NET_OFF.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/filter.h>
+
+#include "vrrp_net.h"
+#include "vrrp_bpf.h"
+#include "log.h"
+
+#define VRRP_TTL         255
+
+/* IPv4 header offsets */
+#define IP4_TTL		8
+#define IP4_SADDR	12
+
+/* IPv6 header offsets */
+#define IP6_HOPLIMIT	(SKF_NET_OFF + 7)
+#define IP6_SADDR	(SKF_NET_OFF + 8)
+
+/* (version << 12 | vrid), from the first 16 bits of VRRP header */
+#define VRRP_BPF_KEY_MASK	0xf0ff
+#define VRRP_BPF_KEY( ver, vrid ) (((ver) << 12) | (vrid))
+
+#define BPF_ACCEPT	0xffffffff
+#define BPF_DROP	0
+
+/**
+ * struct vrrp_bpf - BPF program being built
+ */
+struct vrrp_bpf {
+	struct sock_filter insns[BPF_MAXINSNS];
+	int len;
+};
+
+/**
+ * vrrp_bpf_emit() - append an instruction to the program
+ */
+static void vrrp_bpf_emit(struct vrrp_bpf *prog, uint16_t code,
+			  uint8_t jt, uint8_t jf, uint32_t k)
+{
+	if (prog->len < BPF_MAXINSNS) {
+		prog->insns[prog->len].code = code;
+		prog->insns[prog->len].jt = jt;
+		prog->insns[prog->len].jf = jf;
+		prog->insns[prog->len].k = k;
+	}
+
+	/* overflow is checked once program is built */
+	prog->len++;
+}
+
+/**
+ * vrrp_bpf_blocked() - drop pkt from sources flooding the instance
+ *                      with invalid pkt
+ */
+static void vrrp_bpf_blocked(struct vrrp_bpf *prog,
+			     const struct vrrp_net *vnet)
+{
+	const struct vrrp_flood_src *src;
+	int i;
+
+	if (vnet->flood.nblocked == 0)
+		return;
+
+	if (vnet->family == AF_INET)
+		vrrp_bpf_emit(prog, BPF_LD | BPF_W | BPF_ABS, 0, 0, IP4_SADDR);
+
+	for (i = 0; i < VRRP_FLOOD_SRC; ++i) {
+		src = &vnet->flood.src[i];
+		if (!src->used || (src->blocked == 0))
+			continue;
+
+		if (vnet->family == AF_INET) {
+			vrrp_bpf_emit(prog, BPF_JMP | BPF_JEQ | BPF_K, 0, 1,
+				      ntohl(src->addr.addr.s_addr));
+			vrrp_bpf_emit(prog, BPF_RET | BPF_K, 0, 0, BPF_DROP);
+		}
+#ifdef HAVE_IP6
+		else {	/* AF_INET6 */
+			int w;
+
+			/* compare each 32 bits word, next source on mismatch */
+			for (w = 0; w < 4; ++w) {
+				vrrp_bpf_emit(prog, BPF_LD | BPF_W | BPF_ABS,
+					      0, 0, IP6_SADDR + 4 * w);
+				vrrp_bpf_emit(prog, BPF_JMP | BPF_JEQ | BPF_K,
+					      0, 7 - 2 * w,
+					      ntohl(src->addr.addr6.
+						    s6_addr32[w]));
+			}
+			vrrp_bpf_emit(prog, BPF_RET | BPF_K, 0, 0, BPF_DROP);
+		}
+#endif /* HAVE_IP6 */
+	}
+}
+
+/**
+ * vrrp_bpf_peers() - accept pkt only if source address is in peer list
+ */
+static void vrrp_bpf_peers(struct vrrp_bpf *prog, const struct vrrp_net *vnet)
+{
+	int i;
+
+	if (vnet->npeer == 0) {
+		vrrp_bpf_emit(prog, BPF_RET | BPF_K, 0, 0, BPF_ACCEPT);
+		return;
+	}
+
+	if (vnet->family == AF_INET) {
+		vrrp_bpf_emit(prog, BPF_LD | BPF_W | BPF_ABS, 0, 0, IP4_SADDR);
+
+		for (i = 0; i < vnet->npeer; ++i) {
+			vrrp_bpf_emit(prog, BPF_JMP | BPF_JEQ | BPF_K, 0, 1,
+				      ntohl(vnet->peer[i].addr.s_addr));
+			vrrp_bpf_emit(prog, BPF_RET | BPF_K, 0, 0, BPF_ACCEPT);
+		}
+	}
+#ifdef HAVE_IP6
+	else {	/* AF_INET6 */
+		int w;
+
+		/* compare each 32 bits word, jump to next peer on mismatch */
+		for (i = 0; i < vnet->npeer; ++i) {
+			for (w = 0; w < 4; ++w) {
+				vrrp_bpf_emit(prog, BPF_LD | BPF_W | BPF_ABS,
+					      0, 0, IP6_SADDR + 4 * w);
+				vrrp_bpf_emit(prog, BPF_JMP | BPF_JEQ | BPF_K,
+					      0, 7 - 2 * w,
+					      ntohl(vnet->peer[i].addr6.
+						    s6_addr32[w]));
+			}
+			vrrp_bpf_emit(prog, BPF_RET | BPF_K, 0, 0, BPF_ACCEPT);
+		}
+	}
+#endif /* HAVE_IP6 */
+
+	vrrp_bpf_emit(prog, BPF_RET | BPF_K, 0, 0, BPF_DROP);
+}
+
+/**
+ * vrrp_bpf_build() - build filter of a listen socket
+ */
+static void vrrp_bpf_build(struct vrrp_bpf *prog,
+			   const struct vrrp_socket *sock)
+{
+	const struct vrrp_net *vnet;
+	int vrid, ja;
+
+	prog->len = 0;
+
+	/* TTL must be 255, then load VRRP version and VRID */
+	if (sock->family == AF_INET) {
+		vrrp_bpf_emit(prog, BPF_LD | BPF_B | BPF_ABS, 0, 0, IP4_TTL);
+		vrrp_bpf_emit(prog, BPF_JMP | BPF_JEQ | BPF_K, 1, 0, VRRP_TTL);
+		vrrp_bpf_emit(prog, BPF_RET | BPF_K, 0, 0, BPF_DROP);
+		vrrp_bpf_emit(prog, BPF_LDX | BPF_B | BPF_MSH, 0, 0, 0);
+		vrrp_bpf_emit(prog, BPF_LD | BPF_H | BPF_IND, 0, 0, 0);
+	}
+	else {	/* AF_INET6 */
+		vrrp_bpf_emit(prog, BPF_LD | BPF_B | BPF_ABS, 0, 0,
+			      IP6_HOPLIMIT);
+		vrrp_bpf_emit(prog, BPF_JMP | BPF_JEQ | BPF_K, 1, 0, VRRP_TTL);
+		vrrp_bpf_emit(prog, BPF_RET | BPF_K, 0, 0, BPF_DROP);
+		vrrp_bpf_emit(prog, BPF_LD | BPF_H | BPF_ABS, 0, 0, 0);
+	}
+
+	vrrp_bpf_emit(prog, BPF_ALU | BPF_AND | BPF_K, 0, 0,
+		      VRRP_BPF_KEY_MASK);
+
+	/* one block per instance, skipped if key doesn't match */
+	for (vrid = 1; vrid < VRRP_NVRID; ++vrid) {
+		vnet = sock->vnet[vrid];
+		if (vnet == NULL)
+			continue;
+
+		vrrp_bpf_emit(prog, BPF_JMP | BPF_JEQ | BPF_K, 1, 0,
+			      VRRP_BPF_KEY(vnet->version, vrid));
+		ja = prog->len;
+		vrrp_bpf_emit(prog, BPF_JMP | BPF_JA, 0, 0, 0);
+
+		vrrp_bpf_blocked(prog, vnet);
+		vrrp_bpf_peers(prog, vnet);
+
+		if (ja < BPF_MAXINSNS)
+			prog->insns[ja].k = prog->len - ja - 1;
+	}
+
+	vrrp_bpf_emit(prog, BPF_RET | BPF_K, 0, 0, BPF_DROP);
+}
+
+/**
+ * vrrp_bpf_attach() - (re)attach filter of a listen socket,
+ *                     matching instances currently using it
+ *
+ * @return 0 if success, -1 else
+ */
+int vrrp_bpf_attach(struct vrrp_socket *sock)
+{
+	struct sock_fprog fprog;
+	struct vrrp_bpf *prog = malloc(sizeof(struct vrrp_bpf));
+	int status = -1;
+
+	if (prog == NULL) {
+		log_error("%s :: malloc - %m", sock->ifname);
+		return -1;
+	}
+
+	vrrp_bpf_build(prog, sock);
+
+	if (prog->len > BPF_MAXINSNS) {
+		log_error("%s :: BPF filter too long (%d instructions)",
+			  sock->ifname, prog->len);
+		goto out;
+	}
+
+	fprog.len = prog->len;
+	fprog.filter = prog->insns;
+
+	if (setsockopt(sock->fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog,
+		       sizeof(fprog)) < 0) {
+		log_error("%s :: setsockopt SO_ATTACH_FILTER - %m",
+			  sock->ifname);
+		goto out;
+	}
+
+	status = 0;
+
+ out:
+	free(prog);
+	return status;
+}
@@ -0,0 +1,30 @@
+/*
+ * vrrp_bpf.h - in-kernel filter of VRRP listen sockets
+ *
+ * Copyright (C) 2017 Arnaud Andre 
+ *
+ * This file is part of uvrrpd.
+ *
+ * uvrrpd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * uvrrpd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with uvrrpd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _VRRP_BPF_H_
+#define _VRRP_BPF_H_
+
+/* from vrrp_net.h */
+struct vrrp_socket;
+
+int vrrp_bpf_attach(struct vrrp_socket *sock);
+
+#endif /* _VRRP_BPF_H_ */
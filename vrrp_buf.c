@@ -0,0 +1,110 @@
+/*
+ * vrrp_buf.c - growable text buffer
+ *
+ * Copyright (C) 2017 Arnaud Andre 
+ *
+ * This file is part of uvrrpd.
+ *
+ * uvrrpd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * uvrrpd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with uvrrpd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "vrrp_buf.h"
+#include "log.h"
+
+/**
+ * vrrp_buf_init() - allocate an empty buffer of size bytes
+ */
+int vrrp_buf_init(struct vrrp_buf *b, size_t size)
+{
+	b->data = malloc(size);
+	if (b->data == NULL) {
+		log_error("malloc - %m");
+		return -1;
+	}
+
+	b->size = size;
+	vrrp_buf_reset(b);
+
+	return 0;
+}
+
+/**
+ * vrrp_buf_reset() - empty buffer, keep its memory
+ */
+void vrrp_buf_reset(struct vrrp_buf *b)
+{
+	b->len = 0;
+	b->err = 0;
+}
+
+/**
+ * vrrp_buf_printf() - append to buffer, grown as needed
+ *
+ * On failure, b->err is set and next appends are ignored until reset.
+ */
+void vrrp_buf_printf(struct vrrp_buf *b, const char *fmt, ...)
+{
+	va_list ap;
+	size_t size;
+	char *data;
+	int n;
+
+	if (b->err)
+		return;
+
+	for (;;) {
+		va_start(ap, fmt);
+		n = vsnprintf(b->data + b->len, b->size - b->len, fmt, ap);
+		va_end(ap);
+
+		if (n < 0) {
+			b->err = 1;
+			return;
+		}
+
+		if (b->len + n < b->size) {
+			b->len += n;
+			return;
+		}
+
+		for (size = b->size * 2; size <= b->len + n; size *= 2);
+
+		data = realloc(b->data, size);
+		if (data == NULL) {
+			log_error("realloc - %m");
+			b->err = 1;
+			return;
+		}
+
+		b->data = data;
+		b->size = size;
+	}
+}
+
+/**
+ * vrrp_buf_cleanup() - free buffer
+ */
+void vrrp_buf_cleanup(struct vrrp_buf *b)
+{
+	free(b->data);
+
+	b->data = NULL;
+	b->size = 0;
+	vrrp_buf_reset(b);
+}
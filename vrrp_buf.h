@@ -0,0 +1,45 @@
+/*
+ * vrrp_buf.h - growable text buffer
+ *
+ * Copyright (C) 2017 Arnaud Andre 
+ *
+ * This file is part of uvrrpd.
+ *
+ * uvrrpd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * uvrrpd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with uvrrpd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _VRRP_BUF_H_
+#define _VRRP_BUF_H_
+
+#include <stddef.h>
+
+/**
+ * struct vrrp_buf - text appended by vrrp_buf_printf(), kept between
+ *                   uses to avoid reallocation
+ * @err: an append failed, text is incomplete
+ */
+struct vrrp_buf {
+	char *data;
+	size_t len;
+	size_t size;
+	int err;
+};
+
+int vrrp_buf_init(struct vrrp_buf *b, size_t size);
+void vrrp_buf_reset(struct vrrp_buf *b);
+__attribute__ ((format(printf, 2, 3)))
+void vrrp_buf_printf(struct vrrp_buf *b, const char *fmt, ...);
+void vrrp_buf_cleanup(struct vrrp_buf *b);
+
+#endif /* _VRRP_BUF_H_ */
@@ -0,0 +1,281 @@
+/*
+ * vrrp_csum.c - internet checksum (RFC1071) over a pseudo header and
+ *               an iovec, without copying them
+ *
+ * Copyright (C) 2017 Arnaud Andre 
+ *
+ * This file is part of uvrrpd.
+ *
+ * uvrrpd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * uvrrpd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with uvrrpd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "vrrp_csum.h"
+#include "log.h"
+
+/**
+ * vrrp_csum_kernel - add bytes of a buffer to a 64 bits one's
+ *                    complement accumulator
+ *
+ * Buffer is read as 16 bits words in host order, as cksum() does.
+ */
+typedef uint64_t(*vrrp_csum_kernel) (const unsigned char *p, size_t len,
+				     uint64_t sum);
+
+/* SIMD kernels spill 32 bits lanes before they may overflow */
+#define VRRP_CSUM_SPILL 16384
+
+/**
+ * vrrp_csum_add() - 64 bits add with end around carry
+ */
+static inline uint64_t vrrp_csum_add(uint64_t sum, uint64_t w)
+{
+	sum += w;
+	return sum + (sum < w);
+}
+
+/**
+ * vrrp_csum_fold() - fold 64 bits accumulator to 16 bits
+ */
+static inline uint16_t vrrp_csum_fold(uint64_t sum)
+{
+	sum = (sum >> 32) + (sum & 0xffffffff);
+	sum = (sum >> 32) + (sum & 0xffffffff);
+	sum = (sum >> 16) + (sum & 0xffff);
+	sum = (sum >> 16) + (sum & 0xffff);
+	sum = (sum >> 16) + (sum & 0xffff);
+
+	return (uint16_t) sum;
+}
+
+/**
+ * vrrp_csum_generic() - portable kernel, 8 bytes at a time
+ */
+static uint64_t vrrp_csum_generic(const unsigned char *p, size_t len,
+				  uint64_t sum)
+{
+	uint64_t w64;
+	uint32_t w32;
+	uint16_t w16 = 0;
+
+	for (; len >= sizeof(w64); p += sizeof(w64), len -= sizeof(w64)) {
+		memcpy(&w64, p, sizeof(w64));
+		sum = vrrp_csum_add(sum, w64);
+	}
+
+	if (len >= sizeof(w32)) {
+		memcpy(&w32, p, sizeof(w32));
+		sum = vrrp_csum_add(sum, w32);
+		p += sizeof(w32);
+		len -= sizeof(w32);
+	}
+
+	if (len >= sizeof(w16)) {
+		memcpy(&w16, p, sizeof(w16));
+		sum = vrrp_csum_add(sum, w16);
+		p += sizeof(w16);
+		len -= sizeof(w16);
+	}
+
+	/* odd byte, padded with zero */
+	if (len != 0) {
+		w16 = 0;
+		memcpy(&w16, p, 1);
+		sum = vrrp_csum_add(sum, w16);
+	}
+
+	return sum;
+}
+
+#if defined(__x86_64__)
+/**
+ * vrrp_csum_sse2() - SSE2 kernel, 16 bytes at a time
+ */
+static uint64_t vrrp_csum_sse2(const unsigned char *p, size_t len,
+			       uint64_t sum)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i acc32, acc64 = zero, v;
+	uint64_t lanes[2];
+	size_t n;
+
+	while (len >= 16) {
+		acc32 = zero;
+
+		for (n = 0; (len >= 16) && (n < VRRP_CSUM_SPILL); ++n) {
+			v = _mm_loadu_si128((const __m128i *) p);
+			acc32 = _mm_add_epi32(acc32, _mm_unpacklo_epi16(v, zero));
+			acc32 = _mm_add_epi32(acc32, _mm_unpackhi_epi16(v, zero));
+			p += 16;
+			len -= 16;
+		}
+
+		acc64 = _mm_add_epi64(acc64, _mm_unpacklo_epi32(acc32, zero));
+		acc64 = _mm_add_epi64(acc64, _mm_unpackhi_epi32(acc32, zero));
+	}
+
+	_mm_storeu_si128((__m128i *) lanes, acc64);
+	sum = vrrp_csum_add(sum, lanes[0]);
+	sum = vrrp_csum_add(sum, lanes[1]);
+
+	return vrrp_csum_generic(p, len, sum);
+}
+
+/**
+ * vrrp_csum_avx2() - AVX2 kernel, 32 bytes at a time
+ */
+__attribute__ ((target("avx2")))
+static uint64_t vrrp_csum_avx2(const unsigned char *p, size_t len,
+			       uint64_t sum)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i acc32, acc64 = zero, v;
+	uint64_t lanes[4];
+	size_t n;
+
+	while (len >= 32) {
+		acc32 = zero;
+
+		for (n = 0; (len >= 32) && (n < VRRP_CSUM_SPILL); ++n) {
+			v = _mm256_loadu_si256((const __m256i *) p);
+			acc32 = _mm256_add_epi32(acc32,
+						 _mm256_unpacklo_epi16(v, zero));
+			acc32 = _mm256_add_epi32(acc32,
+						 _mm256_unpackhi_epi16(v, zero));
+			p += 32;
+			len -= 32;
+		}
+
+		acc64 = _mm256_add_epi64(acc64,
+					 _mm256_unpacklo_epi32(acc32, zero));
+		acc64 = _mm256_add_epi64(acc64,
+					 _mm256_unpackhi_epi32(acc32, zero));
+	}
+
+	_mm256_storeu_si256((__m256i *) lanes, acc64);
+	for (n = 0; n < 4; ++n)
+		sum = vrrp_csum_add(sum, lanes[n]);
+
+	return vrrp_csum_sse2(p, len, sum);
+}
+#elif defined(__aarch64__)
+/**
+ * vrrp_csum_neon() - NEON kernel, 16 bytes at a time
+ */
+static uint64_t vrrp_csum_neon(const unsigned char *p, size_t len,
+			       uint64_t sum)
+{
+	uint64x2_t acc64 = vdupq_n_u64(0);
+	uint32x4_t acc32;
+	size_t n;
+
+	while (len >= 16) {
+		acc32 = vdupq_n_u32(0);
+
+		for (n = 0; (len >= 16) && (n < VRRP_CSUM_SPILL); ++n) {
+			acc32 = vpadalq_u16(acc32,
+					    vreinterpretq_u16_u8(vld1q_u8(p)));
+			p += 16;
+			len -= 16;
+		}
+
+		acc64 = vpadalq_u32(acc64, acc32);
+	}
+
+	sum = vrrp_csum_add(sum, vgetq_lane_u64(acc64, 0));
+	sum = vrrp_csum_add(sum, vgetq_lane_u64(acc64, 1));
+
+	return vrrp_csum_generic(p, len, sum);
+}
+#endif
+
+static uint64_t vrrp_csum_resolve(const unsigned char *p, size_t len,
+				  uint64_t sum);
+
+/* kernel in use, chosen on first call */
+static vrrp_csum_kernel vrrp_csum_kernel_run = vrrp_csum_resolve;
+
+/**
+ * vrrp_csum_resolve() - choose best kernel supported by cpu, then
+ *                       run it
+ */
+static uint64_t vrrp_csum_resolve(const unsigned char *p, size_t len,
+				  uint64_t sum)
+{
+	const char *name = "generic";
+
+	vrrp_csum_kernel_run = vrrp_csum_generic;
+
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2")) {
+		vrrp_csum_kernel_run = vrrp_csum_avx2;
+		name = "avx2";
+	}
+	else {
+		vrrp_csum_kernel_run = vrrp_csum_sse2;
+		name = "sse2";
+	}
+#elif defined(__aarch64__)
+	vrrp_csum_kernel_run = vrrp_csum_neon;
+	name = "neon";
+#endif
+
+	log_debug("checksum :: %s kernel", name);
+
+	return vrrp_csum_kernel_run(p, len, sum);
+}
+
+/**
+ * vrrp_csum() - compute internet checksum of pseudo header @psh
+ *               followed by @iovcnt buffers of @iov
+ *
+ * @psh may be NULL. Buffers may have odd lengths, a buffer starting
+ * at an odd offset is summed byte swapped (RFC1071, 2.(B)).
+ */
+uint16_t vrrp_csum(const void *psh, size_t pshlen,
+		   const struct iovec *iov, size_t iovcnt)
+{
+	uint64_t sum = 0;
+	uint16_t part;
+	size_t off = 0;
+
+	if (psh != NULL) {
+		sum = vrrp_csum_kernel_run(psh, pshlen, 0);
+		off = pshlen;
+	}
+
+	for (size_t i = 0; i < iovcnt; ++i) {
+		if (iov[i].iov_len == 0)
+			continue;
+
+		part = vrrp_csum_fold(vrrp_csum_kernel_run(iov[i].iov_base,
+							   iov[i].iov_len, 0));
+		if (off & 1)
+			part = (part << 8) | (part >> 8);
+
+		sum = vrrp_csum_add(sum, part);
+		off += iov[i].iov_len;
+	}
+
+	return (uint16_t) ~vrrp_csum_fold(sum);
+}
@@ -0,0 +1,32 @@
+/*
+ * vrrp_csum.h - internet checksum over iovec
+ *
+ * Copyright (C) 2017 Arnaud Andre 
+ *
+ * This file is part of uvrrpd.
+ *
+ * uvrrpd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * uvrrpd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with uvrrpd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _VRRP_CSUM_H_
+#define _VRRP_CSUM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+uint16_t vrrp_csum(const void *psh, size_t pshlen,
+		   const struct iovec *iov, size_t iovcnt);
+
+#endif /* _VRRP_CSUM_H_ */
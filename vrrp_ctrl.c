@@ -31,6 +31,9 @@
 #include "vrrp.h"
 #include "vrrp_ctrl.h"
 #include "vrrp_adv.h"
+#include "vrrp_arp.h"
+#include "vrrp_na.h"
+#include "vrrp_exec.h"
 
 #include "common.h"
 #include "uvrrpd.h"
@@ -39,9 +42,6 @@
 
 extern unsigned long reg;
 
-static inline vrrp_event_t vrrp_ctrl_cmd(struct vrrp *vrrp,
-					 struct vrrp_net *vnet);
-
 /**
  * flush_fifo() - flush a fifo fd
  */
@@ -102,10 +102,10 @@ static inline int split_cmd(char *str, char **words_ptr, int max_words,
  */
 int vrrp_ctrl_init(struct vrrp_ctrl *ctrl)
 {
-	ctrl->cmd = malloc(sizeof(char *) * CTRL_CMD_NTOKEN);
+	ctrl->cmd = calloc(CTRL_CMD_NTOKEN, sizeof(char *));
 
 	if (ctrl->cmd == NULL) {
-		log_error("init :: malloc - %m");
+		log_error("init :: calloc - %m");
 		return -1;
 	}
 
@@ -129,102 +129,317 @@ static inline void vrrp_ctrl_cmd_flush(struct vrrp_ctrl *ctrl)
 }
 
 /**
- * vrrp_ctrl_cmd() - Interprete control fifo cmd
+ * vrrp_ctrl_vip_rebuild() - VIP set changed, rebuild advertisement and
+ *                           topology pkt
+ *
+ * Frames are rebuilt in place, or in larger arenas allocated before
+ * the previous ones are freed (see vrrp_arena_reserve()): on failure,
+ * pkt of previous VIP set may be rebuilt without allocation.
  */
-static inline vrrp_event_t vrrp_ctrl_cmd(struct vrrp *vrrp,
-					 struct vrrp_net *vnet)
+static int vrrp_ctrl_vip_rebuild(struct vrrp *vrrp, struct vrrp_net *vnet)
 {
-	int nword;
+	vrrp->naddr = vnet->naddr;
 
-	nword =
-	    split_cmd(vrrp->ctrl.msg, vrrp->ctrl.cmd, CTRL_CMD_NTOKEN,
-		      WHITESPACE);
+	/* adv pkt length changes with VIPs count */
+	if (vrrp_adv_init(vnet, vrrp) != 0)
+		return -1;
 
-	if (nword == 0)
-		return INVALID;
+	if (vnet->family == AF_INET)
+		return vrrp_arp_init(vnet);
+#ifdef HAVE_IP6
+	else if (vnet->family == AF_INET6)
+		return vrrp_na_init(vnet);
+#endif
+
+	return 0;
+}
+
+/**
+ * vrrp_ctrl_vip() - add or remove a VIP while running
+ *
+ * While master, VIP is set or removed on interface at once, without
+ * touching other VIPs. If pkt can't be rebuilt, previous VIP set is
+ * restored, instance is reloaded if its pkt can't be rebuilt either.
+ */
+static vrrp_event_t vrrp_ctrl_vip(struct vrrp *vrrp, struct vrrp_net *vnet,
+				  int add, char *ip, const char **errmsg)
+{
+	struct vrrp_ip *vip = vrrp_net_vip_lookup(vnet, ip);
+	struct list_head *pos = NULL;
+
+	if (add) {
+		if (vip != NULL) {
+			*errmsg = "VIP already set";
+			return INVALID;
+		}
+
+		if (vnet->naddr == VIP_MAX) {
+			*errmsg = "too many VIPs";
+			return INVALID;
+		}
+
+		if (vrrp_net_vip_set(vnet, ip) != 0) {
+			log_error("vrid %d :: invalid control cmd vip, %s",
+				  vrrp->vrid, ip);
+			*errmsg = "invalid VIP";
+			return INVALID;
+		}
+
+		vip = list_entry(vnet->vip_list.prev, struct vrrp_ip, iplist);
+		++vnet->naddr;
+	}
+	else {
+		if (vip == NULL) {
+			*errmsg = "VIP not set";
+			return INVALID;
+		}
+
+		if (vnet->naddr == 1) {
+			*errmsg = "can't remove last VIP";
+			return INVALID;
+		}
+
+		/* keep its place, to restore it on failure */
+		pos = vip->iplist.prev;
+		vrrp_net_vip_unset(vnet, vip);
+		--vnet->naddr;
+	}
+
+	if (vrrp_ctrl_vip_rebuild(vrrp, vnet) != 0) {
+		log_error("vrid %d :: can't rebuild pkt, vip %s not %s",
+			  vrrp->vrid, ip, (add ? "added" : "removed"));
+		*errmsg = "can't rebuild pkt";
+
+		/* restore previous VIP set */
+		if (add) {
+			vrrp_net_vip_unset(vnet, vip);
+			--vnet->naddr;
+			free(vip);
+		}
+		else {
+			vrrp_net_vip_relink(vnet, vip, pos);
+			++vnet->naddr;
+		}
+
+		if (vrrp_ctrl_vip_rebuild(vrrp, vnet) == 0)
+			return INVALID;
+
+		log_error("vrid %d :: can't restore pkt, reloading",
+			  vrrp->vrid);
+		set_bit(UVRRPD_RELOAD, &vrrp->reg);
+
+		return CTRL_FIFO;
+	}
+
+	log_notice("vrid %d :: vip %s %s", vrrp->vrid, ip,
+		   (add ? "added" : "removed"));
+
+	if (vrrp->state == MASTER)
+		vrrp_exec_vip(vrrp, vnet, vip, add);
+
+	if (!add)
+		free(vip);
+
+	set_bit(UVRRPD_RECONF_VIP, &vrrp->reg);
+
+	return CTRL_FIFO;
+}
+
+/**
+ * vrrp_ctrl_exec() - Run a control cmd split in words, from control
+ *                    fifo or control socket
+ * @errmsg: reason of failure, for control socket reply
+ *
+ * @return CTRL_FIFO, or INVALID if cmd is unknown or invalid
+ */
+vrrp_event_t vrrp_ctrl_exec(struct vrrp *vrrp, struct vrrp_net *vnet,
+			    char **cmd, int nword, const char **errmsg)
+{
+	*errmsg = NULL;
 
 	/* 
 	 * control cmd stop 
 	 */
-	if (matches(vrrp->ctrl.cmd[0], "stop")) {
+	if (matches(cmd[0], "stop")) {
 		log_notice("vrid %d :: control cmd stop, exiting", vrrp->vrid);
 		set_bit(UVRRPD_RELOAD, &reg);
 		clear_bit(KEEP_GOING, &reg);
-		vrrp_ctrl_cmd_flush(&vrrp->ctrl);
 		return CTRL_FIFO;
 	}
 
 	/* 
 	 * control cmd reload 
 	 */
-	if (matches(vrrp->ctrl.cmd[0], "reload")) {
-		set_bit(UVRRPD_RELOAD, &reg);
-		vrrp_ctrl_cmd_flush(&vrrp->ctrl);
+	if (matches(cmd[0], "reload")) {
+		set_bit(UVRRPD_RELOAD, &vrrp->reg);
 		return CTRL_FIFO;
 	}
 
 	/* 
 	 * control cmd state || status 
 	 */
-	if (matches(vrrp->ctrl.cmd[0], "state")
-	    || matches(vrrp->ctrl.cmd[0], "status")) {
+	if (matches(cmd[0], "state") || matches(cmd[0], "status")) {
+		set_bit(UVRRPD_DUMP, &vrrp->reg);
+		return CTRL_FIFO;
+	}
 
-		set_bit(UVRRPD_DUMP, &reg);
-		vrrp_ctrl_cmd_flush(&vrrp->ctrl);
+	/*
+	 * control cmd timeline
+	 */
+	if (matches(cmd[0], "timeline")) {
+		set_bit(UVRRPD_TIMELINE, &vrrp->reg);
 		return CTRL_FIFO;
 	}
 
 	/* 
 	 * control cmd prio 
 	 */
-	if (matches(vrrp->ctrl.cmd[0], "prio")) {
+	if (matches(cmd[0], "prio")) {
 		if (nword != 2) {
 			log_error
 			    ("vrid %d :: invalid syntax, control cmd prio <priority>",
 			     vrrp->vrid);
-
-			vrrp_ctrl_cmd_flush(&vrrp->ctrl);
+			*errmsg = "usage: prio <priority>";
 			return INVALID;
 		}
 
 		/* fetch priority */
 		int err;
 		unsigned long opt;
-		err = mystrtoul(&opt, vrrp->ctrl.cmd[1], VRRP_PRIO_MAX);
-
-		vrrp_ctrl_cmd_flush(&vrrp->ctrl);
+		err = mystrtoul(&opt, cmd[1], VRRP_PRIO_MAX);
 
-		if (err == -ERANGE) {
+		/* priority 0 is reserved to a master resigning */
+		if ((err == -ERANGE) || ((err == 0) && (opt == 0))) {
 			log_error
 			    ("vrid %d :: invalid control cmd prio, 0 < priority < 255",
 			     vrrp->vrid);
+			*errmsg = "0 < priority < 255";
 			return INVALID;
 		}
 
 		if (err == -EINVAL) {
 			log_error
 			    ("vrid %d :: invalid control cmd prio, error parsing \"%s\" as a number",
-			     vrrp->vrid, vrrp->ctrl.cmd[1]);
+			     vrrp->vrid, cmd[1]);
+			*errmsg = "priority is not a number";
 			return INVALID;
 		}
 
-		/* change prio */
+		/* change prio, in place */
 		if (vrrp->priority != (uint8_t) opt) {
 			vrrp->priority = (uint8_t) opt;
 			vrrp_adv_set_priority(vnet, vrrp->priority);
+			set_bit(UVRRPD_RECONF, &vrrp->reg);
 		}
 
-		/* reload bit */
-		set_bit(UVRRPD_RELOAD, &reg);
+		return CTRL_FIFO;
+	}
+
+	/*
+	 * control cmd advint
+	 */
+	if (matches(cmd[0], "advint")) {
+		if (nword != 2) {
+			log_error
+			    ("vrid %d :: invalid syntax, control cmd advint <interval>",
+			     vrrp->vrid);
+			*errmsg = "usage: advint <interval>";
+			return INVALID;
+		}
+
+		/* 8 bits field in VRRPv2, 12 bits in VRRPv3 */
+		int err;
+		unsigned long opt;
+		err = mystrtoul(&opt, cmd[1],
+				(vrrp->version == RFC5798 ? ADVINT_MAX :
+				 UINT8_MAX));
+
+		if ((err != 0) || (opt == 0)) {
+			log_error
+			    ("vrid %d :: invalid control cmd advint \"%s\"",
+			     vrrp->vrid, cmd[1]);
+			*errmsg = "invalid interval";
+			return INVALID;
+		}
+
+		/* change adv interval, in place */
+		if (vrrp->adv_int != (uint16_t) opt) {
+			vrrp->adv_int = (uint16_t) opt;
+			vrrp_adv_set_advint(vnet, vrrp->adv_int);
+			log_notice("vrid %d :: new adv_int %d applied",
+				   vrrp->vrid, vrrp->adv_int);
+			set_bit(UVRRPD_RECONF, &vrrp->reg);
+		}
 
 		return CTRL_FIFO;
 	}
 
-	vrrp_ctrl_cmd_flush(&vrrp->ctrl);
+	/*
+	 * control cmd preempt
+	 */
+	if (matches(cmd[0], "preempt")) {
+		if ((nword != 2)
+		    || !(matches(cmd[1], "on") || matches(cmd[1], "off"))) {
+			log_error
+			    ("vrid %d :: invalid syntax, control cmd preempt on|off",
+			     vrrp->vrid);
+			*errmsg = "usage: preempt on|off";
+			return INVALID;
+		}
+
+		/* only used on next adv received */
+		vrrp->preempt = (matches(cmd[1], "on") ? TRUE : FALSE);
+		log_notice("vrid %d :: preempt %s applied", vrrp->vrid,
+			   STR_PREEMPT(vrrp->preempt));
+
+		return CTRL_FIFO;
+	}
+
+	/*
+	 * control cmd vip
+	 */
+	if (matches(cmd[0], "vip")) {
+		if ((nword != 3)
+		    || !(matches(cmd[1], "add") || matches(cmd[1], "del"))) {
+			log_error
+			    ("vrid %d :: invalid syntax, control cmd vip add|del <ip>",
+			     vrrp->vrid);
+			*errmsg = "usage: vip add|del <ip>";
+			return INVALID;
+		}
+
+		return vrrp_ctrl_vip(vrrp, vnet, matches(cmd[1], "add"),
+				     cmd[2], errmsg);
+	}
+
+	*errmsg = "unknown command";
 
 	return INVALID;
 }
 
+/**
+ * vrrp_ctrl_cmd() - Interprete control fifo cmd
+ */
+static inline vrrp_event_t vrrp_ctrl_cmd(struct vrrp *vrrp,
+					 struct vrrp_net *vnet)
+{
+	const char *errmsg;
+	vrrp_event_t event;
+	int nword;
+
+	nword =
+	    split_cmd(vrrp->ctrl.msg, vrrp->ctrl.cmd, CTRL_CMD_NTOKEN,
+		      WHITESPACE);
+
+	if (nword == 0)
+		return INVALID;
+
+	event = vrrp_ctrl_exec(vrrp, vnet, vrrp->ctrl.cmd, nword, &errmsg);
+	vrrp_ctrl_cmd_flush(&vrrp->ctrl);
+
+	return event;
+}
+
 /**
  * vrrp_ctrl_read() - Read control fifo
  */
@@ -250,4 +465,8 @@ vrrp_event_t vrrp_ctrl_read(struct vrrp * vrrp, struct vrrp_net * vnet)
 void vrrp_ctrl_cleanup(struct vrrp_ctrl *ctrl)
 {
 	free(ctrl->cmd);
+	free(ctrl->name);
+
+	if (ctrl->fd != -1)
+		close(ctrl->fd);
 }
@@ -36,6 +36,9 @@ typedef enum _vrrp_event_type vrrp_event_t;
  * vrrp_ctrl - infos about control fifo
  */
 struct vrrp_ctrl {
+	/* control fifo name */
+	char *name;
+
 	/* control fifo fd */
 	int fd;
 
@@ -51,6 +54,8 @@ struct vrrp_ctrl {
 int vrrp_ctrl_init(struct vrrp_ctrl *ctrl);
 void vrrp_ctrl_cleanup(struct vrrp_ctrl *ctrl);
 vrrp_event_t vrrp_ctrl_read(struct vrrp *vrrp, struct vrrp_net *vnet);
+vrrp_event_t vrrp_ctrl_exec(struct vrrp *vrrp, struct vrrp_net *vnet,
+			    char **cmd, int nword, const char **errmsg);
 
 
 #endif /* _VRRP_CTRL_H_ */
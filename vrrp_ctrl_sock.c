@@ -0,0 +1,834 @@
+/*
+ * vrrp_ctrl_sock.c - control socket
+ *
+ * Copyright (C) 2017 Arnaud Andre 
+ *
+ * This file is part of uvrrpd.
+ *
+ * uvrrpd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * uvrrpd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with uvrrpd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * SOCK_SEQPACKET UNIX socket serving all instances. Each msg sent by
+ * a client is a request of one or several cmd lines:
+ *
+ *   [vrid <vrid>] <cmd> [args]
+ *
+ * a cmd without vrid applies to all instances. Each request gets one
+ * reply msg: for each cmd, one line by instance, "ok vrid=<vrid> ..."
+ * or "err vrid=<vrid> <reason>", then an empty line. A reply larger than
+ * CTRL_SOCK_MSG_MAX, or half the send buffer of the client socket, is
+ * split in several msgs of whole lines. A client may send requests
+ * without waiting for replies, they are served in order.
+ *
+ * Replies are sent without blocking, what doesn't fit in socket buffer
+ * is kept by client and sent from the event loop once socket is
+ * writable; meanwhile next requests of this client wait.
+ *
+ * After "[vrid X] subscribe", a client also gets one JSON msg by state
+ * transition of the instance (all instances without vrid):
+ *
+ *   {"seq":7,"time":1234567890,"vrid":42,"interface":"eth0",
+ *    "from":"backup","to":"master","priority":100}
+ *
+ * @seq is a daemon wide sequence number, @time CLOCK_MONOTONIC in ns.
+ * Transitions are queued in a ring, and sent once the event loop is
+ * idle, so that the protocol never waits for subscribers. A slow
+ * subscriber keeps its position in the ring and is polled for EPOLLOUT
+ * until it catches up; if it is overrun, it gets {"lost":N} and resumes
+ * with the oldest queued event.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+
+#include "vrrp.h"
+#include "vrrp_ctrl.h"
+#include "vrrp_ctrl_sock.h"
+#include "vrrp_buf.h"
+#include "vrrp_loop.h"
+#include "common.h"
+#include "log.h"
+
+/* words of a cmd line, vrid and interface prefix included */
+#define CTRL_SOCK_NTOKEN	(CTRL_CMD_NTOKEN + 4)
+
+/* initial size of reply */
+#define CTRL_SOCK_BUFSIZE	4096
+
+/* JSON event */
+#define CTRL_SOCK_EVENT_MAX	256
+
+static int vrrp_ctrl_sock = -1;
+static char *vrrp_ctrl_sock_path = NULL;
+static struct list_head *vrrp_ctrl_sock_instances = NULL;
+
+/**
+ * vrrp_ctrl_sock_event - state transition waiting for subscribers
+ */
+struct vrrp_ctrl_sock_event {
+	uint8_t vrid;
+	char ifname[IFNAMSIZ];
+	int len;
+	char msg[CTRL_SOCK_EVENT_MAX];
+};
+
+/**
+ * vrrp_ctrl_sock_filter - instances of a cmd or a subscription,
+ *                         vrid 0 and empty ifname match any
+ */
+struct vrrp_ctrl_sock_filter {
+	uint8_t vrid;
+	char ifname[IFNAMSIZ];
+};
+
+/**
+ * vrrp_ctrl_sock_client - connected client, fd is -1 if slot is free
+ * @subscribed: count of @filter, instances subscribed to
+ * @events: EPOLLIN, or EPOLLOUT while a reply or events are pending
+ * @out: rest of a reply not sent yet, NULL if none
+ * @msg_max: largest reply msg, bounded by socket send buffer
+ * @seq: next event to send, if subscribed
+ */
+struct vrrp_ctrl_sock_client {
+	int fd;
+	uint32_t events;
+	char *out;
+	size_t len;
+	size_t off;
+	size_t msg_max;
+	int subscribed;
+	uint64_t seq;
+	struct vrrp_ctrl_sock_filter filter[CTRL_SOCK_FILTERS];
+};
+
+static struct vrrp_ctrl_sock_client vrrp_ctrl_sock_clients[CTRL_SOCK_CLIENTS];
+static int vrrp_ctrl_sock_nclients = 0;
+
+/* reply msg, kept between requests */
+static struct vrrp_buf vrrp_ctrl_sock_reply;
+
+/* events ring, next event is seq */
+static struct vrrp_ctrl_sock_event vrrp_ctrl_sock_events[CTRL_SOCK_EVENTS];
+static uint64_t vrrp_ctrl_sock_seq = 1;
+static int vrrp_ctrl_sock_pending = FALSE;
+
+/**
+ * vrrp_ctrl_sock_match() - filter f matches instance vrid on ifname
+ */
+static inline int vrrp_ctrl_sock_match(const struct vrrp_ctrl_sock_filter *f,
+				       int vrid, const char *ifname)
+{
+	return (((f->vrid == 0) || (f->vrid == vrid))
+		&& ((f->ifname[0] == '\0') || (strcmp(f->ifname, ifname) == 0)));
+}
+
+/**
+ * vrrp_ctrl_sock_printf() - append to reply
+ */
+#define vrrp_ctrl_sock_printf(...) \
+	vrrp_buf_printf(&vrrp_ctrl_sock_reply, __VA_ARGS__)
+
+/**
+ * vrrp_ctrl_sock_state() - reply state and counters of an instance
+ */
+static void vrrp_ctrl_sock_state(struct vrrp_instance *inst)
+{
+	static const uint8_t none[16] = { 0 };
+	struct vrrp *vrrp = &inst->vrrp;
+	struct vrrp_net *vnet = &inst->vnet;
+	struct vrrp_stats snap;
+	struct vrrp_ip *vip;
+	char straddr[INET6_ADDRSTRLEN];
+	uint64_t invalid = 0, since;
+	char sep = '=';
+	int r;
+
+	vrrp_ctrl_sock_printf("ok vrid=%d interface=%s family=%s version=%d "
+			      "state=%s priority=%d adv_int=%d "
+			      "master_adv_int=%d preempt=%d vips",
+			      vrrp->vrid, vnet->vif.ifname,
+			      (vnet->family == AF_INET) ? "inet" : "inet6",
+			      vrrp->version, STR_STATE(vrrp->state),
+			      vrrp->priority, vrrp->adv_int,
+			      vrrp->master_adv_int, vrrp->preempt);
+
+	list_for_each_entry_reverse(vip, &vnet->vip_list, iplist) {
+		vrrp_ctrl_sock_printf("%c%s", sep,
+				      vnet->ipx_to_str(&vip->ipx, straddr));
+		sep = ',';
+	}
+
+	vrrp_stats_snapshot(vnet->stats, &snap);
+
+	if ((memcmp(snap.master, none, sizeof(none)) != 0)
+	    && (inet_ntop(snap.family, snap.master, straddr,
+			  sizeof(straddr)) != NULL))
+		vrrp_ctrl_sock_printf(" master=%s", straddr);
+
+	for (r = 0; r < VRRP_INVALID_MAX; ++r)
+		invalid += snap.invalid[r];
+
+	since = vrrp_stats_now() - snap.state_since;
+
+	vrrp_ctrl_sock_printf(" transitions=%" PRIu64 " since=%" PRIu64
+			      ".%03" PRIu64 " adv_sent=%" PRIu64 " adv_recv=%"
+			      PRIu64 " invalid=%" PRIu64 "\n",
+			      snap.transitions, since / 1000000000,
+			      since / 1000000 % 1000, snap.adv_sent,
+			      snap.adv_recv, invalid);
+}
+
+/**
+ * vrrp_ctrl_sock_timeline() - reply last transitions of an instance,
+ *                             oldest first
+ */
+static void vrrp_ctrl_sock_timeline(struct vrrp_instance *inst)
+{
+	const struct vrrp_timeline *tl = &inst->vrrp.timeline;
+	uint64_t now = vrrp_stats_now();
+	char line[256];
+	unsigned int i;
+
+	vrrp_ctrl_sock_printf("ok vrid=%d interface=%s transitions=%u",
+			      inst->vrrp.vrid, inst->vnet.vif.ifname, tl->len);
+
+	for (i = 0; i < tl->len; ++i) {
+		vrrp_timeline_format(tl, i, now, line, sizeof(line));
+		vrrp_ctrl_sock_printf("%s%s", (i == 0 ? " timeline=" : "; "),
+				      line);
+	}
+
+	vrrp_ctrl_sock_printf("\n");
+}
+
+/**
+ * vrrp_ctrl_sock_cmd() - run a cmd on an instance
+ */
+static void vrrp_ctrl_sock_cmd(struct vrrp_instance *inst, char **cmd,
+			       int nword)
+{
+	const char *errmsg;
+	vrrp_event_t event;
+
+	if (matches(cmd[0], "state") || matches(cmd[0], "status")) {
+		vrrp_ctrl_sock_state(inst);
+		return;
+	}
+
+	if (matches(cmd[0], "timeline")) {
+		vrrp_ctrl_sock_timeline(inst);
+		return;
+	}
+
+	event = vrrp_ctrl_exec(&inst->vrrp, &inst->vnet, cmd, nword, &errmsg);
+	if (event == INVALID) {
+		vrrp_ctrl_sock_printf("err vrid=%d interface=%s %s\n",
+				      inst->vrrp.vrid, inst->vnet.vif.ifname,
+				      errmsg);
+		return;
+	}
+
+	vrrp_ctrl_sock_printf("ok vrid=%d interface=%s\n", inst->vrrp.vrid,
+			      inst->vnet.vif.ifname);
+	vrrp_loop_dispatch(inst, event);
+}
+
+/**
+ * vrrp_ctrl_sock_subscribe() - send next state transitions of
+ *                              instances matching f to client
+ *
+ * Unsubscribe drops subscriptions to the instances matching f.
+ */
+static void vrrp_ctrl_sock_subscribe(struct vrrp_ctrl_sock_client *c,
+				     const struct vrrp_ctrl_sock_filter *f,
+				     int on)
+{
+	struct vrrp_ctrl_sock_filter *s;
+	int i;
+
+	if (!on) {
+		for (i = 0; i < c->subscribed;) {
+			s = &c->filter[i];
+			if (vrrp_ctrl_sock_match(f, s->vrid, s->ifname))
+				*s = c->filter[--c->subscribed];
+			else
+				++i;
+		}
+
+		vrrp_ctrl_sock_printf("ok seq=%" PRIu64 "\n\n",
+				      vrrp_ctrl_sock_seq);
+		return;
+	}
+
+	for (i = 0; i < c->subscribed; ++i) {
+		s = &c->filter[i];
+		if ((s->vrid == f->vrid) && (strcmp(s->ifname, f->ifname) == 0))
+			break;
+	}
+
+	if (i == c->subscribed) {
+		if (c->subscribed == CTRL_SOCK_FILTERS) {
+			vrrp_ctrl_sock_printf("err too many subscriptions\n\n");
+			return;
+		}
+
+		if (c->subscribed == 0)
+			c->seq = vrrp_ctrl_sock_seq;
+
+		c->filter[c->subscribed++] = *f;
+	}
+
+	vrrp_ctrl_sock_printf("ok seq=%" PRIu64 "\n\n", vrrp_ctrl_sock_seq);
+}
+
+/**
+ * vrrp_ctrl_sock_line() - run a cmd line of a request
+ */
+static void vrrp_ctrl_sock_line(struct vrrp_ctrl_sock_client *c, char *line)
+{
+	struct vrrp_ctrl_sock_filter f = { 0, "" };
+	struct vrrp_instance *inst;
+	char *words[CTRL_SOCK_NTOKEN];
+	char **cmd = words;
+	char *saveptr = NULL;
+	unsigned long vrid;
+	int nword, ninst = 0;
+
+	for (nword = 0; nword < CTRL_SOCK_NTOKEN; ++nword) {
+		words[nword] = strtok_r(nword ? NULL : line, WHITESPACE,
+					&saveptr);
+		if (words[nword] == NULL)
+			break;
+	}
+
+	if (nword == 0)
+		return;
+
+	/* vrid and interface prefix */
+	if (matches(cmd[0], "vrid")) {
+		if ((nword < 3) || (mystrtoul(&vrid, cmd[1], VRID_MAX) != 0)
+		    || (vrid == 0))
+			goto usage;
+
+		f.vrid = vrid;
+		cmd += 2;
+		nword -= 2;
+	}
+
+	if (matches(cmd[0], "if")) {
+		if ((nword < 3) || (strlen(cmd[1]) >= IFNAMSIZ))
+			goto usage;
+
+		strcpy(f.ifname, cmd[1]);
+		cmd += 2;
+		nword -= 2;
+	}
+
+	if (matches(cmd[0], "subscribe") || matches(cmd[0], "unsubscribe")) {
+		vrrp_ctrl_sock_subscribe(c, &f, (cmd[0][0] == 's'));
+		return;
+	}
+
+	/* stop is daemon wide, run it once */
+	if (matches(cmd[0], "stop")) {
+		inst = list_first_entry(vrrp_ctrl_sock_instances,
+					struct vrrp_instance, list);
+		vrrp_ctrl_sock_cmd(inst, cmd, nword);
+		vrrp_ctrl_sock_printf("\n");
+		return;
+	}
+
+	/* several instances may share a vrid on different interfaces */
+	list_for_each_entry(inst, vrrp_ctrl_sock_instances, list) {
+		if (!vrrp_ctrl_sock_match(&f, inst->vrrp.vrid,
+					  inst->vnet.vif.ifname))
+			continue;
+
+		vrrp_ctrl_sock_cmd(inst, cmd, nword);
+		++ninst;
+	}
+
+	if ((ninst == 0) && (f.ifname[0] != '\0'))
+		vrrp_ctrl_sock_printf("err vrid=%d interface=%s no such "
+				      "instance\n", f.vrid, f.ifname);
+	else if (ninst == 0)
+		vrrp_ctrl_sock_printf("err vrid=%d no such instance\n",
+				      f.vrid);
+
+	vrrp_ctrl_sock_printf("\n");
+	return;
+
+ usage:
+	vrrp_ctrl_sock_printf("err usage: [vrid <vrid>] [if <interface>] "
+			      "<cmd>\n\n");
+}
+
+/**
+ * vrrp_ctrl_sock_close() - disconnect a client
+ */
+static void vrrp_ctrl_sock_close(struct vrrp_ctrl_sock_client *c)
+{
+	vrrp_loop_del(c->fd);
+	close(c->fd);
+	free(c->out);
+
+	c->fd = -1;
+	c->out = NULL;
+	c->subscribed = 0;
+	vrrp_ctrl_sock_nclients--;
+}
+
+/**
+ * vrrp_ctrl_sock_subscriber() - client subscribed to instance of event
+ */
+static int vrrp_ctrl_sock_subscriber(const struct vrrp_ctrl_sock_client *c,
+				     const struct vrrp_ctrl_sock_event *ev)
+{
+	int i;
+
+	for (i = 0; i < c->subscribed; ++i) {
+		if (vrrp_ctrl_sock_match(&c->filter[i], ev->vrid, ev->ifname))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/**
+ * vrrp_ctrl_sock_send() - send queued events to a subscriber
+ *
+ * @return 0 if all events are sent, 1 if client is busy, -1 on error
+ */
+static int vrrp_ctrl_sock_send(struct vrrp_ctrl_sock_client *c)
+{
+	struct vrrp_ctrl_sock_event *ev;
+	char lost[32];
+	int len;
+
+	while (c->seq != vrrp_ctrl_sock_seq) {
+
+		/* overrun, skip to the oldest queued event */
+		if (vrrp_ctrl_sock_seq - c->seq > CTRL_SOCK_EVENTS) {
+			len = snprintf(lost, sizeof(lost), "{\"lost\":%" PRIu64
+				       "}", vrrp_ctrl_sock_seq - c->seq
+				       - CTRL_SOCK_EVENTS);
+			if (send(c->fd, lost, len,
+				 MSG_DONTWAIT | MSG_NOSIGNAL) == -1)
+				break;
+
+			c->seq = vrrp_ctrl_sock_seq - CTRL_SOCK_EVENTS;
+			continue;
+		}
+
+		ev = &vrrp_ctrl_sock_events[c->seq % CTRL_SOCK_EVENTS];
+
+		if (vrrp_ctrl_sock_subscriber(c, ev)
+		    && (send(c->fd, ev->msg, ev->len,
+			     MSG_DONTWAIT | MSG_NOSIGNAL) == -1))
+			break;
+
+		c->seq++;
+	}
+
+	if (c->seq == vrrp_ctrl_sock_seq)
+		return 0;
+
+	if ((errno == EAGAIN) || (errno == EINTR) || (errno == ENOBUFS))
+		return 1;
+
+	/* client is gone */
+	return -1;
+}
+
+/**
+ * vrrp_ctrl_sock_poll() - poll client for events, EPOLLIN or EPOLLOUT
+ */
+static int vrrp_ctrl_sock_poll(struct vrrp_ctrl_sock_client *c,
+			       uint32_t events)
+{
+	if (c->events == events)
+		return 0;
+
+	if (vrrp_loop_mod(c->fd, events) != 0)
+		return -1;
+
+	c->events = events;
+
+	return 0;
+}
+
+/**
+ * vrrp_ctrl_sock_write() - send reply data without blocking, one msg
+ *                          by c->msg_max bytes of whole lines
+ *
+ * @return count of bytes sent, -1 if client is gone
+ */
+static ssize_t vrrp_ctrl_sock_write(const struct vrrp_ctrl_sock_client *c,
+				    const char *data, size_t len)
+{
+	const char *eol;
+	size_t off = 0;
+	size_t n;
+
+	while (off < len) {
+		n = len - off;
+		if (n > c->msg_max) {
+			n = c->msg_max;
+			eol = memrchr(data + off, '\n', n);
+			if (eol != NULL)
+				n = eol - (data + off) + 1;
+		}
+
+		if (send(c->fd, data + off, n,
+			 MSG_DONTWAIT | MSG_NOSIGNAL) == -1) {
+			if ((errno == EAGAIN) || (errno == EINTR))
+				break;
+			return -1;
+		}
+
+		off += n;
+	}
+
+	return off;
+}
+
+/**
+ * vrrp_ctrl_sock_answer() - send reply of a request, what doesn't fit in
+ *                           socket buffer is kept by client and sent once
+ *                           socket is writable (see vrrp_ctrl_sock_client())
+ *
+ * @return 0 if reply is sent, 1 if pending, -1 on error
+ */
+static int vrrp_ctrl_sock_answer(struct vrrp_ctrl_sock_client *c,
+				 const struct vrrp_buf *b)
+{
+	ssize_t n;
+
+	if (b->err)
+		return -1;
+
+	n = vrrp_ctrl_sock_write(c, b->data, b->len);
+	if (n < 0)
+		return -1;
+
+	if ((size_t) n == b->len)
+		return 0;
+
+	c->out = malloc(b->len - n);
+	if (c->out == NULL) {
+		log_error("control socket :: malloc - %m");
+		return -1;
+	}
+
+	memcpy(c->out, b->data + n, b->len - n);
+	c->len = b->len - n;
+	c->off = 0;
+
+	if (vrrp_ctrl_sock_poll(c, EPOLLOUT) != 0)
+		return -1;
+
+	return 1;
+}
+
+/**
+ * vrrp_ctrl_sock_drain() - send the rest of a reply, then queued
+ *                          events, socket is writable
+ *
+ * @return 0 if all is sent, 1 if pending, -1 on error
+ */
+static int vrrp_ctrl_sock_drain(struct vrrp_ctrl_sock_client *c)
+{
+	ssize_t n;
+	int ret;
+
+	if (c->out != NULL) {
+		n = vrrp_ctrl_sock_write(c, c->out + c->off, c->len - c->off);
+		if (n < 0) {
+			log_warning("control socket :: reply not sent, "
+				    "disconnect client");
+			return -1;
+		}
+
+		c->off += n;
+		if (c->off < c->len)
+			return 1;
+
+		free(c->out);
+		c->out = NULL;
+	}
+
+	if (c->subscribed) {
+		ret = vrrp_ctrl_sock_send(c);
+		if (ret != 0)
+			return ret;
+	}
+
+	return vrrp_ctrl_sock_poll(c, EPOLLIN);
+}
+
+/**
+ * vrrp_ctrl_sock_client() - requests received from a client, reply
+ *                           to each of them in order
+ */
+static void vrrp_ctrl_sock_client(__attribute__ ((unused)) int fd, void *data)
+{
+	struct vrrp_ctrl_sock_client *c = data;
+	struct vrrp_buf *b = &vrrp_ctrl_sock_reply;
+	char req[CTRL_SOCK_REQ_MAX];
+	char *line, *next;
+	ssize_t n;
+	int i, ret;
+
+	/* socket is writable, reply or events pending, next requests
+	 * wait for them */
+	if (c->events == EPOLLOUT) {
+		if (vrrp_ctrl_sock_drain(c) < 0)
+			vrrp_ctrl_sock_close(c);
+		return;
+	}
+
+	for (i = 0; i < CTRL_SOCK_BATCH; ++i) {
+		n = recv(c->fd, req, sizeof(req) - 1, MSG_DONTWAIT | MSG_TRUNC);
+		if ((n < 0) && ((errno == EAGAIN) || (errno == EINTR)))
+			return;
+
+		if (n <= 0) {
+			vrrp_ctrl_sock_close(c);
+			return;
+		}
+
+		vrrp_buf_reset(b);
+
+		if (n > (ssize_t) sizeof(req) - 1)
+			vrrp_ctrl_sock_printf("err request too large\n\n");
+		else {
+			req[n] = '\0';
+			next = req;
+			while ((line = strsep(&next, "\n")) != NULL)
+				vrrp_ctrl_sock_line(c, line);
+		}
+
+		ret = vrrp_ctrl_sock_answer(c, b);
+		if (ret < 0) {
+			log_warning("control socket :: reply not sent, "
+				    "disconnect client");
+			vrrp_ctrl_sock_close(c);
+			return;
+		}
+
+		if (ret == 1)
+			return;
+	}
+}
+
+/**
+ * vrrp_ctrl_sock_accept() - new client on control socket
+ */
+static void vrrp_ctrl_sock_accept(int fd, __attribute__ ((unused)) void *data)
+{
+	static const char full[] = "err too many clients\n\n";
+	struct vrrp_ctrl_sock_client *c;
+	socklen_t optlen = sizeof(int);
+	int cfd, i, sndbuf;
+
+	cfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (cfd == -1) {
+		if ((errno != EAGAIN) && (errno != EINTR))
+			log_error("control socket :: accept4 - %m");
+		return;
+	}
+
+	for (i = 0; (i < CTRL_SOCK_CLIENTS)
+	     && (vrrp_ctrl_sock_clients[i].fd != -1); ++i);
+
+	if (i == CTRL_SOCK_CLIENTS) {
+		send(cfd, full, sizeof(full) - 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+		close(cfd);
+		return;
+	}
+
+	c = &vrrp_ctrl_sock_clients[i];
+	memset(c, 0, sizeof(struct vrrp_ctrl_sock_client));
+
+	if (vrrp_loop_add(cfd, vrrp_ctrl_sock_client, c) != 0) {
+		c->fd = -1;
+		close(cfd);
+		return;
+	}
+
+	/* a msg larger than send buffer is never sent, EMSGSIZE */
+	c->msg_max = CTRL_SOCK_MSG_MAX;
+	if ((getsockopt(cfd, SOL_SOCKET, SO_SNDBUF, &sndbuf, &optlen) == 0)
+	    && (sndbuf / 2 < CTRL_SOCK_MSG_MAX))
+		c->msg_max = sndbuf / 2;
+
+	c->fd = cfd;
+	c->events = EPOLLIN;
+	vrrp_ctrl_sock_nclients++;
+}
+
+/**
+ * vrrp_ctrl_sock_event() - queue a state transition for subscribers
+ */
+void vrrp_ctrl_sock_event(const struct vrrp *vrrp,
+			  const struct vrrp_net *vnet, int from, int to)
+{
+	struct vrrp_ctrl_sock_event *ev;
+
+	if (vrrp_ctrl_sock == -1)
+		return;
+
+	ev = &vrrp_ctrl_sock_events[vrrp_ctrl_sock_seq % CTRL_SOCK_EVENTS];
+	ev->vrid = vrrp->vrid;
+	memcpy(ev->ifname, vnet->vif.ifname, IFNAMSIZ);
+	ev->len = snprintf(ev->msg, sizeof(ev->msg),
+			   "{\"seq\":%" PRIu64 ",\"time\":%" PRIu64
+			   ",\"vrid\":%d,\"interface\":\"%s\",\"from\":\"%s\","
+			   "\"to\":\"%s\",\"priority\":%d}",
+			   vrrp_ctrl_sock_seq, vrrp_stats_now(), vrrp->vrid,
+			   vnet->vif.ifname, STR_STATE(from), STR_STATE(to),
+			   vrrp->priority);
+	if (ev->len >= (int) sizeof(ev->msg))
+		ev->len = sizeof(ev->msg) - 1;
+
+	vrrp_ctrl_sock_seq++;
+	vrrp_ctrl_sock_pending = TRUE;
+}
+
+/**
+ * vrrp_ctrl_sock_flush() - send queued state transitions to
+ *                          subscribers, without blocking
+ *
+ * A busy subscriber is polled for EPOLLOUT, and gets the rest of the
+ * events from the event loop once writable (see vrrp_ctrl_sock_drain()).
+ */
+void vrrp_ctrl_sock_flush(void)
+{
+	struct vrrp_ctrl_sock_client *c;
+	int i, ret;
+
+	if (!vrrp_ctrl_sock_pending)
+		return;
+
+	for (i = 0; i < CTRL_SOCK_CLIENTS; ++i) {
+		c = &vrrp_ctrl_sock_clients[i];
+		if ((c->fd == -1) || !c->subscribed || (c->events == EPOLLOUT))
+			continue;
+
+		ret = vrrp_ctrl_sock_send(c);
+		if ((ret < 0)
+		    || ((ret == 1) && (vrrp_ctrl_sock_poll(c, EPOLLOUT) != 0)))
+			vrrp_ctrl_sock_close(c);
+	}
+
+	vrrp_ctrl_sock_pending = FALSE;
+}
+
+/**
+ * vrrp_ctrl_sock_init() - open control socket and register it in
+ *                         event loop
+ * @path: path of UNIX socket, only reachable by owner
+ */
+int vrrp_ctrl_sock_init(const char *path, struct list_head *instances)
+{
+	struct sockaddr_un sun = { 0 };
+
+	for (int i = 0; i < CTRL_SOCK_CLIENTS; ++i)
+		vrrp_ctrl_sock_clients[i].fd = -1;
+
+	if (strlen(path) >= sizeof(sun.sun_path)) {
+		log_error("control socket :: path too long %s", path);
+		return -1;
+	}
+
+	sun.sun_family = AF_UNIX;
+	strcpy(sun.sun_path, path);
+
+	vrrp_ctrl_sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK |
+				SOCK_CLOEXEC, 0);
+	if (vrrp_ctrl_sock == -1) {
+		log_error("control socket :: socket - %m");
+		return -1;
+	}
+
+	unlink(path);
+	vrrp_ctrl_sock_path = strdup(path);
+
+	if (bind(vrrp_ctrl_sock, (struct sockaddr *) &sun, sizeof(sun)) != 0) {
+		log_error("control socket :: bind %s - %m", path);
+		goto err;
+	}
+
+	if (chmod(path, 0600) != 0) {
+		log_error("control socket :: chmod %s - %m", path);
+		goto err;
+	}
+
+	if (listen(vrrp_ctrl_sock, CTRL_SOCK_CLIENTS) != 0) {
+		log_error("control socket :: listen - %m");
+		goto err;
+	}
+
+	if (vrrp_buf_init(&vrrp_ctrl_sock_reply, CTRL_SOCK_BUFSIZE) != 0)
+		goto err;
+
+	vrrp_ctrl_sock_instances = instances;
+
+	if (vrrp_loop_add(vrrp_ctrl_sock, vrrp_ctrl_sock_accept, NULL) != 0)
+		goto err;
+
+	log_info("control socket :: listening on %s", path);
+
+	return 0;
+
+ err:
+	vrrp_ctrl_sock_cleanup();
+	return -1;
+}
+
+/**
+ * vrrp_ctrl_sock_cleanup() - close control socket and clients
+ */
+void vrrp_ctrl_sock_cleanup(void)
+{
+	for (int i = 0; i < CTRL_SOCK_CLIENTS; ++i) {
+		if (vrrp_ctrl_sock_clients[i].fd != -1)
+			close(vrrp_ctrl_sock_clients[i].fd);
+		free(vrrp_ctrl_sock_clients[i].out);
+		vrrp_ctrl_sock_clients[i].fd = -1;
+		vrrp_ctrl_sock_clients[i].out = NULL;
+	}
+	vrrp_ctrl_sock_nclients = 0;
+
+	if (vrrp_ctrl_sock != -1)
+		close(vrrp_ctrl_sock);
+	vrrp_ctrl_sock = -1;
+
+	if (vrrp_ctrl_sock_path != NULL) {
+		unlink(vrrp_ctrl_sock_path);
+		free(vrrp_ctrl_sock_path);
+	}
+	vrrp_ctrl_sock_path = NULL;
+
+	vrrp_buf_cleanup(&vrrp_ctrl_sock_reply);
+}
@@ -0,0 +1,56 @@
+/*
+ * vrrp_ctrl_sock.h - control socket
+ *
+ * Copyright (C) 2017 Arnaud Andre 
+ *
+ * This file is part of uvrrpd.
+ *
+ * uvrrpd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * uvrrpd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with uvrrpd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _VRRP_CTRL_SOCK_H_
+#define _VRRP_CTRL_SOCK_H_
+
+#include "list.h"
+
+/* from vrrp.h */
+struct vrrp;
+struct vrrp_net;
+
+/* concurrent clients */
+#define CTRL_SOCK_CLIENTS	32
+
+/* request msg, one or several cmd lines */
+#define CTRL_SOCK_REQ_MAX	4096
+
+/* reply msg, a longer reply is split on line boundaries */
+#define CTRL_SOCK_MSG_MAX	16384
+
+/* requests of a client handled by wakeup */
+#define CTRL_SOCK_BATCH		16
+
+/* state transitions queued for slow subscribers */
+#define CTRL_SOCK_EVENTS	64
+
+/* subscriptions of a client, by vrid and interface */
+#define CTRL_SOCK_FILTERS	16
+
+int vrrp_ctrl_sock_init(const char *path, struct list_head *instances);
+void vrrp_ctrl_sock_event(const struct vrrp *vrrp,
+			  const struct vrrp_net *vnet, int from, int to);
+void vrrp_ctrl_sock_flush(void);
+void vrrp_ctrl_sock_cleanup(void);
+
+#endif /* _VRRP_CTRL_SOCK_H_ */
@@ -23,14 +23,20 @@
 #include <unistd.h>
 #include <string.h>
 #include <signal.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/syscall.h>
 #include <netdb.h>
 #include <netinet/in.h>
-#include <spawn.h>
+#include <stdint.h>
 
 #include "vrrp.h"
 #include "vrrp_exec.h"
+#include "vrrp_vmac.h"
+#include "vrrp_loop.h"
+#include "vrrp_worker.h"
+#include "vrrp_probe.h"
 #include "uvrrpd.h"
 #include "common.h"
 #include "log.h"
@@ -105,11 +111,83 @@ static int vrrp_build_args(const char *scriptname, char **argv,
 }
 
 /**
- * vrrp_exec()
+ * vrrp_exec_pidfd() - get a pidfd of hook script
  */
-int vrrp_exec(struct vrrp *vrrp, const struct vrrp_net *vnet, vrrp_state state)
+static int vrrp_exec_pidfd(pid_t pid)
 {
+#ifdef SYS_pidfd_open
+	return syscall(SYS_pidfd_open, pid, 0);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif /* SYS_pidfd_open */
+}
+
+/**
+ * vrrp_exec_done() - hook script terminated, store its status and
+ *                    duration
+ */
+static void vrrp_exec_done(struct vrrp *vrrp, int status)
+{
+	struct vrrp_hook *hook = &vrrp->hook;
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	hook->status = status;
+	hook->duration = (end.tv_sec - hook->start.tv_sec) * 1000
+	    + (end.tv_nsec - hook->start.tv_nsec) / 1000000;
+	hook->pid = 0;
+	hook->worker = FALSE;
+
+	vrrp_timer_clear(&hook->timer);
+
+	VRRP_PROBE4(hook_done, vrrp->vrid, hook->state, status,
+		    hook->duration);
+}
+
+/**
+ * vrrp_exec_timeout() - hook script is too long, kill it
+ */
+static void vrrp_exec_timeout(__attribute__ ((unused)) struct vrrp_timer *vt,
+			      void *data)
+{
+	struct vrrp *vrrp = data;
+
+	log_warning("vrid %d :: hook %s still running after %lds, kill it",
+		    vrrp->vrid, STR_STATE(vrrp->hook.state),
+		    (long) vrrp->hook.timeout);
+
+	/* script and its children */
+	if (vrrp->hook.worker)
+		vrrp_worker_kill((uintptr_t) vrrp);
+	else
+		kill(-vrrp->hook.pid, SIGKILL);
+}
+
+/**
+ * vrrp_exec_running() - a hook script of @vrrp is running
+ */
+static inline int vrrp_exec_running(const struct vrrp *vrrp)
+{
+	return (vrrp->hook.pid != 0) || vrrp->hook.worker;
+}
+
+/**
+ * vrrp_exec_spawn() - spawn hook script, don't wait for it
+ *
+ * Script is spawned by hook worker, uvrrpd gets its exit status
+ * on worker socketpair. Without worker, uvrrpd spawns it itself and
+ * catches its termination through a pidfd, or waits for it if pidfd
+ * are not supported (linux < 5.3).
+ */
+static int vrrp_exec_spawn(struct vrrp *vrrp, const struct vrrp_net *vnet,
+			   vrrp_state state)
+{
+	struct vrrp_hook *hook = &vrrp->hook;
 	const char *scriptname;
+	pid_t pid;
+	int status;
 
 	if (vrrp->scriptname == NULL)
 		scriptname = VRRP_SCRIPT;
@@ -124,77 +202,187 @@ int vrrp_exec(struct vrrp *vrrp, const struct vrrp_net *vnet, vrrp_state state)
 
 	vrrp_build_args(scriptname, vrrp->argv, vrrp, vnet, state);
 
-	/* Sig gestion */
-	sigset_t blockmask, origmask;
-	struct sigaction sa_ignore, sa_origquit, sa_origint, sa_default;
-
-	sigemptyset(&blockmask);	/* Block SIGCHLD */
-	sigaddset(&blockmask, SIGCHLD);
-	sigprocmask(SIG_BLOCK, &blockmask, &origmask);
-	sa_ignore.sa_handler = SIG_IGN;	/* Ignore SIGINT and SIGQUIT */
-	sa_ignore.sa_flags = 0;
-	sigemptyset(&sa_ignore.sa_mask);
-	sigaction(SIGINT, &sa_ignore, &sa_origint);
-	sigaction(SIGQUIT, &sa_ignore, &sa_origquit);
-
-	/* fork */
-	uvrrpd_sched_unset(); /* remove SCHED_RR */
-	pid_t child = fork();
-	int status, savedErrno;
-
-	if (child == -1) {
-		log_error("vrid %d :: fork - %m", vrrp->vrid);
-		vrrp_exec_cleanup(vrrp);
-		return -1;
+	hook->state = state;
+	clock_gettime(CLOCK_MONOTONIC, &hook->start);
+
+	if (vrrp_worker_spawn((uintptr_t) vrrp, scriptname, vrrp->argv) == 0) {
+		hook->worker = TRUE;
+		VRRP_PROBE3(hook_spawn, vrrp->vrid, state, 0);
+
+		if (hook->timeout != 0)
+			vrrp_timer_set(&hook->timer, hook->timeout, 0);
+
+		return 0;
 	}
 
-	/* child */
-	if (child == 0) {
-		sa_default.sa_handler = SIG_DFL;
-		sa_default.sa_flags = 0;
-		sigemptyset(&sa_default.sa_mask);
-		if (sa_origint.sa_handler != SIG_IGN)
-			sigaction(SIGINT, &sa_default, NULL);
-		if (sa_origquit.sa_handler != SIG_IGN)
-			sigaction(SIGQUIT, &sa_default, NULL);
-		sigprocmask(SIG_SETMASK, &origmask, NULL);
-
-		/* execve */
-		execve(scriptname, (char *const *) vrrp->argv, NULL);
-
-		log_error("vrid %d :: execve - %m", vrrp->vrid);
-		vrrp_exec_cleanup(vrrp);
+	if (vrrp_worker_exec(&pid, scriptname, vrrp->argv) != 0)
 		return -1;
-	}
 
-	/* parent */
-	if (child > 0) {
-		
-		uvrrpd_sched_set(); /* restore SCHED_RR */
-		while (waitpid(child, &status, 0) == -1) {
-			if (errno != EINTR) {	/* Error other than EINTR */
+	hook->pid = pid;
+	hook->pidfd = vrrp_exec_pidfd(pid);
+	VRRP_PROBE3(hook_spawn, vrrp->vrid, state, pid);
+
+	if ((hook->pidfd < 0) || (vrrp_loop_hook(vrrp, hook->pidfd) != 0)) {
+		if (hook->pidfd >= 0)
+			close(hook->pidfd);
+		hook->pidfd = -1;
+
+		while (waitpid(pid, &status, 0) == -1) {
+			if (errno != EINTR) {
 				log_error("vrid %d :: waitpid - %m", vrrp->vrid);
-				status = -1;
-				break;	/* So exit loop */
+				status = W_EXITCODE(127, 0);
+				break;
 			}
 		}
+
+		vrrp_exec_done(vrrp, status);
+		return status;
+	}
+
+	if (hook->timeout != 0)
+		vrrp_timer_set(&hook->timer, hook->timeout, 0);
+
+	return 0;
+}
+
+/**
+ * vrrp_exec() - run hook script, or rtnetlink backend (option -N)
+ *
+ * Hook scripts of an instance run one at a time, in order
+ */
+int vrrp_exec(struct vrrp *vrrp, const struct vrrp_net *vnet, vrrp_state state)
+{
+	struct vrrp_hook *hook = &vrrp->hook;
+
+	if (vrrp->netlink)
+		return vrrp_vmac(vrrp, vnet, state);
+
+	/* a script is running, queue this one */
+	if (vrrp_exec_running(vrrp)) {
+		if (hook->len == VRRP_HOOK_QUEUE) {
+			log_error("vrid %d :: too many hooks pending, drop %s",
+				  vrrp->vrid, STR_STATE(state));
+			return -1;
+		}
+
+		hook->queue[(hook->head + hook->len) % VRRP_HOOK_QUEUE] = state;
+		++hook->len;
+
+		return 0;
 	}
 
-	/* Unblock SIGCHLD, restore dispositions of SIGINT and SIGQUIT */
-	savedErrno = errno;	/* The following may change 'errno' */
-	sigprocmask(SIG_SETMASK, &origmask, NULL);
-	sigaction(SIGINT, &sa_origint, NULL);
-	sigaction(SIGQUIT, &sa_origquit, NULL);
-	errno = savedErrno;
+	return vrrp_exec_spawn(vrrp, vnet, state);
+}
+
+/**
+ * vrrp_exec_vip() - apply a VIP set or removed while master
+ *
+ * rtnetlink backend updates this VIP only, hook script is run again
+ * in master state with the new list of VIPs
+ */
+int vrrp_exec_vip(struct vrrp *vrrp, const struct vrrp_net *vnet,
+		  struct vrrp_ip *vip, int add)
+{
+	if (vrrp->netlink)
+		return vrrp_vmac_vip(vnet, vip, add);
 
-	return status;
+	return vrrp_exec(vrrp, vnet, MASTER);
 }
 
 /**
- * vrrp_exec_init() - init vrrp->argv buffer
+ * vrrp_exec_reap() - hook script terminated, get its exit status
+ */
+void vrrp_exec_reap(struct vrrp *vrrp)
+{
+	struct vrrp_hook *hook = &vrrp->hook;
+	int status;
+
+	while (waitpid(hook->pid, &status, 0) == -1) {
+		if (errno != EINTR) {
+			log_error("vrid %d :: waitpid - %m", vrrp->vrid);
+			status = W_EXITCODE(127, 0);
+			break;
+		}
+	}
+
+	vrrp_loop_del(hook->pidfd);
+	close(hook->pidfd);
+	hook->pidfd = -1;
+
+	vrrp_exec_done(vrrp, status);
+}
+
+/**
+ * vrrp_exec_next() - run queued hook scripts
+ */
+void vrrp_exec_next(struct vrrp *vrrp, const struct vrrp_net *vnet)
+{
+	struct vrrp_hook *hook = &vrrp->hook;
+	vrrp_state state;
+
+	while (!vrrp_exec_running(vrrp) && (hook->len > 0)) {
+		state = hook->queue[hook->head];
+		hook->head = (hook->head + 1) % VRRP_HOOK_QUEUE;
+		--hook->len;
+
+		vrrp_exec_spawn(vrrp, vnet, state);
+	}
+}
+
+/**
+ * vrrp_exec_worker() - read exit status of a script spawned by hook
+ *                      worker
+ *
+ * @return instance whose script terminated, NULL if none
+ */
+struct vrrp *vrrp_exec_worker(void)
+{
+	struct vrrp *vrrp;
+	uint64_t cookie;
+	int status;
+
+	if (vrrp_worker_read(&cookie, &status) != 1)
+		return NULL;
+
+	vrrp = (struct vrrp *) (uintptr_t) cookie;
+	vrrp_exec_done(vrrp, status);
+
+	return vrrp;
+}
+
+/**
+ * vrrp_exec_abort() - hook worker is gone, forget its script
+ *
+ * @return 1 if a script of @vrrp was running in hook worker
+ */
+int vrrp_exec_abort(struct vrrp *vrrp)
+{
+	if (!vrrp->hook.worker)
+		return 0;
+
+	vrrp_exec_done(vrrp, W_EXITCODE(127, 0));
+
+	return 1;
+}
+
+/**
+ * vrrp_exec_pending() - hook scripts of @vrrp running or queued
+ */
+int vrrp_exec_pending(const struct vrrp *vrrp)
+{
+	return vrrp_exec_running(vrrp) || (vrrp->hook.len > 0);
+}
+
+/**
+ * vrrp_exec_init() - init vrrp->argv buffer, or rtnetlink backend
  */
 int vrrp_exec_init(struct vrrp *vrrp)
 {
+	vrrp_timer_init(&vrrp->hook.timer, vrrp_exec_timeout, vrrp);
+
+	if (vrrp->netlink)
+		return vrrp_vmac_init(vrrp);
+
 	vrrp->argv = malloc(sizeof(char *) * SCRIPT_NARGS);
 
 	if (vrrp->argv == NULL) {
@@ -219,6 +407,13 @@ int vrrp_exec_init(struct vrrp *vrrp)
  */
 void vrrp_exec_cleanup(struct vrrp *vrrp)
 {
+	vrrp_timer_clear(&vrrp->hook.timer);
+
+	if (vrrp->netlink) {
+		vrrp_vmac_cleanup(vrrp);
+		return;
+	}
+
 	if (vrrp->argv != NULL) {
 		for (int i = 0; i < SCRIPT_NARGS - 1; ++i) {
 			free(vrrp->argv[i]);
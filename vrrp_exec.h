@@ -25,6 +25,13 @@
 #include "vrrp.h"
 
 int vrrp_exec(struct vrrp *vrrp, const struct vrrp_net *vnet, vrrp_state state);
+int vrrp_exec_vip(struct vrrp *vrrp, const struct vrrp_net *vnet,
+		  struct vrrp_ip *vip, int add);
+void vrrp_exec_reap(struct vrrp *vrrp);
+void vrrp_exec_next(struct vrrp *vrrp, const struct vrrp_net *vnet);
+struct vrrp *vrrp_exec_worker(void);
+int vrrp_exec_abort(struct vrrp *vrrp);
+int vrrp_exec_pending(const struct vrrp *vrrp);
 int vrrp_exec_init(struct vrrp *vrrp);
 void vrrp_exec_cleanup(struct vrrp *vrrp);
 
@@ -0,0 +1,269 @@
+/*
+ * vrrp_flood.c - invalid pkt flood protection
+ *
+ * Copyright (C) 2017 Arnaud Andre 
+ *
+ * This file is part of uvrrpd.
+ *
+ * uvrrpd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * uvrrpd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with uvrrpd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Each invalid pkt costs a checksum and a log line. Sources of
+ * invalid pkt are tracked by instance with a token bucket: while it
+ * has tokens, an invalid pkt is logged; once empty, pkt are only
+ * counted and summarized each second, and the source is dropped by
+ * the socket filter for VRRP_FLOOD_BLOCK seconds. A source which sent
+ * a valid adv recently is never blocked, so that a spoofer can't get
+ * the current master filtered out.
+ */
+
+#include <string.h>
+
+#include "vrrp.h"
+#include "vrrp_net.h"
+#include "vrrp_bpf.h"
+#include "vrrp_flood.h"
+#include "common.h"
+#include "log.h"
+
+#define NSEC		1000000000ULL
+#define TOKEN		1000
+
+/**
+ * vrrp_flood_find() - find entry of a source
+ * @create: recycle an entry if source isn't tracked
+ *
+ * A free entry is used first, then the least recently seen one,
+ * blocked sources are never recycled.
+ *
+ * @return entry, NULL if none
+ */
+static struct vrrp_flood_src *vrrp_flood_find(struct vrrp_net *vnet,
+					      union vrrp_ipx_addr *addr,
+					      int create)
+{
+	struct vrrp_flood_src *src, *old = NULL;
+	int i;
+
+	for (i = 0; i < VRRP_FLOOD_SRC; ++i) {
+		src = &vnet->flood.src[i];
+
+		if (!src->used) {
+			if ((old == NULL) || old->used)
+				old = src;
+			continue;
+		}
+
+		if (vnet->ipx_cmp(&src->addr, addr) == 0)
+			return src;
+
+		if (src->blocked != 0)
+			continue;
+
+		if ((old == NULL) || (old->used && (src->seen < old->seen)))
+			old = src;
+	}
+
+	if (!create || (old == NULL))
+		return NULL;
+
+	memset(old, 0, sizeof(struct vrrp_flood_src));
+	old->addr = *addr;
+	old->tokens = VRRP_FLOOD_BURST * TOKEN;
+	old->used = TRUE;
+
+	return old;
+}
+
+/**
+ * vrrp_flood_refill() - add tokens earned since last pkt of source
+ */
+static void vrrp_flood_refill(struct vrrp_flood_src *src, uint64_t now)
+{
+	uint64_t tokens, elapsed;
+
+	if (src->seen != 0) {
+		/* time to fill the bucket at most, product can't overflow */
+		elapsed = now - src->seen;
+		if (elapsed > VRRP_FLOOD_BURST * NSEC / VRRP_FLOOD_RATE)
+			elapsed = VRRP_FLOOD_BURST * NSEC / VRRP_FLOOD_RATE;
+
+		tokens = src->tokens + elapsed * VRRP_FLOOD_RATE
+		    * TOKEN / NSEC;
+		src->tokens = (tokens > VRRP_FLOOD_BURST * TOKEN) ?
+		    VRRP_FLOOD_BURST * TOKEN : tokens;
+	}
+
+	src->seen = now;
+}
+
+/**
+ * vrrp_flood_timer() - summarize pkt dropped in the last second,
+ *                      unblock sources whose block ended
+ */
+static void vrrp_flood_timer(struct vrrp_timer *timer, void *data)
+{
+	struct vrrp_net *vnet = data;
+	struct vrrp_flood_src *src;
+	char straddr[INET6_ADDRSTRLEN];
+	uint64_t now = vrrp_stats_now();
+	int i, r, rearm = FALSE, unblock = FALSE;
+
+	for (i = 0; i < VRRP_FLOOD_SRC; ++i) {
+		src = &vnet->flood.src[i];
+		if (!src->used)
+			continue;
+
+		for (r = 0; r < VRRP_INVALID_MAX; ++r) {
+			if (src->dropped[r] == 0)
+				continue;
+
+			log_warning("vrid %d :: %u pkt from %s dropped for %s "
+				    "in the last second", vnet->vrid,
+				    src->dropped[r],
+				    vnet->ipx_to_str(&src->addr, straddr),
+				    vrrp_stats_invalid_str[r]);
+			src->dropped[r] = 0;
+			rearm = TRUE;
+		}
+
+		if (src->blocked == 0)
+			continue;
+
+		if (now < src->blocked) {
+			rearm = TRUE;
+			continue;
+		}
+
+		log_notice("vrid %d :: %s unblocked", vnet->vrid,
+			   vnet->ipx_to_str(&src->addr, straddr));
+		src->blocked = 0;
+		vnet->flood.nblocked--;
+		unblock = TRUE;
+	}
+
+	if (unblock && (vnet->sock != NULL))
+		vrrp_bpf_attach(vnet->sock);
+
+	if (rearm)
+		vrrp_timer_set(timer, 1, 0);
+}
+
+/**
+ * vrrp_flood_init() - no source tracked
+ */
+void vrrp_flood_init(struct vrrp_net *vnet)
+{
+	memset(&vnet->flood, 0, sizeof(struct vrrp_flood));
+	vrrp_timer_init(&vnet->flood.timer, vrrp_flood_timer, vnet);
+}
+
+/**
+ * vrrp_flood_blocked() - source is blocked, its pkt were queued
+ *                        before the socket filter was updated
+ *
+ * @return TRUE if pkt must be dropped, FALSE else
+ */
+int vrrp_flood_blocked(struct vrrp_net *vnet, union vrrp_ipx_addr *addr)
+{
+	struct vrrp_flood_src *src;
+
+	if (vnet->flood.nblocked == 0)
+		return FALSE;
+
+	src = vrrp_flood_find(vnet, addr, FALSE);
+	if ((src == NULL) || (src->blocked == 0))
+		return FALSE;
+
+	src->dropped[VRRP_INVALID_FLOOD]++;
+
+	return TRUE;
+}
+
+/**
+ * vrrp_flood_invalid() - account an invalid pkt of a source
+ *
+ * Pkt is logged if source has a token left. Else, it is counted for
+ * next summary, and source is blocked unless it's a live peer.
+ *
+ * @return TRUE if caller may log details of pkt, FALSE else
+ */
+int vrrp_flood_invalid(struct vrrp_net *vnet, union vrrp_ipx_addr *addr,
+		       enum vrrp_stats_invalid reason)
+{
+	struct vrrp_flood_src *src;
+	char straddr[INET6_ADDRSTRLEN];
+	uint64_t now = vrrp_stats_now();
+
+	src = vrrp_flood_find(vnet, addr, TRUE);
+	if (src == NULL)
+		return FALSE;
+
+	vrrp_flood_refill(src, now);
+
+	if (src->tokens >= TOKEN) {
+		src->tokens -= TOKEN;
+		log_warning("vrid %d :: invalid pkt from %s (%s), ignore it",
+			    vnet->vrid, vnet->ipx_to_str(addr, straddr),
+			    vrrp_stats_invalid_str[reason]);
+		return TRUE;
+	}
+
+	src->dropped[reason]++;
+
+	if (!vrrp_timer_is_running(&vnet->flood.timer))
+		vrrp_timer_set(&vnet->flood.timer, 1, 0);
+
+	if ((src->blocked != 0)
+	    || ((src->valid != 0) && (now - src->valid < VRRP_FLOOD_BLOCK * NSEC)))
+		return FALSE;
+
+	log_warning("vrid %d :: %s floods invalid pkt, block it for %ds",
+		    vnet->vrid, vnet->ipx_to_str(addr, straddr),
+		    VRRP_FLOOD_BLOCK);
+
+	src->blocked = now + VRRP_FLOOD_BLOCK * NSEC;
+	vnet->flood.nblocked++;
+
+	if (vnet->sock != NULL)
+		vrrp_bpf_attach(vnet->sock);
+
+	return FALSE;
+}
+
+/**
+ * vrrp_flood_valid() - source sent a valid adv, never block it
+ *                      for the next VRRP_FLOOD_BLOCK seconds
+ */
+void vrrp_flood_valid(struct vrrp_net *vnet, union vrrp_ipx_addr *addr)
+{
+	struct vrrp_flood_src *src;
+	uint64_t now = vrrp_stats_now();
+
+	src = vrrp_flood_find(vnet, addr, TRUE);
+	if (src == NULL)
+		return;
+
+	vrrp_flood_refill(src, now);
+	src->valid = now;
+}
+
+/**
+ * vrrp_flood_cleanup() - stop summary timer
+ */
+void vrrp_flood_cleanup(struct vrrp_net *vnet)
+{
+	vrrp_timer_clear(&vnet->flood.timer);
+	vnet->flood.nblocked = 0;
+}
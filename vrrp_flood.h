@@ -0,0 +1,82 @@
+/*
+ * vrrp_flood.h - invalid pkt flood protection
+ *
+ * Copyright (C) 2017 Arnaud Andre 
+ *
+ * This file is part of uvrrpd.
+ *
+ * uvrrpd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * uvrrpd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with uvrrpd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _VRRP_FLOOD_H_
+#define _VRRP_FLOOD_H_
+
+#include <stdint.h>
+
+#include "vrrp_ipx.h"
+#include "vrrp_stats.h"
+#include "vrrp_timer.h"
+
+/* from vrrp_net.h */
+struct vrrp_net;
+
+/* sources tracked by instance, least recently seen is recycled */
+#define VRRP_FLOOD_SRC		16
+
+/* token bucket of each source: invalid pkt/s logged, and burst */
+#define VRRP_FLOOD_RATE		10
+#define VRRP_FLOOD_BURST	20
+
+/* a source which empties its bucket is dropped by the socket filter
+ * for VRRP_FLOOD_BLOCK s, unless it sent a valid adv meanwhile */
+#define VRRP_FLOOD_BLOCK	10
+
+/**
+ * struct vrrp_flood_src - source of invalid pkt
+ * @tokens: in 1/1000 of pkt
+ * @seen: last pkt, ns
+ * @valid: last valid adv, ns, 0 if none
+ * @blocked: end of block, ns, 0 if not blocked
+ * @dropped: pkt not logged by reason, since last summary
+ */
+struct vrrp_flood_src {
+	union vrrp_ipx_addr addr;
+	uint32_t tokens;
+	uint64_t seen;
+	uint64_t valid;
+	uint64_t blocked;
+	uint32_t dropped[VRRP_INVALID_MAX];
+	int used;
+};
+
+/**
+ * struct vrrp_flood - sources of invalid pkt of a VRRP instance
+ * @timer: summary of dropped pkt and end of blocks, each second
+ *         while a source is rate limited or blocked
+ */
+struct vrrp_flood {
+	struct vrrp_flood_src src[VRRP_FLOOD_SRC];
+	int nblocked;
+	struct vrrp_timer timer;
+};
+
+void vrrp_flood_init(struct vrrp_net *vnet);
+int vrrp_flood_blocked(struct vrrp_net *vnet, union vrrp_ipx_addr *addr);
+int vrrp_flood_invalid(struct vrrp_net *vnet, union vrrp_ipx_addr *addr,
+		       enum vrrp_stats_invalid reason);
+void vrrp_flood_valid(struct vrrp_net *vnet, union vrrp_ipx_addr *addr);
+void vrrp_flood_cleanup(struct vrrp_net *vnet);
+
+#endif /* _VRRP_FLOOD_H_ */
@@ -39,6 +39,7 @@
 #include "vrrp_ipx.h"
 #include "vrrp_net.h"
 #include "vrrp_adv.h"
+#include "vrrp_csum.h"
 #include "log.h"
 #include "common.h"
 
@@ -55,31 +56,13 @@ struct pshdr_ip4 {
 	uint16_t len;
 };
 
-/**
- * vrrp_ip4_search_vip() - search one vip in vip list
- * if vip is found
- * 	set found = 1
- * 	_vip_ptr point to vip in vnet->vip_list
- */
-#define vrrp_ip4_search_vip(vnet, _vip_ptr, _addr, found) \
-    do { \
-        if (_addr != NULL) \
-        list_for_each_entry_reverse(_vip_ptr, &vnet->vip_list, iplist) { \
-            if ( _vip_ptr->ip_addr.s_addr == *_addr) {\
-                found = 1; \
-                break; \
-            } \
-        } \
-    } while(0)
-
-
 /**
  * vrrp_ip4_mgroup() - join IPv4 VRRP multicast group
  */
 static int vrrp_ip4_mgroup(struct vrrp_net *vnet)
 {
 	/* Join VRRP multicast group */
-	struct ip_mreq group = { {0}, {0} };
+	struct ip_mreqn group = { {0}, {0}, 0 };
 	struct in_addr group_addr = { 0 };
 
 	if (inet_pton(AF_INET, VRRP_MGROUP4, &group_addr) < 0) {
@@ -87,11 +70,11 @@ static int vrrp_ip4_mgroup(struct vrrp_net *vnet)
 		return -1;
 	}
 	group.imr_multiaddr.s_addr = group_addr.s_addr;
-	group.imr_interface.s_addr = vnet->vif.ip_addr.s_addr;
+	group.imr_ifindex = vnet->vif.ifindex;
 
 	if (setsockopt
 	    (vnet->socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &group,
-	     sizeof(struct ip_mreq)) < 0) {
+	     sizeof(struct ip_mreqn)) < 0) {
 		log_error("vrid %d :: setsockopt - %m", vnet->vrid);
 		return -1;
 	}
@@ -103,6 +86,8 @@ static int vrrp_ip4_mgroup(struct vrrp_net *vnet)
  * vrrp_ip4_cmp() - Compare VIP list between received vrrpkt and our instance
  * Return 0 if the list is the same,
  * the number of different VIP else
+ *
+ * Silent, caller logs the mismatch if the source isn't rate limited
  */
 static int vrrp_ip4_viplist_cmp(struct vrrp_net *vnet, struct vrrphdr *vrrpkt)
 {
@@ -110,24 +95,21 @@ static int vrrp_ip4_viplist_cmp(struct vrrp_net *vnet, struct vrrphdr *vrrpkt)
 	uint32_t *vip_addr =
 	    (uint32_t *) ((unsigned char *) vrrpkt + VRRP_PKTHDR_SIZE);
 
+	/* our own adv pkt, VIPs in the same order */
+	const unsigned char *adv = vnet->__adv[2].iov_base;
+
 	uint32_t naddr = 0;
 	int ndiff = 0;
 
+	if ((adv != NULL)
+	    && (memcmp(vip_addr, adv + VRRP_PKTHDR_SIZE,
+		       vnet->naddr * sizeof(uint32_t)) == 0))
+		return 0;
+
 	for (naddr = 0; naddr < vnet->naddr; ++naddr) {
-		/* vip in vrrpkt */
-		in_addr_t *addr = vip_addr + naddr;
-
-		/* search in vrrp_ip list */
-		struct vrrp_ip *vip_ptr = NULL;
-		int found = 0;
-		vrrp_ip4_search_vip(vnet, vip_ptr, addr, found);
-
-		if (!found) {
-			log_warning
-			    ("vrid %d :: Invalid pkt - Virtual IP address unexpected",
-			     vnet->vrid);
+		/* vip in vrrpkt, search in vipset */
+		if (!vrrp_net_vip_find(vnet, vip_addr + naddr))
 			++ndiff;
-		}
 	}
 	return ndiff;
 }
@@ -135,14 +117,13 @@ static int vrrp_ip4_viplist_cmp(struct vrrp_net *vnet, struct vrrphdr *vrrpkt)
 /**
  * vrrp_ip4_recv() - Fill vrrp_l3 header from received pkt
  */
-static int vrrp_ip4_recv(int sock_fd, struct vrrp_recv *recv,
-			 unsigned char *buf, ssize_t buf_size, int *payload_pos)
+static int vrrp_ip4_recv(struct msghdr *msg, ssize_t len,
+			 struct vrrp_recv *recv, int *payload_pos)
 {
-	ssize_t len;
-	struct iphdr *ip;
+	struct iphdr *ip = (struct iphdr *) msg->msg_iov->iov_base;
 
-	len = read(sock_fd, buf, buf_size);
-	ip = (struct iphdr *) buf;
+	if (len < (ssize_t) sizeof(struct iphdr))
+		return -1;
 
 	recv->header.len = ip->ihl << 2;
 	recv->header.proto = ip->protocol;
@@ -170,17 +151,24 @@ static int vrrp_ip4_getsize(const struct vrrp_net *vnet)
 
 /**
  * vrrp_ip4_chksum() - compute vrrp adv chksum 
+ * @len: size of vrrp adv, which may count another number of VIPs
+ *       than the local instance if received
  */
 static uint16_t vrrp_ip4_chksum(const struct vrrp_net *vnet,
-				struct vrrphdr *pkt,
+				struct vrrphdr *pkt, size_t len,
 				union vrrp_ipx_addr *ipx_saddr,
 				union vrrp_ipx_addr *ipx_daddr)
 {
 	/* reset chksum */
 	pkt->chksum = 0;
 
+	struct iovec iov = {
+		.iov_base = pkt,
+		.iov_len = len
+	};
+
 	if ((pkt->version_type >> 4) == RFC3768)
-		return cksum((unsigned short *) pkt, vrrp_ip4_getsize(vnet));
+		return vrrp_csum(NULL, 0, &iov, 1);
 
 	if ((pkt->version_type >> 4) == RFC5798) {
 		const struct iovec *iov_iph = &vnet->__adv[1];
@@ -203,18 +191,9 @@ static uint16_t vrrp_ip4_chksum(const struct vrrp_net *vnet,
 		psh.daddr = (daddr ? daddr : iph->daddr);
 		psh.zero = 0;
 		psh.protocol = iph->protocol;
-		psh.len = htons(vrrp_ip4_getsize(vnet));
-
-		uint32_t psh_size =
-		    sizeof(struct pshdr_ip4) + vrrp_ip4_getsize(vnet);
-
-		unsigned short buf[psh_size / sizeof(short)];
-
-		memcpy(buf, &psh, sizeof(struct pshdr_ip4));
-		memcpy(buf + sizeof(struct pshdr_ip4) / sizeof(short), pkt,
-		       vrrp_ip4_getsize(vnet));
+		psh.len = htons(len);
 
-		return cksum(buf, psh_size);
+		return vrrp_csum(&psh, sizeof(struct pshdr_ip4), &iov, 1);
 	}
 
 	return 0;
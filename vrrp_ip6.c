@@ -35,10 +35,10 @@
 #include <net/if.h>
 #include <sys/types.h>
 #include <ifaddrs.h>
-#include <netdb.h>	/* NI_MAXHOST */
 
 #include "vrrp_ipx.h"
 #include "vrrp_net.h"
+#include "vrrp_csum.h"
 #include "log.h"
 #include "common.h"
 
@@ -56,22 +56,6 @@ struct pshdr_ip6 {
 	uint8_t next_header;
 };
 
-/**
- * vrrp_ip6_search_vip() - search one vip in vip list
- * if vip is found
- * 	set found = 1
- * 	_vip_ptr point to vip in vnet->vip_list
- */
-#define vrrp_ip6_search_vip(vnet, _vip_ptr, _addr, found) \
-    do { \
-        list_for_each_entry_reverse(_vip_ptr, &vnet->vip_list, iplist) { \
-	    if (memcmp(&(_vip_ptr->ip_addr6), _addr, sizeof(struct in6_addr)) == 0) { \
-		found = 1; \
-                break; \
-	    }\
-        } \
-    } while(0)
-
 /**
  * vrrp_ip6_setsockopt() - Set socket option
  * used to find ancillary data in recvmsg()
@@ -114,7 +98,7 @@ static int vrrp_ip6_mgroup(struct vrrp_net *vnet)
 
 	memcpy(&group.ipv6mr_multiaddr, &group_addr, sizeof(struct in6_addr));
 
-	group.ipv6mr_interface = if_nametoindex(vnet->vif.ifname);
+	group.ipv6mr_interface = vnet->vif.ifindex;
 
 	if (setsockopt
 	    (vnet->socket, IPPROTO_IPV6, IPV6_ADD_MEMBERSHIP, &group,
@@ -130,34 +114,32 @@ static int vrrp_ip6_mgroup(struct vrrp_net *vnet)
  * vrrp_ip6_cmp() - Compare VIP list between received vrrpkt and our instance
  * Return 0 if the list is the same,
  * the number of differente VIP else
+ *
+ * Silent, caller logs the mismatch if the source isn't rate limited
  */
 static int vrrp_ip6_viplist_cmp(struct vrrp_net *vnet, struct vrrphdr *vrrpkt)
 {
 	uint32_t *vip_addr =
 	    (uint32_t *) ((unsigned char *) vrrpkt + VRRP_PKTHDR_SIZE);
 
+	/* our own adv pkt, VIPs in the same order */
+	const unsigned char *adv = vnet->__adv[2].iov_base;
+
 	uint32_t pos = 0;
 	int naddr = 0;
 	int ndiff = 0;
 
+	if ((adv != NULL)
+	    && (memcmp(vip_addr, adv + VRRP_PKTHDR_SIZE,
+		       vnet->naddr * sizeof(struct in6_addr)) == 0))
+		return 0;
+
 	while (naddr < vnet->naddr) {
-		/* vip in vrrpkt */
+		/* vip in vrrpkt, search in vipset */
 		struct in6_addr *vip = (struct in6_addr *) (vip_addr + pos);
 
-		/* search in vrrp_ip list */
-		struct vrrp_ip *vip_ptr = NULL;
-		int found = 0;
-
-		vrrp_ip6_search_vip(vnet, vip_ptr, vip->s6_addr, found);
-
-		if (!found) {
-			char host[NI_MAXHOST];
-			log_warning
-			    ("vrid %d :: Invalid pkt - Virtual IPv6 address unexpected %s",
-			     vnet->vrid, inet_ntop(vnet->family, vip, host,
-						   sizeof(host)));
+		if (!vrrp_net_vip_find(vnet, vip))
 			++ndiff;
-		}
 		pos += 4;
 		++naddr;
 	}
@@ -186,40 +168,22 @@ static inline void *find_ancillary(struct msghdr *msg, int cmsg_type)
 /** 
  * vrrp_ip6_recv() - Fill vrrp_ipx_header from received pkt
  */
-static int vrrp_ip6_recv(int sock_fd, struct vrrp_recv *recv,
-			 unsigned char *buf, ssize_t buf_size, int *payload_pos)
+static int vrrp_ip6_recv(struct msghdr *msg, ssize_t len,
+			 struct vrrp_recv *recv, int *payload_pos)
 {
-	ssize_t len;
-
 	/* IPv6 raw sockets return no IP header. We must query
 	 * src/dest via socket options/ancillary data */
-	struct msghdr msg;
-	struct sockaddr_in6 src;
-	struct iovec iov;
-	uint8_t ancillary[64];
-
-	msg.msg_name = &src;
-	msg.msg_namelen = sizeof(src);
-	iov.iov_base = buf;
-	iov.iov_len = buf_size;
-	msg.msg_iov = &iov;
-	msg.msg_iovlen = 1;
-	msg.msg_control = ancillary;
-	msg.msg_controllen = sizeof(ancillary);
-	msg.msg_flags = 0;
-
-	len = recvmsg(sock_fd, &msg, 0);
-
-	if (len < 0) {
-		log_error("recvmsg - %m");
-		return -1;
-	}
+	struct sockaddr_in6 *src = (struct sockaddr_in6 *) msg->msg_name;
+
+	/* buf is directly filled with VRRP adv
+	 * no need to skip IPv6 header */
+	*payload_pos = 0;
 
 	/* src address */
-	memcpy(&recv->ip_saddr6, &src.sin6_addr, sizeof(struct in6_addr));
+	memcpy(&recv->ip_saddr6, &src->sin6_addr, sizeof(struct in6_addr));
 
 	/* hoplimit */
-	uint8_t *opt = find_ancillary(&msg, IPV6_HOPLIMIT);
+	uint8_t *opt = find_ancillary(msg, IPV6_HOPLIMIT);
 	if (opt == NULL) {
 		log_error("recvmsg - unknown hop limit");
 		return -1;
@@ -228,7 +192,7 @@ static int vrrp_ip6_recv(int sock_fd, struct vrrp_recv *recv,
 	recv->header.ttl = *(int *) opt;
 
 	/* dst address */
-	opt = find_ancillary(&msg, IPV6_PKTINFO);
+	opt = find_ancillary(msg, IPV6_PKTINFO);
 	if (opt == NULL) {
 		log_error("recvmsg - unknown dst address");
 		return -1;
@@ -245,10 +209,6 @@ static int vrrp_ip6_recv(int sock_fd, struct vrrp_recv *recv,
 	 * But we have set IPPROTO_VRRP in vrrp_net_socket() */
 	recv->header.proto = IPPROTO_VRRP;
 
-	/* buf is directly filled with VRRP adv
-	 * no need to skip IPv6 header */
-	*payload_pos = 0;
-
 	return len;
 }
 
@@ -262,9 +222,11 @@ static int vrrp_ip6_getsize(const struct vrrp_net *vnet)
 
 /**
  * vrrp_ip6_chksum() - compute VRRP adv chksum
+ * @len: size of VRRP adv, which may count another number of VIPs
+ *       than the local instance if received
  */
 uint16_t vrrp_ip6_chksum(const struct vrrp_net *vnet, struct vrrphdr *pkt,
-			 union vrrp_ipx_addr *ipx_saddr,
+			 size_t len, union vrrp_ipx_addr *ipx_saddr,
 			 union vrrp_ipx_addr *ipx_daddr)
 {
 	/* reset chksum */
@@ -293,16 +255,14 @@ uint16_t vrrp_ip6_chksum(const struct vrrp_net *vnet, struct vrrphdr *pkt,
 
 	bzero(&psh.zeros, sizeof(psh.zeros));
 	psh.next_header = IPPROTO_VRRP;
-	psh.len = htons(vrrp_ip6_getsize(vnet));
+	psh.len = htons(len);
 
-	uint32_t psh_size = sizeof(struct pshdr_ip6) + vrrp_ip6_getsize(vnet);
-	unsigned short buf[psh_size / sizeof(short)];
-
-	memcpy(buf, &psh, sizeof(struct pshdr_ip6));
-	memcpy(buf + sizeof(struct pshdr_ip6) / sizeof(short), pkt,
-	       vrrp_ip6_getsize(vnet));
+	struct iovec iov = {
+		.iov_base = pkt,
+		.iov_len = len
+	};
 
-	return cksum(buf, psh_size);
+	return vrrp_csum(&psh, sizeof(struct pshdr_ip6), &iov, 1);
 }
 
 /**
@@ -27,6 +27,7 @@
 struct vrrp_net;
 struct vrrphdr;
 struct vrrp_recv;
+struct msghdr;
 
 /**
  * struct vrrp_ipx_header - IPvX header informations from received adv pkt
@@ -64,9 +65,10 @@ struct vrrp_ipx {
 	/* cmp() - Compare two IPvX address */
 	int (*cmp) (union vrrp_ipx_addr *, union vrrp_ipx_addr *);
 
-	/* recv() - Read received pkt and fetch/store information
-	 *          in struct vrrp_recv */
-	int (*recv) (int, struct vrrp_recv *, unsigned char *, ssize_t, int *);
+	/* recv() - Fetch information of a pkt read by recvmmsg()
+	 *          and store them in struct vrrp_recv, position of
+	 *          VRRP adv is set as soon as known, even on failure */
+	int (*recv) (struct msghdr *, ssize_t, struct vrrp_recv *, int *);
 
 	/* getsize() - get size of IPvX VRRP advertisement pkt */
 	int (*getsize) (const struct vrrp_net *);
@@ -74,9 +76,9 @@ struct vrrp_ipx {
 	/* viplist_cmp() - compare VRRP Virtual IPvX list */
 	int (*viplist_cmp) (struct vrrp_net *, struct vrrphdr *);
 
-	/* chksum() - compute IPvX checksum while building
-	 * 	      advertisement packet */
-	uint16_t(*chksum) (const struct vrrp_net *, struct vrrphdr *,
+	/* chksum() - compute IPvX checksum of an advertisement packet
+	 * 	      of given size, built or received */
+	uint16_t(*chksum) (const struct vrrp_net *, struct vrrphdr *, size_t,
 			    union vrrp_ipx_addr *, union vrrp_ipx_addr *);
 
 	/* ipx_ntop() - call ntop() on IPvX addr */
@@ -0,0 +1,571 @@
+/*
+ * vrrp_loop.c - event loop, wait for events and dispatch them
+ *               to VRRP instances
+ *
+ * Copyright (C) 2017 Arnaud Andre 
+ *
+ * This file is part of uvrrpd.
+ *
+ * uvrrpd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * uvrrpd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with uvrrpd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+
+#include "vrrp.h"
+#include "vrrp_loop.h"
+#include "vrrp_net.h"
+#include "vrrp_nl.h"
+#include "vrrp_adv.h"
+#include "vrrp_ctrl.h"
+#include "vrrp_ctrl_sock.h"
+#include "vrrp_exec.h"
+#include "vrrp_timer.h"
+#include "vrrp_worker.h"
+
+#include "uvrrpd.h"
+#include "bits.h"
+#include "list.h"
+#include "log.h"
+
+extern unsigned long reg;
+
+/**
+ * vrrp_loop_handler - fd registered in event loop
+ */
+struct vrrp_loop_handler {
+	int fd;
+	vrrp_loop_cb cb;
+	void *data;
+	struct list_head list;
+};
+
+static LIST_HEAD(vrrp_loop_handlers);
+
+/* handlers unregistered while dispatching, freed after the batch */
+static LIST_HEAD(vrrp_loop_zombies);
+
+/* epoll instance */
+static int vrrp_epfd = -1;
+
+/* max events returned by a single epoll_wait() */
+#define VRRP_LOOP_MAXEVENTS 64
+
+/* instances table */
+static struct list_head *vrrp_instances = NULL;
+
+/**
+ * vrrp_loop_find() - find handler of a registered fd
+ */
+static struct vrrp_loop_handler *vrrp_loop_find(int fd)
+{
+	struct vrrp_loop_handler *h;
+
+	list_for_each_entry(h, &vrrp_loop_handlers, list) {
+		if (h->fd == fd)
+			return h;
+	}
+
+	return NULL;
+}
+
+/**
+ * vrrp_loop_wheel() - timer wheel deadline reached
+ */
+static void vrrp_loop_wheel(__attribute__ ((unused)) int fd,
+			    __attribute__ ((unused)) void *data)
+{
+	vrrp_timer_wheel_run();
+}
+
+/**
+ * vrrp_loop_netlink() - rtnetlink msg received
+ */
+static void vrrp_loop_netlink(__attribute__ ((unused)) int fd,
+			      __attribute__ ((unused)) void *data)
+{
+	vrrp_nl_read();
+}
+
+/**
+ * vrrp_loop_init() - create epoll instance and timer wheel
+ */
+int vrrp_loop_init(void)
+{
+	int fd;
+
+	vrrp_epfd = epoll_create1(EPOLL_CLOEXEC);
+
+	if (vrrp_epfd == -1) {
+		log_error("epoll_create1 - %m");
+		return -1;
+	}
+
+	/* timers */
+	fd = vrrp_timer_wheel_init();
+	if ((fd == -1) || (vrrp_loop_add(fd, vrrp_loop_wheel, NULL) != 0))
+		return -1;
+
+	/* interfaces cache, opened while reading instances options */
+	fd = vrrp_nl_fd();
+	if (fd == -1)
+		return 0;
+
+	return vrrp_loop_add(fd, vrrp_loop_netlink, NULL);
+}
+
+/**
+ * vrrp_loop_add() - register a fd in event loop
+ */
+int vrrp_loop_add(int fd, vrrp_loop_cb cb, void *data)
+{
+	struct vrrp_loop_handler *h;
+	struct epoll_event ev;
+
+	h = malloc(sizeof(struct vrrp_loop_handler));
+	if (h == NULL) {
+		log_error("malloc - %m");
+		return -1;
+	}
+
+	h->fd = fd;
+	h->cb = cb;
+	h->data = data;
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = h;
+
+	if (epoll_ctl(vrrp_epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+		log_error("epoll_ctl - %m");
+		free(h);
+		return -1;
+	}
+
+	list_add_tail(&h->list, &vrrp_loop_handlers);
+
+	return 0;
+}
+
+/**
+ * vrrp_loop_mod() - change events a registered fd is polled for,
+ *                   EPOLLIN or EPOLLOUT
+ */
+int vrrp_loop_mod(int fd, uint32_t events)
+{
+	struct vrrp_loop_handler *h = vrrp_loop_find(fd);
+	struct epoll_event ev;
+
+	if (h == NULL)
+		return -1;
+
+	ev.events = events;
+	ev.data.ptr = h;
+
+	if (epoll_ctl(vrrp_epfd, EPOLL_CTL_MOD, fd, &ev) == -1) {
+		log_error("epoll_ctl - %m");
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * vrrp_loop_del() - unregister a fd
+ *
+ * Pending events of the current epoll_wait() may still refer to its
+ * handler, it is only freed once the batch is dispatched.
+ */
+void vrrp_loop_del(int fd)
+{
+	struct vrrp_loop_handler *h = vrrp_loop_find(fd);
+
+	if (h == NULL)
+		return;
+
+	epoll_ctl(vrrp_epfd, EPOLL_CTL_DEL, fd, NULL);
+	list_del(&h->list);
+
+	h->fd = -1;
+	list_add_tail(&h->list, &vrrp_loop_zombies);
+}
+
+/**
+ * vrrp_loop_reap() - free handlers unregistered during last batch
+ */
+static void vrrp_loop_reap(void)
+{
+	struct vrrp_loop_handler *h, *n;
+
+	list_for_each_entry_safe(h, n, &vrrp_loop_zombies, list) {
+		list_del(&h->list);
+		free(h);
+	}
+}
+
+/**
+ * vrrp_loop_dispatch() - feed an event to a VRRP instance
+ */
+void vrrp_loop_dispatch(struct vrrp_instance *inst, vrrp_event_t event)
+{
+	struct vrrp *vrrp = &inst->vrrp;
+
+	vrrp_process(vrrp, &inst->vnet, event);
+
+	/* reload event, restart instance from init state */
+	if ((vrrp->state == INIT) && test_bit(KEEP_GOING, &reg))
+		vrrp_state_init(vrrp, &inst->vnet);
+}
+
+/**
+ * vrrp_loop_broadcast() - forward daemon control bits set by a signal
+ *                         or a control cmd to all instances
+ */
+static void vrrp_loop_broadcast(void)
+{
+	struct vrrp_instance *inst;
+	int reload, dump;
+
+	reload = test_and_clear_bit(UVRRPD_RELOAD, &reg);
+	dump = test_and_clear_bit(UVRRPD_DUMP, &reg);
+
+	if (!reload && !dump)
+		return;
+
+	list_for_each_entry(inst, vrrp_instances, list) {
+		if (reload)
+			set_bit(UVRRPD_RELOAD, &inst->vrrp.reg);
+		if (dump)
+			set_bit(UVRRPD_DUMP, &inst->vrrp.reg);
+
+		vrrp_loop_dispatch(inst, SIGNAL);
+	}
+}
+
+/**
+ * vrrp_loop_socket() - pkt received on a listen socket
+ *
+ * Pkt of a batch are checked from the latest to the oldest, only the
+ * latest valid advertisement of each instance is fed to its state
+ * machine, older pkt of this instance are ignored.
+ */
+static void vrrp_loop_socket(__attribute__ ((unused)) int fd, void *data)
+{
+	struct vrrp_socket *sock = data;
+	struct vrrp_net *valid[VRRP_RECV_BATCH];
+	struct vrrp_instance *inst;
+	struct vrrp_net *vnet;
+	vrrp_event_t event;
+	int i, j, n, nvalid = 0;
+
+	n = vrrp_net_read(sock);
+
+	for (i = n - 1; i >= 0; --i) {
+		vnet = sock->rx[i].vnet;
+		if (vnet == NULL)
+			continue;
+
+		for (j = 0; (j < nvalid) && (valid[j] != vnet); ++j);
+		if (j < nvalid)
+			continue;
+
+		inst = container_of(vnet, struct vrrp_instance, vnet);
+
+		/* check if received is valid or not */
+		event = vrrp_net_recv(vnet, &inst->vrrp, &sock->rx[i]);
+		if (event == PKT)
+			valid[nvalid++] = vnet;
+		else
+			vrrp_loop_dispatch(inst, event);
+	}
+
+	for (j = nvalid - 1; j >= 0; --j) {
+		inst = container_of(valid[j], struct vrrp_instance, vnet);
+		vrrp_loop_dispatch(inst, PKT);
+		vrrp_net_invalidate_buffer(valid[j]);
+	}
+}
+
+/**
+ * vrrp_loop_ctrl() - msg received on control fifo
+ */
+static void vrrp_loop_ctrl(__attribute__ ((unused)) int fd, void *data)
+{
+	struct vrrp_instance *inst = data;
+
+	vrrp_loop_dispatch(inst, vrrp_ctrl_read(&inst->vrrp, &inst->vnet));
+}
+
+/**
+ * vrrp_loop_timer() - Advertisement timer or Masterdown timer expired
+ */
+static void vrrp_loop_timer(__attribute__ ((unused)) struct vrrp_timer *vt,
+			    void *data)
+{
+	struct vrrp_instance *inst = data;
+
+	/* daemon is stopping, only hook timers matter */
+	if (!test_bit(KEEP_GOING, &reg))
+		return;
+
+	log_debug("vrid %d :: timer expired", inst->vrrp.vrid);
+	vrrp_loop_dispatch(inst, TIMER);
+}
+
+/**
+ * vrrp_loop_hook_end() - report hook script termination to an
+ *                        instance, run its next queued script
+ */
+static void vrrp_loop_hook_end(struct vrrp_instance *inst)
+{
+	vrrp_loop_dispatch(inst, HOOK);
+	vrrp_exec_next(&inst->vrrp, &inst->vnet);
+}
+
+/**
+ * vrrp_loop_hook_done() - hook script spawned by uvrrpd terminated
+ */
+static void vrrp_loop_hook_done(__attribute__ ((unused)) int fd, void *data)
+{
+	struct vrrp_instance *inst = data;
+
+	vrrp_exec_reap(&inst->vrrp);
+	vrrp_loop_hook_end(inst);
+}
+
+/**
+ * vrrp_loop_worker() - hook scripts spawned by hook worker terminated
+ */
+static void vrrp_loop_worker(int fd, __attribute__ ((unused)) void *data)
+{
+	struct vrrp_instance *inst;
+	struct vrrp *vrrp;
+
+	while ((vrrp = vrrp_exec_worker()) != NULL) {
+		inst = container_of(vrrp, struct vrrp_instance, vrrp);
+		vrrp_loop_hook_end(inst);
+	}
+
+	if (vrrp_worker_fd() != -1)
+		return;
+
+	/* worker is gone, uvrrpd spawns next scripts itself */
+	vrrp_loop_del(fd);
+
+	list_for_each_entry(inst, vrrp_instances, list) {
+		if (vrrp_exec_abort(&inst->vrrp))
+			vrrp_loop_hook_end(inst);
+	}
+}
+
+/**
+ * vrrp_loop_hooks() - hook scripts still running or queued
+ */
+static int vrrp_loop_hooks(void)
+{
+	struct vrrp_instance *inst;
+
+	list_for_each_entry(inst, vrrp_instances, list) {
+		if (vrrp_exec_pending(&inst->vrrp))
+			return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * vrrp_loop_hook() - register pidfd of a running hook script
+ */
+int vrrp_loop_hook(struct vrrp *vrrp, int pidfd)
+{
+	struct vrrp_instance *inst =
+	    container_of(vrrp, struct vrrp_instance, vrrp);
+
+	return vrrp_loop_add(pidfd, vrrp_loop_hook_done, inst);
+}
+
+/**
+ * vrrp_loop_vif() - VRRP interface changed
+ */
+static void vrrp_loop_vif(struct vrrp_if *vif, int changes, void *data)
+{
+	struct vrrp_instance *inst = data;
+	struct vrrp_net *vnet = &inst->vnet;
+	char straddr[INET6_ADDRSTRLEN];
+
+	if (changes & VRRP_IF_LINK)
+		log_notice("vrid %d :: %s link %s", vnet->vrid, vif->ifname,
+			   vif->up ? "up" : "down");
+
+	if (changes & VRRP_IF_MTU)
+		log_notice("vrid %d :: %s mtu %d", vnet->vrid, vif->ifname,
+			   vif->mtu);
+
+	if (changes & VRRP_IF_INDEX) {
+		log_notice("vrid %d :: %s ifindex %d", vnet->vrid, vif->ifname,
+			   vif->ifindex);
+		vrrp_net_socket_rebind(vnet);
+	}
+
+	if (changes & VRRP_IF_ADDR) {
+		union vrrp_ipx_addr none;
+
+		memset(&none, 0, sizeof(none));
+
+		/* keep advertising from the last address until a new
+		 * primary address is found */
+		if (memcmp(&vif->ipx, &none, sizeof(none)) == 0) {
+			log_notice("vrid %d :: %s primary address removed",
+				   vnet->vrid, vif->ifname);
+			return;
+		}
+
+		log_notice("vrid %d :: %s primary address %s", vnet->vrid,
+			   vif->ifname, vnet->ipx_to_str(&vif->ipx, straddr));
+
+		/* rebuild advertisement in place with the new source
+		 * address, size is unchanged */
+		if (vrrp_adv_init(vnet, &inst->vrrp) != 0)
+			log_error("vrid %d :: can't rebuild advertisement",
+				  vnet->vrid);
+	}
+}
+
+/**
+ * vrrp_loop_register() - register control fifo, timers and
+ *                        listen socket of a VRRP instance
+ */
+int vrrp_loop_register(struct vrrp_instance *inst)
+{
+	struct vrrp *vrrp = &inst->vrrp;
+	struct vrrp_net *vnet = &inst->vnet;
+
+	if (vrrp_loop_add(vrrp->ctrl.fd, vrrp_loop_ctrl, inst) != 0)
+		return -1;
+
+	/* timers */
+	vrrp_timer_init(&vrrp->adv_timer, vrrp_loop_timer, inst);
+	vrrp_timer_init(&vrrp->masterdown_timer, vrrp_loop_timer, inst);
+
+	/* interface changes */
+	vnet->vif.cb = vrrp_loop_vif;
+	vnet->vif.data = inst;
+
+	/* listen socket may be shared with another instance */
+	if (vrrp_loop_find(vnet->sock->fd) != NULL)
+		return 0;
+
+	return vrrp_loop_add(vnet->sock->fd, vrrp_loop_socket, vnet->sock);
+}
+
+/**
+ * vrrp_loop_run() - Wait for events (VRRP pkt, msg on fifo, timer
+ *                   expiration, signal ...) and dispatch them to
+ *                   instances until daemon is stopped
+ */
+int vrrp_loop_run(struct list_head *instances)
+{
+	struct vrrp_instance *inst;
+	struct vrrp_loop_handler *h;
+	struct epoll_event events[VRRP_LOOP_MAXEVENTS];
+	int i, n;
+
+	vrrp_instances = instances;
+
+	/* hook worker socketpair */
+	n = vrrp_worker_fd();
+	if ((n != -1) && (vrrp_loop_add(n, vrrp_loop_worker, NULL) != 0))
+		vrrp_worker_cleanup();
+
+	set_bit(KEEP_GOING, &reg);
+
+	/* init state */
+	list_for_each_entry(inst, instances, list)
+	    vrrp_state_init(&inst->vrrp, &inst->vnet);
+
+	while (test_bit(KEEP_GOING, &reg)) {
+
+		/* Wait for packet, timer expiration or signal */
+		n = epoll_wait(vrrp_epfd, events, VRRP_LOOP_MAXEVENTS, -1);
+		if (n < 0) {
+			if (errno != EINTR) {
+				log_error("epoll_wait - %m");
+				return -1;
+			}
+			continue;
+		}
+
+		for (i = 0; i < n; ++i) {
+			h = events[i].data.ptr;
+			if (h->fd != -1)
+				h->cb(h->fd, h->data);
+		}
+
+		vrrp_loop_reap();
+		vrrp_loop_broadcast();
+
+		/* idle, send queued logs and state transitions */
+		log_flush();
+		vrrp_ctrl_sock_flush();
+	}
+
+	/* last hook scripts, e.g. backup on exit */
+	while (vrrp_loop_hooks()) {
+		n = epoll_wait(vrrp_epfd, events, VRRP_LOOP_MAXEVENTS, -1);
+		if (n < 0) {
+			if (errno != EINTR) {
+				log_error("epoll_wait - %m");
+				return -1;
+			}
+			continue;
+		}
+
+		for (i = 0; i < n; ++i) {
+			h = events[i].data.ptr;
+			if ((h->fd != -1)
+			    && ((h->cb == vrrp_loop_hook_done)
+				|| (h->cb == vrrp_loop_worker)
+				|| (h->cb == vrrp_loop_wheel)))
+				h->cb(h->fd, h->data);
+		}
+
+		vrrp_loop_reap();
+		log_flush();
+		vrrp_ctrl_sock_flush();
+	}
+
+	return 0;
+}
+
+/**
+ * vrrp_loop_cleanup()
+ */
+void vrrp_loop_cleanup(void)
+{
+	struct vrrp_loop_handler *h, *n;
+
+	list_for_each_entry_safe(h, n, &vrrp_loop_handlers, list) {
+		list_del(&h->list);
+		free(h);
+	}
+
+	vrrp_loop_reap();
+	vrrp_timer_wheel_cleanup();
+
+	if (vrrp_epfd != -1)
+		close(vrrp_epfd);
+
+	vrrp_epfd = -1;
+}
@@ -0,0 +1,50 @@
+/*
+ * vrrp_loop.h - event loop
+ *
+ * Copyright (C) 2017 Arnaud Andre 
+ *
+ * This file is part of uvrrpd.
+ *
+ * uvrrpd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * uvrrpd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with uvrrpd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _VRRP_LOOP_H_
+#define _VRRP_LOOP_H_
+
+#include <stdint.h>
+
+#include "list.h"
+
+/* from vrrp.h */
+struct vrrp;
+struct vrrp_instance;
+typedef enum _vrrp_event_type vrrp_event_t;
+
+/**
+ * vrrp_loop_cb - callback run when a registered fd is readable, or
+ *                writable if polled for EPOLLOUT
+ */
+typedef void (*vrrp_loop_cb) (int fd, void *data);
+
+int vrrp_loop_init(void);
+int vrrp_loop_add(int fd, vrrp_loop_cb cb, void *data);
+int vrrp_loop_mod(int fd, uint32_t events);
+void vrrp_loop_del(int fd);
+int vrrp_loop_register(struct vrrp_instance *inst);
+int vrrp_loop_hook(struct vrrp *vrrp, int pidfd);
+void vrrp_loop_dispatch(struct vrrp_instance *inst, vrrp_event_t event);
+int vrrp_loop_run(struct list_head *instances);
+void vrrp_loop_cleanup(void);
+
+#endif /* _VRRP_LOOP_H_ */
@@ -0,0 +1,668 @@
+/*
+ * vrrp_metrics.c - OpenMetrics exporter, served from the event loop
+ *
+ * Copyright (C) 2017 Arnaud Andre 
+ *
+ * This file is part of uvrrpd.
+ *
+ * uvrrpd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * uvrrpd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with uvrrpd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "vrrp.h"
+#include "vrrp_loop.h"
+#include "vrrp_buf.h"
+#include "vrrp_metrics.h"
+#include "common.h"
+#include "log.h"
+
+#define VRRP_METRICS_TYPE \
+	"application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+/* request line and headers, read at once */
+#define VRRP_METRICS_REQ_MAX	4096
+
+/* initial size of response body */
+#define VRRP_METRICS_BUFSIZE	4096
+
+/**
+ * vrrp_metrics_inst - instance and its statistics during a scrape
+ */
+struct vrrp_metrics_inst {
+	const struct vrrp_instance *inst;
+	struct vrrp_stats snap;
+	char labels[IFNAMSIZ + 64];
+};
+
+static int vrrp_metrics_sock = -1;
+static char *vrrp_metrics_path = NULL;
+static struct list_head *vrrp_metrics_instances = NULL;
+
+/**
+ * vrrp_metrics_client - connected client
+ * @out: rest of response not sent yet, NULL while reading request
+ * @off: bytes of @out already sent
+ */
+struct vrrp_metrics_client {
+	int fd;
+	char *out;
+	size_t len;
+	size_t off;
+};
+
+/* connected clients, oldest first */
+static struct vrrp_metrics_client vrrp_metrics_clients[VRRP_METRICS_CLIENTS];
+static int vrrp_metrics_nclients = 0;
+
+/* response body, kept between scrapes */
+static struct vrrp_buf vrrp_metrics_body;
+static struct vrrp_metrics_inst *vrrp_metrics_snap = NULL;
+static int vrrp_metrics_nsnap = 0;
+
+/**
+ * vrrp_metrics_printf() - append to response body
+ */
+#define vrrp_metrics_printf(...) \
+	vrrp_buf_printf(&vrrp_metrics_body, __VA_ARGS__)
+
+/**
+ * vrrp_metrics_family() - metric family header
+ */
+static void vrrp_metrics_family(const char *name, const char *type,
+				const char *help)
+{
+	vrrp_metrics_printf("# TYPE %s %s\n# HELP %s %s\n", name, type, name,
+			    help);
+}
+
+/**
+ * vrrp_metrics_counter() - counter family, one sample per instance
+ * @offset: offset of counter in struct vrrp_stats
+ */
+static void vrrp_metrics_counter(int n, const char *name, const char *help,
+				 size_t offset)
+{
+	const struct vrrp_metrics_inst *m;
+	int i;
+
+	vrrp_metrics_family(name, "counter", help);
+
+	for (i = 0; i < n; ++i) {
+		m = &vrrp_metrics_snap[i];
+		vrrp_metrics_printf("%s_total{%s} %" PRIu64 "\n", name,
+				    m->labels,
+				    *(const uint64_t *) ((const char *) &m->snap
+							 + offset));
+	}
+}
+
+/**
+ * vrrp_metrics_seconds() - print ns as seconds
+ */
+static void vrrp_metrics_seconds(uint64_t ns)
+{
+	vrrp_metrics_printf("%" PRIu64 ".%09" PRIu64 "\n", ns / 1000000000,
+			    ns % 1000000000);
+}
+
+/**
+ * vrrp_metrics_hist_sample() - samples of a histogram, in seconds
+ * @labels: labels of the histogram
+ * @bounds: upper bounds of buckets, ns
+ */
+static void vrrp_metrics_hist_sample(const char *name, const char *labels,
+				     const struct vrrp_stats_hist *hist,
+				     const uint64_t *bounds)
+{
+	uint64_t count = 0;
+	int b;
+
+	for (b = 0; b < VRRP_STATS_BUCKETS; ++b) {
+		count += hist->bucket[b];
+		vrrp_metrics_printf("%s_bucket{%s,le=\"%g\"} %" PRIu64 "\n",
+				    name, labels, bounds[b] / 1e9, count);
+	}
+
+	count += hist->bucket[VRRP_STATS_BUCKETS];
+	vrrp_metrics_printf("%s_bucket{%s,le=\"+Inf\"} %" PRIu64 "\n", name,
+			    labels, count);
+	vrrp_metrics_printf("%s_count{%s} %" PRIu64 "\n", name, labels, count);
+	vrrp_metrics_printf("%s_sum{%s} ", name, labels);
+	vrrp_metrics_seconds(hist->sum);
+}
+
+/**
+ * vrrp_metrics_hist() - histogram family, one histogram per instance
+ * @offset: offset of struct vrrp_stats_hist in struct vrrp_stats
+ */
+static void vrrp_metrics_hist(int n, const char *name, const char *help,
+			      size_t offset)
+{
+	const struct vrrp_metrics_inst *m;
+	int i;
+
+	vrrp_metrics_family(name, "histogram", help);
+
+	for (i = 0; i < n; ++i) {
+		m = &vrrp_metrics_snap[i];
+		vrrp_metrics_hist_sample(name, m->labels,
+					 (const struct vrrp_stats_hist *)
+					 ((const char *) &m->snap + offset),
+					 vrrp_stats_bounds);
+	}
+}
+
+/**
+ * vrrp_metrics_timeline() - histograms of failover steps, one per
+ *                           instance and step
+ */
+static void vrrp_metrics_timeline(int n)
+{
+	const char *name = "uvrrpd_failover_step_seconds";
+	const struct vrrp_metrics_inst *m;
+	char labels[sizeof(m->labels) + 32];
+	int i, step;
+
+	vrrp_metrics_family(name, "histogram",
+			    "Delay of each step of transition to master "
+			    "after its trigger");
+
+	for (i = 0; i < n; ++i) {
+		m = &vrrp_metrics_snap[i];
+		for (step = VRRP_TL_TRIGGER + 1; step < VRRP_TL_MAX; ++step) {
+			snprintf(labels, sizeof(labels), "%s,step=\"%s\"",
+				 m->labels, vrrp_timeline_steps[step]);
+			vrrp_metrics_hist_sample(name, labels,
+						 &m->inst->vrrp.timeline.
+						 hist[step - 1],
+						 vrrp_timeline_bounds);
+		}
+	}
+}
+
+/**
+ * vrrp_metrics_snapshot() - snapshot statistics of all instances
+ *
+ * @return count of instances, -1 on error
+ */
+static int vrrp_metrics_snapshot(void)
+{
+	const struct vrrp_instance *inst;
+	struct vrrp_metrics_inst *m;
+	int n = 0;
+
+	list_for_each_entry(inst, vrrp_metrics_instances, list) {
+		if (n == vrrp_metrics_nsnap) {
+			m = realloc(vrrp_metrics_snap,
+				    (n + 8) * sizeof(struct vrrp_metrics_inst));
+			if (m == NULL) {
+				log_error("metrics :: realloc - %m");
+				return -1;
+			}
+
+			vrrp_metrics_snap = m;
+			vrrp_metrics_nsnap = n + 8;
+		}
+
+		m = &vrrp_metrics_snap[n++];
+		m->inst = inst;
+		vrrp_stats_snapshot(inst->vnet.stats, &m->snap);
+		snprintf(m->labels, sizeof(m->labels),
+			 "vrid=\"%d\",interface=\"%s\",family=\"%s\"",
+			 inst->vrrp.vrid, inst->vnet.vif.ifname,
+			 (inst->vnet.family == AF_INET6 ? "inet6" : "inet"));
+	}
+
+	return n;
+}
+
+/**
+ * vrrp_metrics_render() - render metrics of all instances in
+ *                         response body
+ *
+ * @return 0 if success, -1 else
+ */
+static int vrrp_metrics_render(void)
+{
+	static const uint8_t none[16] = { 0 };
+	const struct vrrp_metrics_inst *m;
+	char straddr[INET6_ADDRSTRLEN];
+	struct timespec ts;
+	uint64_t now, ns;
+	int i, n, s, r;
+
+	vrrp_buf_reset(&vrrp_metrics_body);
+
+	n = vrrp_metrics_snapshot();
+	if (n < 0)
+		return -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	now = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+
+	vrrp_metrics_family("uvrrpd_state", "stateset",
+			    "Current state of VRRP instance");
+	for (i = 0; i < n; ++i) {
+		m = &vrrp_metrics_snap[i];
+		for (s = INIT; s <= MASTER; ++s)
+			vrrp_metrics_printf("uvrrpd_state{%s,uvrrpd_state=\"%s\"}"
+					    " %d\n", m->labels, STR_STATE(s),
+					    (m->snap.state == (uint32_t) s));
+	}
+
+	vrrp_metrics_family("uvrrpd_state_seconds", "counter",
+			    "Time spent in each state");
+	for (i = 0; i < n; ++i) {
+		m = &vrrp_metrics_snap[i];
+		for (s = INIT; s <= MASTER; ++s) {
+			ns = m->snap.state_time[s];
+			if (m->snap.state == (uint32_t) s)
+				ns += now - m->snap.state_since;
+
+			vrrp_metrics_printf("uvrrpd_state_seconds_total"
+					    "{%s,state=\"%s\"} ", m->labels,
+					    STR_STATE(s));
+			vrrp_metrics_seconds(ns);
+		}
+	}
+
+	vrrp_metrics_family("uvrrpd_priority", "gauge",
+			    "Priority of VRRP instance");
+	for (i = 0; i < n; ++i) {
+		m = &vrrp_metrics_snap[i];
+		vrrp_metrics_printf("uvrrpd_priority{%s} %d\n", m->labels,
+				    m->inst->vrrp.priority);
+	}
+
+	vrrp_metrics_family("uvrrpd_master", "info",
+			    "Last master seen by VRRP instance");
+	for (i = 0; i < n; ++i) {
+		m = &vrrp_metrics_snap[i];
+		if (memcmp(m->snap.master, none, sizeof(none)) == 0)
+			continue;
+
+		if (inet_ntop(m->snap.family, m->snap.master, straddr,
+			      sizeof(straddr)) == NULL)
+			continue;
+
+		vrrp_metrics_printf("uvrrpd_master_info{%s,address=\"%s\"} 1\n",
+				    m->labels, straddr);
+	}
+
+	vrrp_metrics_counter(n, "uvrrpd_transitions", "State transitions",
+			     offsetof(struct vrrp_stats, transitions));
+	vrrp_metrics_counter(n, "uvrrpd_adverts_sent", "Advertisements sent",
+			     offsetof(struct vrrp_stats, adv_sent));
+	vrrp_metrics_counter(n, "uvrrpd_adverts_received",
+			     "Valid advertisements received",
+			     offsetof(struct vrrp_stats, adv_recv));
+
+	vrrp_metrics_family("uvrrpd_adverts_invalid", "counter",
+			    "Invalid advertisements received, by reason");
+	for (i = 0; i < n; ++i) {
+		m = &vrrp_metrics_snap[i];
+		for (r = 0; r < VRRP_INVALID_MAX; ++r)
+			vrrp_metrics_printf("uvrrpd_adverts_invalid_total"
+					    "{%s,reason=\"%s\"} %" PRIu64 "\n",
+					    m->labels, vrrp_stats_invalid_str[r],
+					    m->snap.invalid[r]);
+	}
+
+	vrrp_metrics_hist(n, "uvrrpd_advert_interval_seconds",
+			  "Inter-arrival time of valid advertisements",
+			  offsetof(struct vrrp_stats, adv_interval));
+	vrrp_metrics_hist(n, "uvrrpd_failover_seconds",
+			  "Time from last advertisement of lost master to "
+			  "transition to master",
+			  offsetof(struct vrrp_stats, failover));
+	vrrp_metrics_timeline(n);
+
+	vrrp_metrics_family("uvrrpd_log_dropped", "counter",
+			    "Log messages dropped, log ring full");
+	vrrp_metrics_printf("uvrrpd_log_dropped_total %lu\n", log_dropped());
+
+	vrrp_metrics_printf("# EOF\n");
+
+	return (vrrp_metrics_body.err ? -1 : 0);
+}
+
+/**
+ * vrrp_metrics_reply() - send HTTP response to request req
+ *
+ * Response is sent without blocking, what doesn't fit in socket buffer
+ * is kept by client and sent from the event loop once socket is
+ * writable (see vrrp_metrics_flush()).
+ *
+ * @return 0 if response is sent, 1 if pending, -1 on error
+ */
+static int vrrp_metrics_reply(struct vrrp_metrics_client *c, const char *req)
+{
+	const char *status = "200 OK";
+	char header[256];
+	struct iovec iov[2];
+	struct msghdr msg = { 0 };
+	size_t total, skip;
+	ssize_t n;
+
+	vrrp_buf_reset(&vrrp_metrics_body);
+
+	if (strncmp(req, "GET ", 4) != 0)
+		status = "405 Method Not Allowed";
+	else if ((strncmp(req + 4, "/metrics", 8) != 0)
+		 || ((req[12] != ' ') && (req[12] != '?')))
+		status = "404 Not Found";
+	else if (vrrp_metrics_render() != 0) {
+		status = "500 Internal Server Error";
+		vrrp_buf_reset(&vrrp_metrics_body);
+	}
+
+	iov[0].iov_base = header;
+	iov[0].iov_len = snprintf(header, sizeof(header),
+				  "HTTP/1.1 %s\r\n"
+				  "Content-Type: " VRRP_METRICS_TYPE "\r\n"
+				  "Content-Length: %zu\r\n"
+				  "Connection: close\r\n\r\n",
+				  status, vrrp_metrics_body.len);
+	iov[1].iov_base = vrrp_metrics_body.data;
+	iov[1].iov_len = vrrp_metrics_body.len;
+
+	total = iov[0].iov_len + iov[1].iov_len;
+
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+
+	n = sendmsg(c->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+	if (n < 0) {
+		if ((errno != EAGAIN) && (errno != EINTR)) {
+			log_error("metrics :: sendmsg - %m");
+			return -1;
+		}
+		n = 0;
+	}
+
+	if ((size_t) n == total)
+		return 0;
+
+	/* keep the rest, body is overwritten by the next scrape */
+	c->out = malloc(total - n);
+	if (c->out == NULL) {
+		log_error("metrics :: malloc - %m");
+		return -1;
+	}
+
+	c->len = 0;
+	c->off = 0;
+
+	if ((size_t) n < iov[0].iov_len) {
+		memcpy(c->out, header + n, iov[0].iov_len - n);
+		c->len = iov[0].iov_len - n;
+		skip = 0;
+	}
+	else
+		skip = n - iov[0].iov_len;
+
+	memcpy(c->out + c->len, vrrp_metrics_body.data + skip,
+	       vrrp_metrics_body.len - skip);
+	c->len += vrrp_metrics_body.len - skip;
+
+	if (vrrp_loop_mod(c->fd, EPOLLOUT) != 0)
+		return -1;
+
+	return 1;
+}
+
+/**
+ * vrrp_metrics_flush() - send the rest of a response, socket is
+ *                        writable
+ *
+ * @return 0 if response is sent, 1 if pending, -1 on error
+ */
+static int vrrp_metrics_flush(struct vrrp_metrics_client *c)
+{
+	ssize_t n;
+
+	n = send(c->fd, c->out + c->off, c->len - c->off,
+		 MSG_DONTWAIT | MSG_NOSIGNAL);
+	if (n < 0) {
+		if ((errno == EAGAIN) || (errno == EINTR))
+			return 1;
+
+		log_error("metrics :: send - %m");
+		return -1;
+	}
+
+	c->off += n;
+
+	return (c->off < c->len);
+}
+
+/**
+ * vrrp_metrics_find() - find a connected client
+ */
+static struct vrrp_metrics_client *vrrp_metrics_find(int fd)
+{
+	int i;
+
+	for (i = 0; i < vrrp_metrics_nclients; ++i) {
+		if (vrrp_metrics_clients[i].fd == fd)
+			return &vrrp_metrics_clients[i];
+	}
+
+	return NULL;
+}
+
+/**
+ * vrrp_metrics_close() - disconnect a client
+ */
+static void vrrp_metrics_close(int fd)
+{
+	struct vrrp_metrics_client *c = vrrp_metrics_find(fd);
+	int i;
+
+	if (c == NULL)
+		return;
+
+	free(c->out);
+
+	i = c - vrrp_metrics_clients;
+	memmove(c, c + 1, (--vrrp_metrics_nclients - i)
+		* sizeof(struct vrrp_metrics_client));
+
+	vrrp_loop_del(fd);
+	close(fd);
+}
+
+/**
+ * vrrp_metrics_client() - request received from a client, reply and
+ *                         disconnect it once response is sent
+ */
+static void vrrp_metrics_client(int fd, __attribute__ ((unused)) void *data)
+{
+	struct vrrp_metrics_client *c = vrrp_metrics_find(fd);
+	char req[VRRP_METRICS_REQ_MAX];
+	ssize_t n;
+
+	if (c == NULL)
+		return;
+
+	/* socket is writable, response pending */
+	if (c->out != NULL) {
+		if (vrrp_metrics_flush(c) != 1)
+			vrrp_metrics_close(fd);
+		return;
+	}
+
+	n = recv(fd, req, sizeof(req) - 1, MSG_DONTWAIT);
+	if ((n < 0) && ((errno == EAGAIN) || (errno == EINTR)))
+		return;
+
+	if (n > 0) {
+		req[n] = '\0';
+		if (vrrp_metrics_reply(c, req) == 1)
+			return;
+	}
+
+	vrrp_metrics_close(fd);
+}
+
+/**
+ * vrrp_metrics_accept() - new client on listen socket
+ */
+static void vrrp_metrics_accept(int fd, __attribute__ ((unused)) void *data)
+{
+	int cfd;
+
+	cfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (cfd == -1) {
+		if ((errno != EAGAIN) && (errno != EINTR))
+			log_error("metrics :: accept4 - %m");
+		return;
+	}
+
+	/* too many clients, drop the oldest one */
+	if (vrrp_metrics_nclients == VRRP_METRICS_CLIENTS)
+		vrrp_metrics_close(vrrp_metrics_clients[0].fd);
+
+	if (vrrp_loop_add(cfd, vrrp_metrics_client, NULL) != 0) {
+		close(cfd);
+		return;
+	}
+
+	vrrp_metrics_clients[vrrp_metrics_nclients].fd = cfd;
+	vrrp_metrics_clients[vrrp_metrics_nclients].out = NULL;
+	++vrrp_metrics_nclients;
+}
+
+/**
+ * vrrp_metrics_init() - open metrics listen socket and register it
+ *                       in event loop
+ * @addr: path of a UNIX socket, or TCP port on loopback
+ */
+int vrrp_metrics_init(const char *addr, struct list_head *instances)
+{
+	struct sockaddr_un sun = { 0 };
+	struct sockaddr_in sin = { 0 };
+	struct sockaddr *sa;
+	socklen_t salen;
+	unsigned long port;
+	int on = 1;
+
+	if (addr[0] == '/') {
+		if (strlen(addr) >= sizeof(sun.sun_path)) {
+			log_error("metrics :: socket path too long %s", addr);
+			return -1;
+		}
+
+		sun.sun_family = AF_UNIX;
+		strcpy(sun.sun_path, addr);
+		sa = (struct sockaddr *) &sun;
+		salen = sizeof(sun);
+	}
+	else {
+		if ((mystrtoul(&port, addr, 65535) != 0) || (port == 0)) {
+			log_error("metrics :: invalid port %s", addr);
+			return -1;
+		}
+
+		sin.sin_family = AF_INET;
+		sin.sin_port = htons(port);
+		sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		sa = (struct sockaddr *) &sin;
+		salen = sizeof(sin);
+	}
+
+	vrrp_metrics_sock = socket(sa->sa_family,
+				   SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+				   0);
+	if (vrrp_metrics_sock == -1) {
+		log_error("metrics :: socket - %m");
+		return -1;
+	}
+
+	if (sa->sa_family == AF_UNIX) {
+		unlink(addr);
+		vrrp_metrics_path = strdup(addr);
+	}
+	else
+		setsockopt(vrrp_metrics_sock, SOL_SOCKET, SO_REUSEADDR, &on,
+			   sizeof(on));
+
+	if (bind(vrrp_metrics_sock, sa, salen) != 0) {
+		log_error("metrics :: bind %s - %m", addr);
+		goto err;
+	}
+
+	if (listen(vrrp_metrics_sock, VRRP_METRICS_CLIENTS) != 0) {
+		log_error("metrics :: listen - %m");
+		goto err;
+	}
+
+	if (vrrp_buf_init(&vrrp_metrics_body, VRRP_METRICS_BUFSIZE) != 0)
+		goto err;
+
+	vrrp_metrics_instances = instances;
+
+	if (vrrp_loop_add(vrrp_metrics_sock, vrrp_metrics_accept, NULL) != 0)
+		goto err;
+
+	log_info("metrics :: listening on %s", addr);
+
+	return 0;
+
+ err:
+	vrrp_metrics_cleanup();
+	return -1;
+}
+
+/**
+ * vrrp_metrics_cleanup() - close metrics sockets
+ */
+void vrrp_metrics_cleanup(void)
+{
+	while (vrrp_metrics_nclients > 0) {
+		--vrrp_metrics_nclients;
+		close(vrrp_metrics_clients[vrrp_metrics_nclients].fd);
+		free(vrrp_metrics_clients[vrrp_metrics_nclients].out);
+	}
+
+	if (vrrp_metrics_sock != -1)
+		close(vrrp_metrics_sock);
+	vrrp_metrics_sock = -1;
+
+	if (vrrp_metrics_path != NULL) {
+		unlink(vrrp_metrics_path);
+		free(vrrp_metrics_path);
+	}
+	vrrp_metrics_path = NULL;
+
+	vrrp_buf_cleanup(&vrrp_metrics_body);
+
+	free(vrrp_metrics_snap);
+	vrrp_metrics_snap = NULL;
+	vrrp_metrics_nsnap = 0;
+}
@@ -0,0 +1,34 @@
+/*
+ * vrrp_metrics.h - OpenMetrics exporter
+ *
+ * Copyright (C) 2017 Arnaud Andre 
+ *
+ * This file is part of uvrrpd.
+ *
+ * uvrrpd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * uvrrpd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with uvrrpd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _VRRP_METRICS_H_
+#define _VRRP_METRICS_H_
+
+#include "list.h"
+
+/* max clients served at the same time, oldest one is dropped */
+#define VRRP_METRICS_CLIENTS	8
+
+int vrrp_metrics_init(const char *addr, struct list_head *instances);
+void vrrp_metrics_cleanup(void);
+
+#endif /* _VRRP_METRICS_H_ */
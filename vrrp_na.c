@@ -34,6 +34,7 @@
 #include "log.h"
 #include "vrrp.h"
 #include "vrrp_net.h"
+#include "vrrp_csum.h"
 
 #define IN6ADDR_MCAST "ff02::1"
 
@@ -67,17 +68,12 @@ struct pshdr_ip6 {
 /**
  * vrrp_na_eth_build()
  */
-static int vrrp_na_eth_build(struct iovec *iov, const uint8_t vrid)
+static int vrrp_na_eth_build(struct iovec *iov, void *buf, const uint8_t vrid)
 {
-	iov->iov_base = malloc(sizeof(struct ether_header));
+	iov->iov_base = buf;
 
 	struct ether_header *hdr = iov->iov_base;
 
-	if (hdr == NULL) {
-		log_error("vrid %d :: malloc - %m", vrid);
-		return -1;
-	}
-
 	memcpy(hdr, &vrrp_na_eth, sizeof(struct ether_header));
 
 	hdr->ether_shost[5] = vrid;
@@ -91,18 +87,13 @@ static int vrrp_na_eth_build(struct iovec *iov, const uint8_t vrid)
 /**
  * vrrp_na_ip6_build()
  */
-static int vrrp_na_ip6_build(struct iovec *iov, struct vrrp_ip *ip,
+static int vrrp_na_ip6_build(struct iovec *iov, void *buf, struct vrrp_ip *ip,
 			     const struct vrrp_net *vnet)
 {
-	iov->iov_base = malloc(sizeof(struct ip6_hdr));
+	iov->iov_base = buf;
 
 	struct ip6_hdr *ip6h = iov->iov_base;
 
-	if (ip6h == NULL) {
-		log_error("vrid %d :: malloc - %m", vnet->vrid);
-		return -1;
-	}
-
 	ip6h->ip6_flow = htonl((6 << 28) | (0 << 20) | 0);
 	ip6h->ip6_plen = htons(sizeof(struct nd_neighbor_advert));
 	ip6h->ip6_nxt = IPPROTO_ICMPV6;
@@ -146,32 +137,23 @@ uint16_t vrrp_na_chksum(struct iovec * iov, struct nd_neighbor_advert * na)
 	psh.next_header = IPPROTO_ICMPV6;
 	psh.len = htons(sizeof(struct nd_neighbor_advert));
 
-	uint32_t psh_size =
-	    sizeof(struct pshdr_ip6) + sizeof(struct nd_neighbor_advert);
-	unsigned short buf[psh_size / sizeof(short)];
-
-	memcpy(buf, &psh, sizeof(struct pshdr_ip6));
-	memcpy(buf + sizeof(struct pshdr_ip6) / sizeof(short), na,
-	       sizeof(struct nd_neighbor_advert));
+	struct iovec iov_na = {
+		.iov_base = na,
+		.iov_len = sizeof(struct nd_neighbor_advert)
+	};
 
-	return cksum(buf, psh_size);
+	return vrrp_csum(&psh, sizeof(struct pshdr_ip6), &iov_na, 1);
 }
 
 /**
  * vrrp_na_build()
  */
-static int vrrp_na_build(struct iovec *iov, struct vrrp_ip *ip,
-			 const struct vrrp_net *vnet)
+static int vrrp_na_build(struct iovec *iov, void *buf, struct vrrp_ip *ip)
 {
-	iov->iov_base = malloc(sizeof(struct nd_neighbor_advert));
+	iov->iov_base = buf;
 
 	struct nd_neighbor_advert *na = iov->iov_base;
 
-	if (na == NULL) {
-		log_error("vrid %d :: malloc - %m", vnet->vrid);
-		return -1;
-	}
-
 	na->nd_na_hdr.icmp6_type = ND_NEIGHBOR_ADVERT;
 	na->nd_na_hdr.icmp6_code = 0;
 	na->nd_na_hdr.icmp6_cksum = 0;
@@ -191,15 +173,8 @@ static int vrrp_na_build(struct iovec *iov, struct vrrp_ip *ip,
  */
 int vrrp_na_send(struct vrrp_net *vnet)
 {
-	struct vrrp_ip *vip_ptr = NULL;
-
-	/* we have to send one na by vip */
-	list_for_each_entry_reverse(vip_ptr, &vnet->vip_list, iplist) {
-		vrrp_net_send(vnet, vip_ptr->__topology,
-			      ARRAY_SIZE(vip_ptr->__topology));
-	}
-
-	return 0;
+	/* one na pkt by vip, in a single burst */
+	return vrrp_net_send_topology(vnet);
 }
 
 /**
@@ -207,16 +182,33 @@ int vrrp_na_send(struct vrrp_net *vnet)
  */
 int vrrp_na_init(struct vrrp_net *vnet)
 {
+	const size_t len = ETHDR_SIZE + sizeof(struct ip6_hdr)
+	    + sizeof(struct nd_neighbor_advert);
+	unsigned char *frame;
 	int status = -1;
 
-	/* we have to build one na pkt by vip */
+	/* we have to build one na pkt by vip, all in one arena */
 	struct vrrp_ip *vip_ptr = NULL;
 
+	if (vrrp_arena_reserve(&vnet->__topology_arena,
+			       vnet->naddr * VRRP_ARENA_FRAME(len)) != 0)
+		return -1;
+
 	list_for_each_entry_reverse(vip_ptr, &vnet->vip_list, iplist) {
-		status = vrrp_na_eth_build(&vip_ptr->__topology[0], vnet->vrid);
-		status |=
-		    vrrp_na_ip6_build(&vip_ptr->__topology[1], vip_ptr, vnet);
-		status |= vrrp_na_build(&vip_ptr->__topology[2], vip_ptr, vnet);
+		frame = vrrp_arena_frame(&vnet->__topology_arena, len);
+		if (frame == NULL)
+			return -1;
+
+		status = vrrp_na_eth_build(&vip_ptr->__topology[0], frame,
+					   vnet->vrid);
+		status |= vrrp_na_ip6_build(&vip_ptr->__topology[1],
+					    frame + ETHDR_SIZE, vip_ptr, vnet);
+		status |= vrrp_na_build(&vip_ptr->__topology[2],
+					frame + ETHDR_SIZE
+					+ sizeof(struct ip6_hdr), vip_ptr);
+
+		vip_ptr->__frame.iov_base = frame;
+		vip_ptr->__frame.iov_len = len;
 	}
 
 	return status;
@@ -228,18 +220,8 @@ int vrrp_na_init(struct vrrp_net *vnet)
  */
 void vrrp_na_cleanup(struct vrrp_net *vnet)
 {
-	/* clean na buffer for each vrrp_ip addr */
-	struct vrrp_ip *vip_ptr = NULL;
-
-	list_for_each_entry(vip_ptr, &vnet->vip_list, iplist) {
-
-		/* clean iovec */
-		for (int i = 0; i < 3; ++i) {
-			struct iovec *iov = &vip_ptr->__topology[i];
-			free(iov->iov_base);
-		}
-
-	}
+	/* na pkt of all vrrp_ip addr at once */
+	vrrp_arena_cleanup(&vnet->__topology_arena);
 }
 
 #endif /* HAVE_IP6 */
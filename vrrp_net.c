@@ -23,23 +23,23 @@
 #include <string.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <errno.h>
+#include <time.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
 #include <netinet/ip6.h>
 #include <arpa/inet.h>
-/* ifreq + ioctl */
-#include <sys/ioctl.h>
 #include <net/if.h>
 
-#include <sys/types.h>
-#include <ifaddrs.h>
-#include <netdb.h>	/* NI_MAXHOST */
-
 #include "vrrp.h"
 #include "vrrp_net.h"
 #include "vrrp_adv.h"
+#include "vrrp_bpf.h"
+#include "vrrp_ring.h"
+#include "vrrp_nl.h"
+#include "vrrp_probe.h"
 
 #include "common.h"
 #include "list.h"
@@ -49,7 +49,15 @@
 
 #define VRRP_TTL         255
 
-static inline void vrrp_net_invalidate_buffer(struct vrrp_net *vnet);
+/* listen sockets, one per interface and family */
+static LIST_HEAD(vrrp_sockets);
+
+/* xmit socket, shared by all instances */
+static int vrrp_xmit = -1;
+static int vrrp_xmit_refcnt = 0;
+
+/* use a PACKET_MMAP TX ring (option -R) */
+extern int tx_ring;
 
 /**
  * vrrp_net_init() - init struct vrrp_net of vrrp instance
@@ -57,20 +65,35 @@ static inline void vrrp_net_invalidate_buffer(struct vrrp_net *vnet);
 void vrrp_net_init(struct vrrp_net *vnet)
 {
 	vnet->vrid = 0;
+	vnet->version = 0;
 	vnet->naddr = 0;
-	vnet->socket = 0;
-	vnet->xmit = 0;
+	vnet->npeer = 0;
+	vnet->peer_family = 0;
+	vnet->socket = -1;
+	vnet->sock = NULL;
+	vnet->xmit = -1;
 	vnet->family = AF_INET;
 	vnet->ipx_helper = NULL;
 
 	/* init VRRP IPs list */
 	INIT_LIST_HEAD(&vnet->vip_list);
+	bzero((void *) &vnet->vipset, sizeof(struct vrrp_vipset));
 
 	/* init vrrp interface */
 	bzero((void *) &vnet->vif, sizeof(struct vrrp_if));
+	INIT_LIST_HEAD(&vnet->vif.list);
 
 	/* init pkt buffer */
-	bzero((void *) &vnet->__pkt, sizeof(struct vrrp_recv));
+	vnet->__pkt = NULL;
+
+	vrrp_flood_init(vnet);
+
+	/* init pkt templates */
+	bzero((void *) &vnet->__adv_arena, sizeof(struct vrrp_arena));
+	bzero((void *) &vnet->__topology_arena, sizeof(struct vrrp_arena));
+
+	vnet->stats = NULL;
+	vnet->stats_name = NULL;
 }
 
 /**
@@ -84,26 +107,140 @@ void vrrp_net_cleanup(struct vrrp_net *vnet)
 	list_for_each_entry_safe(vip_ptr, n, &vnet->vip_list, iplist)
 	    free(vip_ptr);
 
+	free(vnet->vipset.addr);
+	bzero((void *) &vnet->vipset, sizeof(struct vrrp_vipset));
+
+	vrrp_nl_vif_del(&vnet->vif);
 	free(vnet->vif.ifname);
 
-	/* close sockets */
-	close(vnet->socket);
-	close(vnet->xmit);
+	vrrp_stats_cleanup(vnet);
+	vrrp_flood_cleanup(vnet);
+
+	/* release listen socket */
+	struct vrrp_socket *sock = vnet->sock;
+
+	if (sock != NULL) {
+		sock->vnet[vnet->vrid] = NULL;
+		if (--sock->refcnt == 0) {
+			list_del(&sock->list);
+			close(sock->fd);
+			free(sock->buf);
+			free(sock);
+		}
+		else
+			vrrp_bpf_attach(sock);
+	}
+
+	/* release xmit socket */
+	if ((vnet->xmit != -1) && (--vrrp_xmit_refcnt == 0)) {
+		vrrp_ring_cleanup();
+		close(vrrp_xmit);
+		vrrp_xmit = -1;
+	}
 }
 
 /**
- * vrrp_net_socket() - create VRRP socket destined to receive VRRP pkt
+ * vrrp_net_socket_vec() - set recvmmsg() vector on socket buffer
  */
-int vrrp_net_socket(struct vrrp_net *vnet)
+static void vrrp_net_socket_vec(struct vrrp_socket *sock)
 {
+	struct vrrp_rx *rx;
+	int i;
+
+	for (i = 0; i < VRRP_RECV_BATCH; ++i) {
+		rx = &sock->rx[i];
+		rx->buf = sock->buf + i * VRRP_RECV_BUFSIZE;
+		rx->iov.iov_base = rx->buf;
+		rx->iov.iov_len = VRRP_RECV_BUFSIZE;
+
+		sock->msgs[i].msg_hdr.msg_name = &rx->src;
+		sock->msgs[i].msg_hdr.msg_iov = &rx->iov;
+		sock->msgs[i].msg_hdr.msg_iovlen = 1;
+		sock->msgs[i].msg_hdr.msg_control = rx->ancillary;
+		sock->msgs[i].msg_hdr.msg_flags = 0;
+	}
+}
+
+/**
+ * vrrp_net_socket_open() - open a listen socket on VRRP interface
+ */
+static struct vrrp_socket *vrrp_net_socket_open(struct vrrp_net *vnet)
+{
+	struct vrrp_socket *sock = calloc(1, sizeof(struct vrrp_socket));
+
+	if (sock == NULL) {
+		log_error("vrid %d :: calloc - %m", vnet->vrid);
+		return NULL;
+	}
+
+	/* batch slots are cache line aligned and sized to the largest
+	 * valid pkt, whatever the interface MTU */
+	int err = posix_memalign((void **) &sock->buf, VRRP_RECV_ALIGN,
+				 VRRP_RECV_BATCH * VRRP_RECV_BUFSIZE);
+
+	if (err != 0) {
+		errno = err;
+		log_error("vrid %d :: posix_memalign - %m", vnet->vrid);
+		free(sock);
+		return NULL;
+	}
+
+	vrrp_net_socket_vec(sock);
+
 	/* Open RAW socket */
-	vnet->socket = socket(vnet->family, SOCK_RAW, IPPROTO_VRRP);
+	sock->fd = socket(vnet->family, SOCK_RAW, IPPROTO_VRRP);
 
-	if (vnet->socket < 0) {
+	if (sock->fd < 0) {
 		log_error("vrid %d :: socket - %m", vnet->vrid);
-		return -1;
+		goto err;
+	}
+
+	/* only receive pkt from VRRP interface */
+	if (setsockopt(sock->fd, SOL_SOCKET, SO_BINDTODEVICE,
+		       vnet->vif.ifname, strlen(vnet->vif.ifname) + 1) < 0) {
+		log_error("vrid %d :: setsockopt - %m", vnet->vrid);
+		close(sock->fd);
+		goto err;
 	}
 
+	vnet->socket = sock->fd;
+
+	int status = -1;
+
+	status = vnet->set_sockopt(sock->fd, vnet->vrid);
+	status |= vnet->join_mgroup(vnet);
+
+	if (status != 0) {
+		close(sock->fd);
+		goto err;
+	}
+
+	strncpy(sock->ifname, vnet->vif.ifname, IFNAMSIZ - 1);
+	sock->ifindex = vnet->vif.ifindex;
+	sock->family = vnet->family;
+	sock->ipx_helper = vnet->ipx_helper;
+
+	list_add_tail(&sock->list, &vrrp_sockets);
+
+	return sock;
+
+ err:
+	vnet->socket = -1;
+	free(sock->buf);
+	free(sock);
+	return NULL;
+}
+
+/**
+ * vrrp_net_socket() - create VRRP socket destined to receive VRRP pkt
+ *
+ * Instances running on the same interface and family share
+ * the same socket, received pkt are demultiplexed by VRID
+ */
+int vrrp_net_socket(struct vrrp_net *vnet)
+{
+	struct vrrp_socket *sock;
+
 	vnet->ipx_helper = vrrp_ipx_set(vnet->family);
 
 	if (vnet->ipx_helper == NULL) {
@@ -111,106 +248,201 @@ int vrrp_net_socket(struct vrrp_net *vnet)
 		return -1;
 	}
 
-	int status = -1;
+	list_for_each_entry(sock, &vrrp_sockets, list) {
+		if ((sock->family == vnet->family)
+		    && (strcmp(sock->ifname, vnet->vif.ifname) == 0))
+			goto attach;
+	}
 
-	status = vnet->set_sockopt(vnet->socket, vnet->vrid);
-	status |= vnet->join_mgroup(vnet);
+	sock = vrrp_net_socket_open(vnet);
+	if (sock == NULL)
+		return -1;
+
+ attach:
+	if (sock->vnet[vnet->vrid] != NULL) {
+		log_error("vrid %d :: already running on %s", vnet->vrid,
+			  sock->ifname);
+		return -1;
+	}
+
+	sock->vnet[vnet->vrid] = vnet;
+	++sock->refcnt;
+
+	vnet->sock = sock;
+	vnet->socket = sock->fd;
+
+	/* drop pkt of other VRID in kernel, vrrp_net_recv() still
+	 * checks pkt if filter can't be attached */
+	vrrp_bpf_attach(sock);
 
-	return status;
+	return 0;
+}
+
+/**
+ * vrrp_net_socket_rebind() - VRRP interface recreated, bind listen
+ *                            socket to it and join multicast group again
+ *
+ * Done once for all instances sharing the socket
+ */
+int vrrp_net_socket_rebind(struct vrrp_net *vnet)
+{
+	struct vrrp_socket *sock = vnet->sock;
+
+	if ((sock == NULL) || (sock->ifindex == vnet->vif.ifindex))
+		return 0;
+
+	/* bound device and memberships went away with the old link */
+	if (setsockopt(sock->fd, SOL_SOCKET, SO_BINDTODEVICE,
+		       vnet->vif.ifname, strlen(vnet->vif.ifname) + 1) < 0) {
+		log_error("vrid %d :: setsockopt - %m", vnet->vrid);
+		return -1;
+	}
+
+	if (vnet->join_mgroup(vnet) != 0)
+		return -1;
+
+	sock->ifindex = vnet->vif.ifindex;
+
+	log_notice("vrid %d :: %s listen socket bound to ifindex %d",
+		   vnet->vrid, sock->ifname, sock->ifindex);
+
+	return 0;
 }
 
 /**
  * vrrp_net_socket_xmit() - open raw VRRP xmit socket
+ *
+ * A single xmit socket is shared by all instances
  */
 int vrrp_net_socket_xmit(struct vrrp_net *vnet)
 {
-	vnet->xmit = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+	if (vrrp_xmit_refcnt == 0) {
+		vrrp_xmit = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
 
-	if (vnet->xmit < 0) {
-		log_error("vrid %d :: socket xmit - %m", vnet->vrid);
-		return -1;
+		if (vrrp_xmit < 0) {
+			log_error("vrid %d :: socket xmit - %m", vnet->vrid);
+			return -1;
+		}
+
+		if (tx_ring && (vrrp_ring_init() != 0))
+			log_notice("TX ring not available, use sendmsg()");
 	}
 
+	++vrrp_xmit_refcnt;
+	vnet->xmit = vrrp_xmit;
+
 	return 0;
 }
 
 
 /**
- * vrrp_net_vif_getaddr() - get IPvX addr from a VRRP interface
+ * vrrp_net_vif_getaddr() - get ifindex, MTU, link state and primary
+ *                          IPvX addr of VRRP interface
+ *
+ * They are kept up to date by rtnetlink events (vrrp_nl.c)
  */
 int vrrp_net_vif_getaddr(struct vrrp_net *vnet)
 {
+	union vrrp_ipx_addr none = { 0 };
+	char straddr[INET6_ADDRSTRLEN];
 
-	struct ifaddrs *ifaddr, *ifa;
-	int family;
+	vnet->vif.family = vnet->family;
 
-	if (getifaddrs(&ifaddr) == -1) {
-		log_error("vrid %d :: getifaddrs - %m", vnet->vrid);
+	if (vrrp_nl_vif_add(&vnet->vif) != 0)
 		return -1;
+
+	if (memcmp(&vnet->vif.ipx, &none, sizeof(none)) == 0) {
+		log_warning("vrid %d :: no primary address on %s", vnet->vrid,
+			    vnet->vif.ifname);
+		return 0;
 	}
 
-	/* search address */
-	for (ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next) {
-		if (strcmp(ifa->ifa_name, vnet->vif.ifname) != 0)
-			continue;
+	log_debug("%s ifindex %d mtu %d %s %s", vnet->vif.ifname,
+		  vnet->vif.ifindex, vnet->vif.mtu,
+		  vnet->vif.up ? "up" : "down",
+		  inet_ntop(vnet->family, &vnet->vif.ipx, straddr,
+			    sizeof(straddr)));
 
-		if (ifa->ifa_addr == NULL)
-			continue;
+	return 0;
+}
 
-		family = ifa->ifa_addr->sa_family;
+/**
+ * vrrp_net_vip_len() - size of a VIP of vnet family
+ */
+static inline size_t vrrp_net_vip_len(const struct vrrp_net *vnet)
+{
+	return (vnet->family == AF_INET6 ? sizeof(struct in6_addr) :
+		sizeof(struct in_addr));
+}
 
-		if (family != vnet->family)
-			continue;
+/**
+ * vrrp_net_vip_hash() - slot of a VIP in vipset
+ */
+static inline uint32_t vrrp_net_vip_hash(const struct vrrp_net *vnet,
+					 const void *addr)
+{
+	uint32_t w[4] = { 0 };
 
-		if (vnet->family == AF_INET) {
-			vnet->vif.ip_addr.s_addr =
-			    ((struct sockaddr_in *) ifa->ifa_addr)->
-			    sin_addr.s_addr;
-		}
-#ifdef HAVE_IP6
-		else {	/* AF_INET6 */
-			struct sockaddr_in6 *src =
-			    (struct sockaddr_in6 *) ifa->ifa_addr;
-			memcpy(&vnet->vif.ip_addr6, &src->sin6_addr,
-			       sizeof(struct in6_addr));
-		}
-#endif /* HAVE_IP6 */
-	}
+	memcpy(w, addr, vrrp_net_vip_len(vnet));
+
+	return ((w[0] ^ w[1] ^ w[2] ^ w[3]) * 0x9e3779b1U)
+	    >> (32 - VRRP_VIPSET_BITS);
+}
 
-	freeifaddrs(ifaddr);
+/**
+ * vrrp_net_vip_find() - search a VIP of a received adv pkt in vipset
+ *
+ * @return 1 if found, 0 otherwise
+ */
+int vrrp_net_vip_find(const struct vrrp_net *vnet, const void *addr)
+{
+	const struct vrrp_vipset *set = &vnet->vipset;
+	uint32_t h = vrrp_net_vip_hash(vnet, addr);
+	size_t len = vrrp_net_vip_len(vnet);
 
-	vrrp_net_vif_mtu(vnet);
+	for (; set->slot[h] != 0; h = (h + 1) & (VRRP_VIPSET_SIZE - 1)) {
+		if (memcmp(&set->addr[set->slot[h] - 1], addr, len) == 0)
+			return 1;
+	}
 
 	return 0;
 }
 
 /**
- * vrrp_net_vif_mtu() - get MTU of vrrp interface
+ * vrrp_net_vip_add() - add a VIP in vipset
  */
-int vrrp_net_vif_mtu(struct vrrp_net *vnet)
+static int vrrp_net_vip_add(struct vrrp_net *vnet, const struct vrrp_ip *vip)
 {
-	struct ifreq ifr;
+	struct vrrp_vipset *set = &vnet->vipset;
+	union vrrp_ipx_addr *addr;
+	uint32_t h;
 
-	strncpy(ifr.ifr_name, vnet->vif.ifname, IFNAMSIZ - 1);
+	if (vrrp_net_vip_find(vnet, &vip->ipx))
+		return 0;
 
-	int fd = socket(AF_INET, SOCK_DGRAM, 0);
-
-	ifr.ifr_addr.sa_family = AF_INET;
+	if (set->n == VIP_MAX) {
+		log_error("vrid %d :: too many VIPs", vnet->vrid);
+		return -1;
+	}
 
-	if (ioctl(fd, SIOCGIFMTU, &ifr) < 0) {
-		log_error("vrid %d :: ioctl - %m", vnet->vrid);
+	addr = realloc(set->addr, (set->n + 1) * sizeof(union vrrp_ipx_addr));
+	if (addr == NULL) {
+		log_error("vrid %d :: realloc - %m", vnet->vrid);
 		return -1;
 	}
 
-	vnet->vif.mtu = ifr.ifr_mtu;
-	log_debug("%s mtu : %d", vnet->vif.ifname, vnet->vif.mtu);
+	set->addr = addr;
+	set->addr[set->n++] = vip->ipx;
+
+	h = vrrp_net_vip_hash(vnet, &vip->ipx);
+	while (set->slot[h] != 0)
+		h = (h + 1) & (VRRP_VIPSET_SIZE - 1);
 
-	close(fd);
+	set->slot[h] = set->n;
 
 	return 0;
 }
 
-
 /**
  * vrrp_net_vip_set() - register VRRP virtual IPvX addresses
  */
@@ -245,88 +477,281 @@ int vrrp_net_vip_set(struct vrrp_net *vnet, const char *ip)
 		return -1;
 	}
 
+	if (vrrp_net_vip_add(vnet, vip) != 0) {
+		free(vip);
+		return -1;
+	}
+
 	list_add_tail(&vip->iplist, &vnet->vip_list);
 
 	return 0;
 }
 
+/**
+ * vrrp_net_vip_lookup() - get a registered VIP from its string form,
+ *                         netmask is ignored
+ *
+ * @return VIP, NULL if invalid or not registered
+ */
+struct vrrp_ip *vrrp_net_vip_lookup(const struct vrrp_net *vnet,
+				    const char *ip)
+{
+	union vrrp_ipx_addr addr;
+	struct vrrp_ip *vip_ptr = NULL;
+	char str[INET6_ADDRSTRLEN + 4];
+	uint8_t netmask;
+
+	memset(&addr, 0, sizeof(addr));
+
+	/* split_ip_netmask() cuts netmask off the string */
+	snprintf(str, sizeof(str), "%s", ip);
+
+	if (split_ip_netmask(vnet->family, str, &addr, &netmask) != 0)
+		return NULL;
+
+	list_for_each_entry(vip_ptr, &vnet->vip_list, iplist) {
+		if (memcmp(&vip_ptr->ipx, &addr, vrrp_net_vip_len(vnet)) == 0)
+			return vip_ptr;
+	}
+
+	return NULL;
+}
+
+/**
+ * vrrp_net_vipset_rebuild() - rebuild VIP set from VIP list
+ */
+static void vrrp_net_vipset_rebuild(struct vrrp_net *vnet)
+{
+	struct vrrp_vipset *set = &vnet->vipset;
+	struct vrrp_ip *vip_ptr = NULL;
+
+	set->n = 0;
+	memset(set->slot, 0, sizeof(set->slot));
+
+	list_for_each_entry(vip_ptr, &vnet->vip_list, iplist)
+	    vrrp_net_vip_add(vnet, vip_ptr);
+}
+
+/**
+ * vrrp_net_vip_unset() - unregister a VIP, caller frees it
+ *
+ * vipset is rebuilt from remaining VIPs, in place.
+ */
+void vrrp_net_vip_unset(struct vrrp_net *vnet, struct vrrp_ip *vip)
+{
+	list_del(&vip->iplist);
+	vrrp_net_vipset_rebuild(vnet);
+}
+
+/**
+ * vrrp_net_vip_relink() - register again a VIP unset by
+ *                         vrrp_net_vip_unset(), after pos in VIP list
+ */
+void vrrp_net_vip_relink(struct vrrp_net *vnet, struct vrrp_ip *vip,
+			 struct list_head *pos)
+{
+	list_add(&vip->iplist, pos);
+	vrrp_net_vipset_rebuild(vnet);
+}
+
 
 /**
  * vrrp_net_invalidate_buffer() 
- * invalidate internal buffer used to stock received pkt
- * vnet->__pkt
+ * invalidate view on last received pkt vnet->__pkt, listen socket
+ * buffer is about to be reused
  */
-static inline void vrrp_net_invalidate_buffer(struct vrrp_net *vnet)
+void vrrp_net_invalidate_buffer(struct vrrp_net *vnet)
 {
-	vnet->__pkt.adv.version_type = 0;
+	vnet->__pkt = NULL;
 }
 
 /**
- * vrrp_net_recv() - read and check a received VRRP pkt advertisement
+ * vrrp_net_read() - read a batch of pkt on a listen socket
+ *
+ * Each pkt read is demultiplexed by VRID, rx[i].vnet is the instance
+ * the pkt is destined to, NULL if none.
+ *
+ * @return count of pkt read in sock->rx, -1 on error
+ */
+int vrrp_net_read(struct vrrp_socket *sock)
+{
+	struct vrrphdr *vrrpkt;
+	struct vrrp_rx *rx;
+	int i, n;
+
+	/* lengths are updated by previous recvmmsg() */
+	for (i = 0; i < VRRP_RECV_BATCH; ++i) {
+		sock->msgs[i].msg_hdr.msg_namelen = sizeof(sock->rx[i].src);
+		sock->msgs[i].msg_hdr.msg_controllen =
+		    sizeof(sock->rx[i].ancillary);
+	}
+
+	/* MSG_TRUNC: msg_len is the real pkt len, even if larger
+	 * than the batch slot */
+	n = recvmmsg(sock->fd, sock->msgs, VRRP_RECV_BATCH,
+		     MSG_DONTWAIT | MSG_TRUNC, NULL);
+
+	if (n < 0) {
+		if (errno != EAGAIN)
+			log_error("%s :: recvmmsg - %m", sock->ifname);
+		return -1;
+	}
+
+	for (i = 0; i < n; ++i) {
+		rx = &sock->rx[i];
+		rx->vnet = NULL;
+		rx->invalid = NULL;
+
+		/* pkt larger than any valid VRRP adv, truncated in slot */
+		if (sock->msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+			rx->invalid = "too large";
+
+		/* read IPvX header values and fill vrrp_recv buffer */
+		rx->payload_pos = -1;
+		rx->len = sock->ipx_helper->recv(&sock->msgs[i].msg_hdr,
+						 sock->msgs[i].msg_len,
+						 &rx->pkt, &rx->payload_pos);
+
+		if (rx->len == -1) {
+			rx->len = sock->msgs[i].msg_len;
+			rx->invalid = "unreadable header";
+		}
+		else if (rx->len < (ssize_t) (rx->payload_pos
+					      + VRRP_PKTHDR_SIZE))
+			rx->invalid = "too short";
+
+		/* invalid pkt are demultiplexed too if their VRID was
+		 * received, to be accounted by vrrp_net_recv() */
+		if ((rx->payload_pos < 0)
+		    || (rx->len < (ssize_t) (rx->payload_pos
+					     + offsetof(struct vrrphdr, vrid)
+					     + 1))) {
+			log_debug("%s :: Invalid pkt - %s (%zd bytes), no VRID",
+				  sock->ifname, rx->invalid, rx->len);
+			continue;
+		}
+
+		/* demux by VRID */
+		vrrpkt = (struct vrrphdr *) (rx->buf + rx->payload_pos);
+		rx->pkt.adv = vrrpkt;
+		rx->vnet = sock->vnet[vrrpkt->vrid];
+
+		if (rx->vnet == NULL)
+			log_debug("%s :: no instance for VRID %d",
+				  sock->ifname, vrrpkt->vrid);
+	}
+
+	return n;
+}
+
+/**
+ * vrrp_net_drop() - account an invalid pkt by reason and source
+ *
+ * @return TRUE if pkt may be logged, FALSE if its source is rate
+ *         limited (see vrrp_flood.c)
+ */
+static inline int vrrp_net_drop(struct vrrp_net *vnet,
+				struct vrrp_recv *pkt,
+				enum vrrp_stats_invalid reason)
+{
+	vrrp_stats_inc(&vnet->stats->invalid[reason]);
+	VRRP_PROBE2(pkt_drop, vnet->vrid, reason);
+
+	return vrrp_flood_invalid(vnet, &pkt->s_ipx, reason);
+}
+
+/**
+ * vrrp_net_recv() - check a VRRP pkt advertisement read on
+ *                   listen socket by vrrp_net_read()
  *
  * @return vrrp_pkt_t
  */
-vrrp_event_t vrrp_net_recv(struct vrrp_net *vnet, const struct vrrp *vrrp)
+vrrp_event_t vrrp_net_recv(struct vrrp_net *vnet, const struct vrrp *vrrp,
+			   struct vrrp_rx *rx)
 {
-	/* fetch pkt data received to buf */
-	unsigned char buf[IP_MAXPACKET];
+	struct vrrp_recv *pkt = &rx->pkt;
+	ssize_t len = rx->len;
+
+	vrrp_net_invalidate_buffer(vnet);
 
-	/* read IPvX header values and fill vrrp_recv buffer __pkt */
-	int payload_pos = 0;
-	ssize_t len = vnet->pkt_receive(vnet->socket, &vnet->__pkt, buf,
-					IP_MAXPACKET, &payload_pos);
+	VRRP_PROBE2(pkt_recv, vnet->vrid, len);
 
-	/* check len */
-	if (len == -1) {
-		log_error("vrid %d :: invalid pkt", vnet->vrid);
+	/* source floods invalid pkt, queued before socket filter update */
+	if (vrrp_flood_blocked(vnet, &pkt->s_ipx)) {
+		vrrp_stats_inc(&vnet->stats->invalid[VRRP_INVALID_FLOOD]);
+		VRRP_PROBE2(pkt_drop, vnet->vrid, VRRP_INVALID_FLOOD);
 		return INVALID;
 	}
 
-	if ((len > vnet->vif.mtu) || (len < vnet->adv_getsize(vnet))) {
-		log_error("vrid %d :: invalid pkt len", vnet->vrid);
+	/* too large, too short or unreadable pkt, see vrrp_net_read() */
+	if (rx->invalid != NULL) {
+		if (vrrp_net_drop(vnet, pkt, VRRP_INVALID_LEN))
+			log_info("vrid %d :: Invalid pkt - %s (%zd bytes)",
+				 vnet->vrid, rx->invalid, len);
 		return INVALID;
 	}
 
-	/* read and check vrrp advertisement pkt */
-	struct vrrphdr *vrrpkt;
+	/* check len, VRRPv3 pkt is checked against its own count of
+	 * VIPs below */
+	if ((vrrp->version != RFC5798) && (len < vnet->adv_getsize(vnet))) {
+		if (vrrp_net_drop(vnet, pkt, VRRP_INVALID_LEN))
+			log_error("vrid %d :: invalid pkt len", vnet->vrid);
+		return INVALID;
+	}
 
-	vrrpkt = (struct vrrphdr *) (buf + payload_pos);
+	/* check vrrp advertisement pkt in place */
+	struct vrrphdr *vrrpkt;
 
-	/* TODO : is this really necessary ?? */
-	vrrp_net_invalidate_buffer(vnet);
+	vrrpkt = (struct vrrphdr *) (rx->buf + rx->payload_pos);
 
 	/* check VRRP pkt size (including VRRP IP address(es) and Auth data) */
-	unsigned int payload_size =
-	    vnet->__pkt.header.totlen - vnet->__pkt.header.len;
+	unsigned int payload_size = pkt->header.totlen - pkt->header.len;
 
 	if ((payload_size < VRRP_PKT_MINSIZE)
 	    || (payload_size > VRRP_PKT_MAXSIZE)) {
-		log_info
-		    ("vrid %d :: Invalid pkt - Invalid packet size %d, expecting size between %ld and %ld",
-		     vrrp->vrid, payload_size, VRRP_PKT_MINSIZE,
-		     VRRP_PKT_MAXSIZE);
+		if (vrrp_net_drop(vnet, pkt, VRRP_INVALID_LEN))
+			log_info
+			    ("vrid %d :: Invalid pkt - Invalid packet size %d, expecting size between %ld and %ld",
+			     vrrp->vrid, payload_size, VRRP_PKT_MINSIZE,
+			     VRRP_PKT_MAXSIZE);
+		return INVALID;
+	}
+
+	/* VRRPv3 routers may count other VIPs than ours while they are
+	 * changed in place (vip add|del), pkt must hold all of its VIPs */
+	if ((vrrp->version == RFC5798)
+	    && (((ssize_t) payload_size > len - rx->payload_pos)
+		|| (payload_size < VRRP_PKTHDR_SIZE
+		    + vrrpkt->naddr * vrrp_net_vip_len(vnet)))) {
+		if (vrrp_net_drop(vnet, pkt, VRRP_INVALID_LEN))
+			log_info("vrid %d :: Invalid pkt - size %d too short "
+				 "for %d VIPs", vrrp->vrid, payload_size,
+				 vrrpkt->naddr);
 		return INVALID;
 	}
 
 	/* verify ip proto */
-	if (vnet->__pkt.header.proto != IPPROTO_VRRP) {
-		log_info("vrid %d :: Invalid pkt - ip proto not valid %d",
-			 vrrp->vrid, vnet->__pkt.header.proto);
+	if (pkt->header.proto != IPPROTO_VRRP) {
+		if (vrrp_net_drop(vnet, pkt, VRRP_INVALID_PROTO))
+			log_info("vrid %d :: Invalid pkt - ip proto not valid %d",
+				 vrrp->vrid, pkt->header.proto);
 		return INVALID;
 	}
 
 	/* verify VRRP version */
 	if ((vrrpkt->version_type >> 4) != vrrp->version) {
-		log_info
-		    ("vrid %d :: Invalid pkt - version %d mismatch, expecting %d",
-		     vrrp->vrid, vrrpkt->version_type >> 4, vrrp->version);
+		if (vrrp_net_drop(vnet, pkt, VRRP_INVALID_VERSION))
+			log_info
+			    ("vrid %d :: Invalid pkt - version %d mismatch, expecting %d",
+			     vrrp->vrid, vrrpkt->version_type >> 4, vrrp->version);
 		return INVALID;
 	}
 
 	/* TTL must be 255 */
-	if (vnet->__pkt.header.ttl != VRRP_TTL) {
-		log_info("vrid %d :: Invalid pkt - TTL isn't %d", vrrp->vrid,
-			 VRRP_TTL);
+	if (pkt->header.ttl != VRRP_TTL) {
+		if (vrrp_net_drop(vnet, pkt, VRRP_INVALID_TTL))
+			log_info("vrid %d :: Invalid pkt - TTL isn't %d", vrrp->vrid,
+				 VRRP_TTL);
 		return INVALID;
 	}
 
@@ -339,11 +764,11 @@ vrrp_event_t vrrp_net_recv(struct vrrp_net *vnet, const struct vrrp *vrrp)
 
 	/* verify VRRP checksum */
 	int chksum = vrrpkt->chksum;	/* save checksum */
-	if (vnet->adv_checksum(vnet, vrrpkt, &vnet->__pkt.s_ipx,
-			       &vnet->__pkt.d_ipx) != chksum) {
-		log_info("vrid %d :: Invalid pkt - Invalid checksum %x",
-			 vrrp->vrid, chksum);
-
+	if (vnet->adv_checksum(vnet, vrrpkt, payload_size, &pkt->s_ipx,
+			       &pkt->d_ipx) != chksum) {
+		if (vrrp_net_drop(vnet, pkt, VRRP_INVALID_CHKSUM))
+			log_info("vrid %d :: Invalid pkt - Invalid checksum %x",
+				 vrrp->vrid, chksum);
 		return INVALID;
 	}
 	/* restore checksum */
@@ -353,9 +778,10 @@ vrrp_event_t vrrp_net_recv(struct vrrp_net *vnet, const struct vrrp *vrrp)
 	 * (Priority equals 255) 
 	 */
 	if (vrrp->priority == PRIO_OWNER) {
-		log_info
-		    ("vrid %d :: Invalid pkt - *We* are the owner of IP address(es) (priority %d)",
-		     vrrp->vrid, vrrp->priority);
+		if (vrrp_net_drop(vnet, pkt, VRRP_INVALID_OWNER))
+			log_info
+			    ("vrid %d :: Invalid pkt - *We* are the owner of IP address(es) (priority %d)",
+			     vrrp->vrid, vrrp->priority);
 		return INVALID;
 	}
 
@@ -365,9 +791,10 @@ vrrp_event_t vrrp_net_recv(struct vrrp_net *vnet, const struct vrrp *vrrp)
 
 		/* auth type must be the same locally configured */
 		if (vrrpkt->auth_type != vrrp->auth_type) {
-			log_info
-			    ("vrid %d :: Invalid pkt - Invalid authentication type",
-			     vrrp->vrid);
+			if (vrrp_net_drop(vnet, pkt, VRRP_INVALID_AUTH))
+				log_info
+				    ("vrid %d :: Invalid pkt - Invalid authentication type",
+				     vrrp->vrid);
 			return INVALID;
 		}
 
@@ -381,9 +808,10 @@ vrrp_event_t vrrp_net_recv(struct vrrp_net *vnet, const struct vrrp *vrrp)
 			    (auth_data, vrrp->auth_data,
 			     strlen(vrrp->auth_data))
 			    != 0) {
-				log_info
-				    ("vrid %d :: Invalid pkt - Invalid authentication password",
-				     vrrp->vrid);
+				if (vrrp_net_drop(vnet, pkt, VRRP_INVALID_AUTH))
+					log_info
+					    ("vrid %d :: Invalid pkt - Invalid authentication password",
+					     vrrp->vrid);
 				return INVALID;
 			}
 		}
@@ -392,25 +820,37 @@ vrrp_event_t vrrp_net_recv(struct vrrp_net *vnet, const struct vrrp *vrrp)
 	/* count of IP address(es) and list may be the same 
 	 * or generated by the owner 
 	 */
-	if (((vrrpkt->naddr != vrrp->naddr)
-	     || (vnet->vip_compare(vnet, vrrpkt) != 0))
-	    && (vrrpkt->priority != PRIO_OWNER) && (vrrp->version == 2)) {
-		log_info
-		    ("vrid %d :: Invalid pkt not generated by the owner, drop it",
-		     vrrp->vrid);
-		return INVALID;
+	if ((vrrp->version != RFC5798) && (vrrpkt->priority != PRIO_OWNER)) {
+		int ndiff = 0;
+
+		if (vrrpkt->naddr == vrrp->naddr)
+			ndiff = vnet->vip_compare(vnet, vrrpkt);
+
+		if ((vrrpkt->naddr != vrrp->naddr) || (ndiff != 0)) {
+			if (vrrp_net_drop(vnet, pkt, VRRP_INVALID_VIP))
+				log_info
+				    ("vrid %d :: Invalid pkt not generated by the owner, %d VIPs, %d unexpected, drop it",
+				     vrrp->vrid, vrrpkt->naddr, ndiff);
+			return INVALID;
+		}
 	}
 
-	/* advert interval must be the same as the locally configured */
-	if (vrrpkt->adv_int != vrrp->adv_int) {
-		log_info
-		    ("vrid %d :: Invalid pkt - Advertisement interval mismatch\n",
-		     vrrp->vrid);
+	/* advert interval must be the same as the locally configured,
+	 * RFC5798 backups learn Master_Adver_Interval from master */
+	if ((vrrp->version != RFC5798) && (vrrpkt->adv_int != vrrp->adv_int)) {
+		if (vrrp_net_drop(vnet, pkt, VRRP_INVALID_ADVINT))
+			log_info
+			    ("vrid %d :: Invalid pkt - Advertisement interval mismatch\n",
+			     vrrp->vrid);
 		return INVALID;
 	}
 
-	/* pkt is valid, keep it in internal buffer */
-	memcpy(&vnet->__pkt.adv, vrrpkt, sizeof(struct vrrphdr));
+	/* pkt is valid, keep a view on it until dispatched */
+	vnet->__pkt = pkt;
+
+	vrrp_stats_recv(vnet, &pkt->s_ipx);
+	vrrp_flood_valid(vnet, &pkt->s_ipx);
+	VRRP_PROBE2(pkt_valid, vnet->vrid, vrrpkt->priority);
 
 	return PKT;
 }
@@ -428,11 +868,16 @@ int vrrp_net_send(const struct vrrp_net *vnet, struct iovec *iov, size_t len)
 	struct sockaddr_ll device = { 0 };
 
 	device.sll_family = AF_PACKET;
-	device.sll_ifindex = if_nametoindex(vnet->vif.ifname);
-
-	if (device.sll_ifindex == 0) {
-		log_error("vrid %d :: if_nametoindex - %m", vnet->vrid);
-		return -1;
+	device.sll_ifindex = vnet->vif.ifindex;
+
+	/* copy frame in TX ring, or sendmsg() it */
+	if (vrrp_ring_enabled() && (vrrp_ring_queue(iov, len) == 0)) {
+		if (vrrp_ring_flush(&device, NULL) != 1) {
+			log_error("vrid %d :: TX ring - pkt not sent",
+				  vnet->vrid);
+			return -1;
+		}
+		return 0;
 	}
 
 	struct msghdr msg = { 0 };
@@ -452,3 +897,87 @@ int vrrp_net_send(const struct vrrp_net *vnet, struct iovec *iov, size_t len)
 
 	return 0;
 }
+
+/**
+ * vrrp_net_send_topology() - send topology update pkt of each VIP
+ *                            (gratuitous ARP or unsolicited NA)
+ *                            in a single sendmmsg() burst
+ *
+ * A failed pkt is reported and skipped, the burst goes on with
+ * the next VIP. If TX ring is enabled, frames are copied in the ring
+ * and sent in one kick, sendmmsg() is used for frames which don't fit.
+ *
+ * @return 0 if all pkt are sent, -1 else
+ */
+int vrrp_net_send_topology(const struct vrrp_net *vnet)
+{
+	struct mmsghdr msgs[VIP_MAX];
+	struct sockaddr_ll device = { 0 };
+	struct vrrp_ip *vip_ptr = NULL;
+	struct vrrp_ip *vips[VIP_MAX];
+	int status[VIP_MAX];
+	struct timespec start, end;
+	char straddr[INET6_ADDRSTRLEN];
+	int n = 0, sent = 0, ret;
+
+	device.sll_family = AF_PACKET;
+	device.sll_ifindex = vnet->vif.ifindex;
+
+	/* one pkt by vip */
+	list_for_each_entry_reverse(vip_ptr, &vnet->vip_list, iplist) {
+		if (n == VIP_MAX)
+			break;
+
+		memset(&msgs[n], 0, sizeof(struct mmsghdr));
+		msgs[n].msg_hdr.msg_name = &device;
+		msgs[n].msg_hdr.msg_namelen = sizeof(device);
+		msgs[n].msg_hdr.msg_iov = &vip_ptr->__frame;
+		msgs[n].msg_hdr.msg_iovlen = 1;
+		vips[n++] = vip_ptr;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (int i = 0; i < n; i += ret) {
+
+		/* copy frames in TX ring and send them in one kick */
+		for (ret = 0; vrrp_ring_enabled() && (i + ret < n); ++ret) {
+			if (vrrp_ring_queue(&vips[i + ret]->__frame, 1) != 0)
+				break;
+		}
+
+		if (ret > 0) {
+			sent += vrrp_ring_flush(&device, status);
+			for (int j = 0; j < ret; ++j) {
+				if (status[j] != 0)
+					log_error("vrid %d :: TX ring %s - pkt not sent",
+						  vnet->vrid,
+						  vnet->ipx_to_str(&vips[i + j]->ipx,
+								   straddr));
+			}
+			continue;
+		}
+
+		ret = sendmmsg(vnet->xmit, &msgs[i], n - i, 0);
+
+		if (ret > 0) {
+			sent += ret;
+			continue;
+		}
+
+		/* sendmmsg() stops on the first failed pkt */
+		log_error("vrid %d :: sendmmsg %s - %m", vnet->vrid,
+			  vnet->ipx_to_str(&vips[i]->ipx, straddr));
+		ret = 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	VRRP_PROBE3(topology_send, vnet->vrid, sent, n);
+
+	log_info("vrid %d :: %d/%d topology pkt sent in %ld us", vnet->vrid,
+		 sent, n, (end.tv_sec - start.tv_sec) * 1000000
+		 + (end.tv_nsec - start.tv_nsec) / 1000);
+
+	return (sent == n) ? 0 : -1;
+}
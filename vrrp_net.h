@@ -34,6 +34,9 @@
 #include <linux/if_packet.h>
 
 #include "vrrp_ipx.h"
+#include "vrrp_arena.h"
+#include "vrrp_stats.h"
+#include "vrrp_flood.h"
 #include "vrrp_rfc.h"
 #include "list.h"
 
@@ -54,6 +57,24 @@ typedef enum _vrrp_event_type vrrp_event_t;
 #define VRRP_PKT_MAXSIZE VRRP_PKTHDR_SIZE + VRRP_VIPMAX_SIZE + VRRP_AUTH_SIZE
 
 #define IPHDR_SIZE sizeof(struct iphdr)
+#define IPHDR_MAXSIZE (15 << 2)
+
+/* VRID demux table size */
+#define VRRP_NVRID      256
+
+/* max pkt read by a single recvmmsg() */
+#define VRRP_RECV_BATCH 16
+
+/* room for a single pkt in listen socket buffer: largest IP header
+ * and largest VRRP adv, rounded to a cache line. Larger pkt are
+ * truncated by the kernel and dropped */
+#define VRRP_RECV_ALIGN 64
+#define VRRP_RECV_BUFSIZE \
+	((IPHDR_MAXSIZE + VRRP_PKT_MAXSIZE + VRRP_RECV_ALIGN - 1) \
+	 & ~((size_t) VRRP_RECV_ALIGN - 1))
+
+/* max peer addresses allowed to send advertisements */
+#define VRRP_PEER_MAX   16
 
 /**
  * struct vrrp_ip - VRRP IPs addresses
@@ -62,8 +83,26 @@ struct vrrp_ip {
 	union vrrp_ipx_addr ipx;
 	uint8_t netmask;
 	struct list_head iplist;
-	/* internal buffer for topology update pkt */
+	/* internal buffer for topology update pkt : ethernet header, IP
+	 * or ARP header and payload, in the contiguous frame __frame */
 	struct iovec __topology[3];
+	struct iovec __frame;
+};
+
+/* VIPs hash set, power of 2 greater than 2 * VIP_MAX */
+#define VRRP_VIPSET_BITS 9
+#define VRRP_VIPSET_SIZE (1 << VRRP_VIPSET_BITS)
+
+/**
+ * struct vrrp_vipset - VIPs in an open addressing hash set (linear
+ *                      probing), built once while reading options
+ */
+struct vrrp_vipset {
+	union vrrp_ipx_addr *addr;
+	int n;
+
+	/* index in addr[] + 1, 0 if empty */
+	uint16_t slot[VRRP_VIPSET_SIZE];
 };
 
 /**
@@ -71,10 +110,24 @@ struct vrrp_ip {
  */
 struct vrrp_if {
 	char *ifname;
+	int ifindex;
 	int mtu;
+	int up;
+	int family;
 	union vrrp_ipx_addr ipx;
+
+	/* rtnetlink cache, run cb() when one of the fields above changes */
+	void (*cb) (struct vrrp_if *vif, int changes, void *data);
+	void *data;
+	struct list_head list;
 };
 
+/* vrrp_if changes */
+#define VRRP_IF_LINK    0x1
+#define VRRP_IF_MTU     0x2
+#define VRRP_IF_ADDR    0x4
+#define VRRP_IF_INDEX   0x8	/* link (re)created, new ifindex */
+
 
 /**
  * struct vrrp_recv - VRRP buffer recv
@@ -83,7 +136,9 @@ struct vrrp_recv {
 	union vrrp_ipx_addr s_ipx;
 	union vrrp_ipx_addr d_ipx;
 	struct vrrp_ipx_header header;
-	struct vrrphdr adv;
+
+	/* view on VRRP adv in listen socket buffer */
+	const struct vrrphdr *adv;
 };
 
 #define ip_addr   ipx.addr
@@ -96,6 +151,54 @@ struct vrrp_recv {
 #define ip_daddr6 d_ipx.addr6
 #endif /* HAVE_IP6 */
 
+/**
+ * struct vrrp_rx - pkt read on a listen socket
+ */
+struct vrrp_rx {
+	struct vrrp_recv pkt;
+	unsigned char *buf;
+	ssize_t len;
+	int payload_pos;
+
+	/* reason of a pkt found invalid before demux, NULL if none */
+	const char *invalid;
+
+	/* destination instance, NULL if none */
+	struct vrrp_net *vnet;
+
+	/* recvmmsg() source address and ancillary data */
+	struct sockaddr_in6 src;
+	uint8_t ancillary[64];
+	struct iovec iov;
+};
+
+/**
+ * struct vrrp_socket - listen socket shared by all VRRP instances
+ *                      running on the same interface and family
+ */
+struct vrrp_socket {
+	char ifname[IFNAMSIZ];
+	int ifindex;
+	int family;
+	int fd;
+
+	/* count of instances using this socket */
+	int refcnt;
+
+	/* instances demux table, indexed by VRID */
+	struct vrrp_net *vnet[VRRP_NVRID];
+
+	/* last pkt batch read */
+	struct vrrp_rx rx[VRRP_RECV_BATCH];
+	struct mmsghdr msgs[VRRP_RECV_BATCH];
+	unsigned char *buf;
+
+	/* family helper functions */
+	struct vrrp_ipx *ipx_helper;
+
+	struct list_head list;
+};
+
 /**
  * struct vrrp_net - VRRP net structure
  */
@@ -103,11 +206,15 @@ struct vrrp_net {
 	/* VRRP id */
 	uint8_t vrid;
 
+	/* VRRP version */
+	uint8_t version;
+
 	/* VRRP interface */
 	struct vrrp_if vif;
 
 	/* list of VRRP IP adresses */
 	struct list_head vip_list;
+	struct vrrp_vipset vipset;
 
 	/* family */
 	int family;
@@ -115,17 +222,39 @@ struct vrrp_net {
 	/* count IP addresses */
 	uint8_t naddr;
 
+	/* peers allowed to send advertisements, any if empty */
+	union vrrp_ipx_addr peer[VRRP_PEER_MAX];
+	uint8_t npeer;
+	int peer_family;
+
 	/* listen VRRP socket */
 	int socket;
+	struct vrrp_socket *sock;
 
 	/* xmit VRRP socket */
 	int xmit;
 
-	/* buffer for received pkt */
-	struct vrrp_recv __pkt;
+	/* last valid pkt received, points to a listen socket batch slot,
+	 * only valid while the pkt is dispatched */
+	struct vrrp_recv *__pkt;
+
+	/* buffer for advertisement pkt : ethernet, IP and VRRP headers,
+	 * then VRRP header of priority 0 advertisement. Headers are laid
+	 * out in two contiguous frames __adv_frame, normal and priority 0
+	 * advertisement */
+	struct iovec __adv[4];
+	struct iovec __adv_frame[2];
+	struct vrrp_arena __adv_arena;
+
+	/* topology update pkt of all VIPs */
+	struct vrrp_arena __topology_arena;
+
+	/* statistics page, shared with monitors through stats_name */
+	struct vrrp_stats *stats;
+	char *stats_name;
 
-	/* buffer for advertisement pkt */
-	struct iovec __adv[3];
+	/* sources of invalid pkt */
+	struct vrrp_flood flood;
 
 	/* family helper functions */
 	struct vrrp_ipx *ipx_helper;
@@ -148,10 +277,20 @@ void vrrp_net_init(struct vrrp_net *vnet);
 void vrrp_net_cleanup(struct vrrp_net *vnet);
 int vrrp_net_socket(struct vrrp_net *vnet);
 int vrrp_net_socket_xmit(struct vrrp_net *vnet);
+int vrrp_net_read(struct vrrp_socket *sock);
 int vrrp_net_vif_getaddr(struct vrrp_net *vnet);
-int vrrp_net_vif_mtu(struct vrrp_net *vnet);
+int vrrp_net_socket_rebind(struct vrrp_net *vnet);
 int vrrp_net_vip_set(struct vrrp_net *vnet, const char *ip);
-vrrp_event_t vrrp_net_recv(struct vrrp_net *vnet, const struct vrrp *vrrp);
+int vrrp_net_vip_find(const struct vrrp_net *vnet, const void *addr);
+struct vrrp_ip *vrrp_net_vip_lookup(const struct vrrp_net *vnet,
+				    const char *ip);
+void vrrp_net_vip_unset(struct vrrp_net *vnet, struct vrrp_ip *vip);
+void vrrp_net_vip_relink(struct vrrp_net *vnet, struct vrrp_ip *vip,
+			 struct list_head *pos);
+vrrp_event_t vrrp_net_recv(struct vrrp_net *vnet, const struct vrrp *vrrp,
+			   struct vrrp_rx *rx);
+void vrrp_net_invalidate_buffer(struct vrrp_net *vnet);
 int vrrp_net_send(const struct vrrp_net *vnet, struct iovec *iov, size_t len);
+int vrrp_net_send_topology(const struct vrrp_net *vnet);
 
 #endif /* _VRRP_NET_ */
@@ -0,0 +1,477 @@
+/*
+ * vrrp_nl.c - rtnetlink cache of VRRP interfaces, keep ifindex,
+ *             MTU, link state and primary address of each VRRP
+ *             interface up to date
+ *
+ * Copyright (C) 2017 Arnaud Andre 
+ *
+ * This file is part of uvrrpd.
+ *
+ * uvrrpd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * uvrrpd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with uvrrpd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_addr.h>
+
+#include "vrrp_net.h"
+#include "vrrp_nl.h"
+
+#include "list.h"
+#include "log.h"
+
+/* rtnetlink socket, subscribed to link and address events */
+static int vrrp_nl = -1;
+static uint32_t vrrp_nl_seq = 0;
+
+/* cached interfaces */
+static LIST_HEAD(vrrp_nl_vifs);
+
+/**
+ * vrrp_nl_req - pending request, the kernel runs one dump at a time
+ */
+static struct {
+	uint32_t seq;	/* request waiting for its reply, 0 if none */
+	int error;
+	int dump;	/* dumps to run once current request is done */
+} vrrp_nl_req;
+
+#define VRRP_NL_DUMP_LINK	0x1
+#define VRRP_NL_DUMP_ADDR	0x2
+
+/* netlink_dump() sizes skb on our recv buffer, up to 32k */
+#define VRRP_NL_BUFSIZE		32768
+
+static char vrrp_nl_buf[VRRP_NL_BUFSIZE]
+    __attribute__ ((aligned(NLMSG_ALIGNTO)));
+
+/**
+ * vrrp_nl_open() - open rtnetlink socket
+ */
+static int vrrp_nl_open(void)
+{
+	struct sockaddr_nl sa = { 0 };
+
+	vrrp_nl = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+
+	if (vrrp_nl < 0) {
+		log_error("socket - %m");
+		return -1;
+	}
+
+	sa.nl_family = AF_NETLINK;
+	sa.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+
+	if (bind(vrrp_nl, (struct sockaddr *) &sa, sizeof(sa)) < 0) {
+		log_error("bind - %m");
+		close(vrrp_nl);
+		vrrp_nl = -1;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * vrrp_nl_send() - send RTM_GETLINK or RTM_GETADDR request
+ *
+ * @ifname: get a single link by name if not NULL, dump else
+ */
+static int vrrp_nl_send(int type, int family, const char *ifname)
+{
+	struct {
+		struct nlmsghdr nh;
+		union {
+			struct ifinfomsg ifi;
+			struct ifaddrmsg ifa;
+		};
+		char attr[RTA_SPACE(IFNAMSIZ)];
+	} req;
+	struct rtattr *rta;
+	size_t len;
+
+	memset(&req, 0, sizeof(req));
+
+	req.nh.nlmsg_type = type;
+	req.nh.nlmsg_flags = NLM_F_REQUEST;
+	req.nh.nlmsg_seq = ++vrrp_nl_seq;
+
+	if (type == RTM_GETLINK) {
+		req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+		req.ifi.ifi_family = AF_UNSPEC;
+	}
+	else {	/* RTM_GETADDR */
+		req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifaddrmsg));
+		req.ifa.ifa_family = family;
+	}
+
+	if (ifname != NULL) {
+		len = strnlen(ifname, IFNAMSIZ - 1);
+		rta = (struct rtattr *) ((char *) &req
+					 + NLMSG_ALIGN(req.nh.nlmsg_len));
+		rta->rta_type = IFLA_IFNAME;
+		rta->rta_len = RTA_LENGTH(len + 1);
+		memcpy(RTA_DATA(rta), ifname, len);
+		req.nh.nlmsg_len = NLMSG_ALIGN(req.nh.nlmsg_len)
+		    + RTA_ALIGN(rta->rta_len);
+	}
+	else
+		req.nh.nlmsg_flags |= NLM_F_DUMP;
+
+	if (send(vrrp_nl, &req, req.nh.nlmsg_len, 0) < 0) {
+		log_error("send - %m");
+		return -1;
+	}
+
+	vrrp_nl_req.seq = req.nh.nlmsg_seq;
+	vrrp_nl_req.error = 0;
+
+	return 0;
+}
+
+/**
+ * vrrp_nl_next() - run next pending dump
+ */
+static void vrrp_nl_next(void)
+{
+	if (vrrp_nl_req.seq != 0)
+		return;
+
+	if (vrrp_nl_req.dump & VRRP_NL_DUMP_LINK) {
+		vrrp_nl_req.dump &= ~VRRP_NL_DUMP_LINK;
+		vrrp_nl_send(RTM_GETLINK, AF_UNSPEC, NULL);
+	}
+	else if (vrrp_nl_req.dump & VRRP_NL_DUMP_ADDR) {
+		vrrp_nl_req.dump &= ~VRRP_NL_DUMP_ADDR;
+		vrrp_nl_send(RTM_GETADDR, AF_UNSPEC, NULL);
+	}
+}
+
+/**
+ * vrrp_nl_link() - RTM_NEWLINK / RTM_DELLINK
+ */
+static void vrrp_nl_link(struct nlmsghdr *nh)
+{
+	struct ifinfomsg *ifi = NLMSG_DATA(nh);
+	int len = IFLA_PAYLOAD(nh);
+	struct rtattr *rta;
+	struct vrrp_if *vif;
+	const char *ifname = NULL;
+	int mtu = 0, up, changes;
+
+	for (rta = IFLA_RTA(ifi); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		if (rta->rta_type == IFLA_IFNAME)
+			ifname = RTA_DATA(rta);
+		else if (rta->rta_type == IFLA_MTU)
+			mtu = *(int *) RTA_DATA(rta);
+	}
+
+	up = (nh->nlmsg_type == RTM_NEWLINK)
+	    && (ifi->ifi_flags & IFF_RUNNING);
+
+	list_for_each_entry(vif, &vrrp_nl_vifs, list) {
+		changes = 0;
+
+		/* interface is looked up by name while unbound: at start,
+		 * or once removed, so that a link recreated with the same
+		 * name is bound again */
+		if (vif->ifindex == 0) {
+			if ((nh->nlmsg_type != RTM_NEWLINK) || (ifname == NULL)
+			    || (strcmp(ifname, vif->ifname) != 0))
+				continue;
+			vif->ifindex = ifi->ifi_index;
+			changes |= VRRP_IF_INDEX;
+		}
+
+		if (vif->ifindex != ifi->ifi_index)
+			continue;
+
+		if (nh->nlmsg_type == RTM_DELLINK) {
+			log_error("%s removed", vif->ifname);
+			vif->ifindex = 0;
+		}
+
+		if (up != vif->up) {
+			vif->up = up;
+			changes |= VRRP_IF_LINK;
+		}
+
+		if ((mtu != 0) && (mtu != vif->mtu)) {
+			vif->mtu = mtu;
+			changes |= VRRP_IF_MTU;
+		}
+
+		if (changes && (vif->cb != NULL))
+			vif->cb(vif, changes, vif->data);
+	}
+}
+
+/**
+ * vrrp_nl_addrlen() - size of an address of family, 0 if not supported
+ */
+static size_t vrrp_nl_addrlen(int family)
+{
+	if (family == AF_INET)
+		return sizeof(struct in_addr);
+#ifdef HAVE_IP6
+	if (family == AF_INET6)
+		return sizeof(struct in6_addr);
+#endif /* HAVE_IP6 */
+
+	return 0;
+}
+
+/**
+ * vrrp_nl_addr() - RTM_NEWADDR / RTM_DELADDR
+ *
+ * Primary address is the first IPv4 address not flagged secondary,
+ * or the first IPv6 link-local address (RFC 5798 5.1.2.1)
+ */
+static void vrrp_nl_addr(struct nlmsghdr *nh)
+{
+	struct ifaddrmsg *ifa = NLMSG_DATA(nh);
+	int len = IFA_PAYLOAD(nh);
+	size_t addrlen = vrrp_nl_addrlen(ifa->ifa_family);
+	union vrrp_ipx_addr none;
+	struct rtattr *rta;
+	struct vrrp_if *vif;
+	void *addr = NULL, *local = NULL;
+	uint32_t flags = ifa->ifa_flags;
+
+	for (rta = IFA_RTA(ifa); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		if (rta->rta_type == IFA_ADDRESS)
+			addr = RTA_DATA(rta);
+		else if (rta->rta_type == IFA_LOCAL)
+			local = RTA_DATA(rta);
+		else if (rta->rta_type == IFA_FLAGS)
+			flags = *(uint32_t *) RTA_DATA(rta);
+	}
+
+	/* IFA_ADDRESS is the peer address on point-to-point links */
+	if (local != NULL)
+		addr = local;
+
+	if ((addr == NULL) || (addrlen == 0))
+		return;
+
+	if ((ifa->ifa_family == AF_INET) && (flags & IFA_F_SECONDARY))
+		return;
+
+	if ((ifa->ifa_family != AF_INET) && (ifa->ifa_scope != RT_SCOPE_LINK))
+		return;
+
+	memset(&none, 0, sizeof(none));
+
+	list_for_each_entry(vif, &vrrp_nl_vifs, list) {
+		if ((vif->ifindex != (int) ifa->ifa_index)
+		    || (vif->family != ifa->ifa_family))
+			continue;
+
+		if (nh->nlmsg_type == RTM_NEWADDR) {
+			if (memcmp(&vif->ipx, &none, addrlen) != 0)
+				continue;
+			memcpy(&vif->ipx, addr, addrlen);
+		}
+		else {	/* RTM_DELADDR */
+			if (memcmp(&vif->ipx, addr, addrlen) != 0)
+				continue;
+			memset(&vif->ipx, 0, sizeof(vif->ipx));
+
+			/* look for another primary address */
+			vrrp_nl_req.dump |= VRRP_NL_DUMP_ADDR;
+		}
+
+		if (vif->cb != NULL)
+			vif->cb(vif, VRRP_IF_ADDR, vif->data);
+	}
+}
+
+/**
+ * vrrp_nl_parse() - update cache from rtnetlink msg, replies to our
+ *                   requests and events
+ */
+static void vrrp_nl_parse(ssize_t len)
+{
+	struct nlmsghdr *nh;
+	struct nlmsgerr *err;
+
+	for (nh = (struct nlmsghdr *) vrrp_nl_buf; NLMSG_OK(nh, len);
+	     nh = NLMSG_NEXT(nh, len)) {
+
+		switch (nh->nlmsg_type) {
+		case RTM_NEWLINK:
+		case RTM_DELLINK:
+			vrrp_nl_link(nh);
+			break;
+
+		case RTM_NEWADDR:
+		case RTM_DELADDR:
+			vrrp_nl_addr(nh);
+			break;
+
+		case NLMSG_ERROR:
+			err = NLMSG_DATA(nh);
+			if (nh->nlmsg_seq == vrrp_nl_req.seq)
+				vrrp_nl_req.error = -err->error;
+			break;
+
+		default:
+			break;
+		}
+
+		/* events have a null seq */
+		if ((nh->nlmsg_seq == 0) || (nh->nlmsg_seq != vrrp_nl_req.seq))
+			continue;
+
+		if ((nh->nlmsg_type == NLMSG_DONE)
+		    || (nh->nlmsg_type == NLMSG_ERROR)
+		    || !(nh->nlmsg_flags & NLM_F_MULTI))
+			vrrp_nl_req.seq = 0;
+	}
+}
+
+/**
+ * vrrp_nl_recv() - read rtnetlink socket
+ *
+ * @return length read, -1 on error
+ */
+static ssize_t vrrp_nl_recv(int flags)
+{
+	ssize_t len;
+
+	len = recv(vrrp_nl, vrrp_nl_buf, sizeof(vrrp_nl_buf), flags);
+
+	if ((len < 0) && (errno == ENOBUFS)) {
+		/* socket overrun, events and replies are lost,
+		 * dump everything again */
+		log_notice("rtnetlink overrun, resync interfaces");
+		vrrp_nl_req.seq = 0;
+		vrrp_nl_req.dump = VRRP_NL_DUMP_LINK | VRRP_NL_DUMP_ADDR;
+		return 0;
+	}
+
+	if ((len < 0) && (errno != EINTR) && (errno != EAGAIN))
+		log_error("recv - %m");
+
+	return len;
+}
+
+/**
+ * vrrp_nl_wait() - wait for the reply of pending request
+ */
+static int vrrp_nl_wait(void)
+{
+	ssize_t len;
+
+	while (vrrp_nl_req.seq != 0) {
+		len = vrrp_nl_recv(0);
+
+		if (len > 0)
+			vrrp_nl_parse(len);
+		else if ((len < 0) && (errno != EINTR))
+			return -1;
+	}
+
+	if (vrrp_nl_req.error != 0) {
+		errno = vrrp_nl_req.error;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * vrrp_nl_vif_add() - add a VRRP interface in cache, get its ifindex,
+ *                     MTU, link state and primary address
+ *
+ * vif->ifname and vif->family must be set
+ */
+int vrrp_nl_vif_add(struct vrrp_if *vif)
+{
+	if ((vrrp_nl == -1) && (vrrp_nl_open() != 0))
+		return -1;
+
+	list_add_tail(&vif->list, &vrrp_nl_vifs);
+
+	/* previous request */
+	vrrp_nl_wait();
+
+	/* link */
+	if ((vrrp_nl_send(RTM_GETLINK, AF_UNSPEC, vif->ifname) != 0)
+	    || (vrrp_nl_wait() != 0)) {
+		log_error("%s - %m", vif->ifname);
+		goto err;
+	}
+
+	/* addresses */
+	if ((vrrp_nl_send(RTM_GETADDR, vif->family, NULL) != 0)
+	    || (vrrp_nl_wait() != 0)) {
+		log_error("%s - %m", vif->ifname);
+		goto err;
+	}
+
+	vrrp_nl_next();
+
+	return 0;
+
+ err:
+	vrrp_nl_vif_del(vif);
+	return -1;
+}
+
+/**
+ * vrrp_nl_vif_del() - remove a VRRP interface from cache
+ */
+void vrrp_nl_vif_del(struct vrrp_if *vif)
+{
+	if (list_empty(&vif->list))
+		return;
+
+	list_del_init(&vif->list);
+
+	if (list_empty(&vrrp_nl_vifs) && (vrrp_nl != -1)) {
+		close(vrrp_nl);
+		vrrp_nl = -1;
+		memset(&vrrp_nl_req, 0, sizeof(vrrp_nl_req));
+	}
+}
+
+/**
+ * vrrp_nl_fd() - rtnetlink socket to register in event loop
+ */
+int vrrp_nl_fd(void)
+{
+	return vrrp_nl;
+}
+
+/**
+ * vrrp_nl_read() - rtnetlink msg received, update cache
+ */
+void vrrp_nl_read(void)
+{
+	ssize_t len;
+
+	while ((len = vrrp_nl_recv(MSG_DONTWAIT)) >= 0) {
+		if (len > 0)
+			vrrp_nl_parse(len);
+	}
+
+	vrrp_nl_next();
+}
@@ -0,0 +1,33 @@
+/*
+ * vrrp_nl.h - rtnetlink cache of VRRP interfaces
+ *
+ * Copyright (C) 2017 Arnaud Andre 
+ *
+ * This file is part of uvrrpd.
+ *
+ * uvrrpd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * uvrrpd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with uvrrpd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _VRRP_NL_H_
+#define _VRRP_NL_H_
+
+/* from vrrp_net.h */
+struct vrrp_if;
+
+int vrrp_nl_vif_add(struct vrrp_if *vif);
+void vrrp_nl_vif_del(struct vrrp_if *vif);
+int vrrp_nl_fd(void);
+void vrrp_nl_read(void);
+
+#endif /* _VRRP_NL_H_ */
@@ -32,9 +32,15 @@
 
 /* from uvrrpd.c */
 extern int background;
+extern int tx_ring;
 extern char *loglevel;
 extern char *pidfile_name;
-extern char *ctrlfile_name;
+extern char *config_name;
+extern char *metrics_addr;
+extern char *ctrl_sock_path;
+
+/* parsing an instance from configuration file */
+static int config_line = 0;
 
 /**
  * vrrp_usage()
@@ -42,7 +48,8 @@ extern char *ctrlfile_name;
 static void vrrp_usage(void)
 {
 	fprintf(stdout,
-		"Usage: uvrrpd -v vrid -i ifname [OPTIONS] VIP1 [… VIPn]\n\n"
+		"Usage: uvrrpd -v vrid -i ifname [OPTIONS] VIP1 [… VIPn]\n"
+		"       uvrrpd -c file [OPTIONS]\n\n"
 		"Mandatory options:\n"
 		"  -v, --vrid vrid           Virtual router identifier\n"
 		"  -i, --interface iface     Interface\n"
@@ -64,12 +71,25 @@ static void vrrp_usage(void)
 		"  -6, --ipv6                IPv6 support, (only in VRRPv3)\n"
 #endif /* HAVE_IP6 */
 		"  -a, --auth pass           Simple text password (only in VRRPv2)\n"
+		"  -S, --source addr         Accept advertisements from peer 'addr' only,\n"
+		"                            may be repeated (16 peers max),\n"
+		"                            link-local address of peer in IPv6\n"
 		"  -f, --foreground          Execute uvrrpd in foreground\n"
+		"  -R, --tx-ring             Send pkt through a PACKET_MMAP TX ring\n"
 		"  -s, --script              Path of hook script (default "stringify(PATH)"/vrrp_switch.sh)\n"
+		"  -k, --script-timeout secs Kill hook script after 'secs' (default "stringify(VRRP_SCRIPT_TIMEOUT)"s,\n"
+		"                            0 never kills it)\n"
+		"  -N, --netlink             Set VMAC interface and VIPs through rtnetlink, no script\n"
 		"  -F  --pidfile name        Use alternate pid file 'name'\n"
 		"                            Default "stringify(PATHRUN)"/uvrrp_${vrid}.pid\n"
 		"  -C  --control name        Use alternate control file 'name'\n"
 		"                            Default "stringify(PATHRUN)"/uvrrpd_ctrl.${vrid}\n"
+		"  -c  --config file         Run all VRRP instances listed in 'file',\n"
+		"                            one instance per line, using options above\n"
+		"  -M  --metrics addr        Serve OpenMetrics on UNIX socket 'addr' if it\n"
+		"                            is a path, else on TCP port 'addr' of loopback\n"
+		"  -U  --ctrl-socket path    Serve control commands of all instances on\n"
+		"                            SOCK_SEQPACKET UNIX socket 'path'\n"
 		"  -d, --debug\n" "  -h, --help\n");
 }
 
@@ -79,7 +99,7 @@ static void vrrp_usage(void)
 int vrrp_options(struct vrrp *vrrp, struct vrrp_net *vnet, int argc,
 		 char *argv[])
 {
-	int optc, err;
+	int optc, err, family;
 	unsigned long opt;	/* strtoul */
 
 	static struct option const opts[] = {
@@ -96,8 +116,15 @@ int vrrp_options(struct vrrp *vrrp, struct vrrp_net *vnet, int argc,
 		{"auth", required_argument, 0, 'a'},
 		{"foreground", no_argument, 0, 'f'},
 		{"script", required_argument, 0, 's'},
+		{"script-timeout", required_argument, 0, 'k'},
+		{"netlink", no_argument, 0, 'N'},
 		{"pidfile", required_argument, 0, 'F'},
 		{"control", required_argument, 0, 'C'},
+		{"config", required_argument, 0, 'c'},
+		{"source", required_argument, 0, 'S'},
+		{"tx-ring", no_argument, 0, 'R'},
+		{"metrics", required_argument, 0, 'M'},
+		{"ctrl-socket", required_argument, 0, 'U'},
 		{"debug", no_argument, 0, 'd'},
 		{"help", no_argument, 0, 'h'},
 		{NULL, 0, 0, 0}
@@ -106,9 +133,9 @@ int vrrp_options(struct vrrp *vrrp, struct vrrp_net *vnet, int argc,
 	while ((optc =
 		getopt_long(argc, argv, 
 #ifdef HAVE_IP6
-			    "v:i:p:t:T:P:r:6a:fs:F:C:dh", 
+			    "v:i:p:t:T:P:r:6a:fs:k:NF:C:c:S:RM:U:dh", 
 #else 
-			    "v:i:p:t:T:P:r:a:fs:F:C:dh", 
+			    "v:i:p:t:T:P:r:a:fs:k:NF:C:c:S:RM:U:dh", 
 #endif /* HAVE_IP6 */			    
 			    opts,
 
@@ -268,6 +295,30 @@ int vrrp_options(struct vrrp *vrrp, struct vrrp_net *vnet, int argc,
 			}
 			break;
 
+			/* script timeout */
+		case 'k':
+			err = mystrtoul(&opt, optarg, VRRP_SCRIPT_TIMEOUT_MAX);
+			if (err == -ERANGE) {
+				fprintf(stderr, "0 <= script timeout <= %d\n",
+					VRRP_SCRIPT_TIMEOUT_MAX);
+				vrrp_usage();
+				return -1;
+			}
+			if (err == -EINVAL) {
+				fprintf(stderr,
+					"Error parsing \"%s\" as a number\n",
+					optarg);
+				vrrp_usage();
+				return err;
+			}
+			vrrp->hook.timeout = (time_t) opt;
+			break;
+
+			/* rtnetlink backend */
+		case 'N':
+			vrrp->netlink = TRUE;
+			break;
+
 			/* pidfile */
 		case 'F':
 			pidfile_name = strndup(optarg, NAME_MAX + PATH_MAX);
@@ -275,7 +326,63 @@ int vrrp_options(struct vrrp *vrrp, struct vrrp_net *vnet, int argc,
 
 			/* control file (fifo) */
 		case 'C':
-			ctrlfile_name = strndup(optarg, NAME_MAX + PATH_MAX);
+			vrrp->ctrl.name = strndup(optarg, NAME_MAX + PATH_MAX);
+			break;
+
+			/* configuration file */
+		case 'c':
+			if (config_line) {
+				fprintf(stderr,
+					"Option -c not allowed in configuration file\n");
+				return -1;
+			}
+			config_name = strndup(optarg, NAME_MAX + PATH_MAX);
+			break;
+
+			/* peer source addresses */
+		case 'S':
+			if (vnet->npeer == VRRP_PEER_MAX) {
+				fprintf(stderr, "Too many peers (%d max)\n",
+					VRRP_PEER_MAX);
+				return -1;
+			}
+			if (inet_pton(AF_INET, optarg,
+				      &vnet->peer[vnet->npeer].addr) == 1)
+				family = AF_INET;
+#ifdef HAVE_IP6
+			else if (inet_pton(AF_INET6, optarg,
+					   &vnet->peer[vnet->npeer].addr6) == 1)
+				family = AF_INET6;
+#endif /* HAVE_IP6 */
+			else {
+				fprintf(stderr, "Invalid peer address %s\n",
+					optarg);
+				vrrp_usage();
+				return -1;
+			}
+			if (vnet->npeer && (family != vnet->peer_family)) {
+				fprintf(stderr, "Peer addresses family mismatch\n");
+				return -1;
+			}
+			vnet->peer_family = family;
+			vnet->npeer++;
+			break;
+
+			/* PACKET_MMAP TX ring */
+		case 'R':
+			tx_ring = 1;
+			break;
+
+			/* OpenMetrics exporter */
+		case 'M':
+			free(metrics_addr);
+			metrics_addr = strndup(optarg, PATH_MAX);
+			break;
+
+			/* control socket */
+		case 'U':
+			free(ctrl_sock_path);
+			ctrl_sock_path = strndup(optarg, PATH_MAX);
 			break;
 
 			/* debug */
@@ -292,6 +399,17 @@ int vrrp_options(struct vrrp *vrrp, struct vrrp_net *vnet, int argc,
 		}
 	}
 
+	/* VRRP instances are read from configuration file */
+	if ((config_name != NULL) && !config_line) {
+		if (optind != argc) {
+			fprintf(stderr,
+				"VIP must be specified in configuration file\n");
+			vrrp_usage();
+			return -1;
+		}
+		return 0;
+	}
+
 	/* Fetch virtual IP addresses */
 	if (optind == argc) {
 		fprintf(stderr, "Specify at least one virtual IP addr !\n");
@@ -324,6 +442,14 @@ int vrrp_options(struct vrrp *vrrp, struct vrrp_net *vnet, int argc,
 		return -1;
 	}
 
+	if (vnet->npeer && (vnet->peer_family != vnet->family)) {
+		fprintf(stderr, "Peer addresses family mismatch\n");
+		vrrp_usage();
+		return -1;
+	}
+
+	vnet->version = vrrp->version;
+
 	/* default adv int */
 	if ((vrrp->version == RFC3768) && (vrrp->adv_int == 0))
 		vrrp->adv_int = 1;
@@ -333,3 +459,108 @@ int vrrp_options(struct vrrp *vrrp, struct vrrp_net *vnet, int argc,
 	/* Get IP addresse from interface name */
 	return vrrp_net_vif_getaddr(vnet);
 }
+
+/**
+ * vrrp_options_split() - split a configuration line in argv words
+ *
+ * @return argc, -1 on error
+ */
+static int vrrp_options_split(char *line, char ***argv)
+{
+	int argc = 1, max = 0;
+	char *saveptr = NULL;
+	char *word;
+
+	for (word = strtok_r(line, WHITESPACE, &saveptr); word != NULL;
+	     word = strtok_r(NULL, WHITESPACE, &saveptr)) {
+
+		/* keep room for progname and the last NULL elmt */
+		if (argc + 1 >= max) {
+			max += 32;
+			char **tmp = realloc(*argv, max * sizeof(char *));
+			if (tmp == NULL) {
+				perror("realloc");
+				return -1;
+			}
+			*argv = tmp;
+		}
+
+		(*argv)[argc++] = word;
+	}
+
+	if (*argv != NULL)
+		(*argv)[argc] = NULL;
+
+	return argc;
+}
+
+/**
+ * vrrp_options_config() - Read VRRP instances from configuration file
+ *
+ * Each line describes one instance, with the same syntax as the
+ * command line options. Empty lines and lines starting with '#'
+ * are ignored.
+ */
+int vrrp_options_config(struct list_head *instances, const char *filename)
+{
+	struct vrrp_instance *inst;
+	char *line = NULL;
+	char **argv = NULL;
+	size_t len = 0;
+	int argc, lineno = 0, status = 0;
+
+	FILE *fp = fopen(filename, "r");
+	if (fp == NULL) {
+		fprintf(stderr, "Error opening configuration file %s: %m\n",
+			filename);
+		return -1;
+	}
+
+	config_line = 1;
+
+	while (getline(&line, &len, fp) != -1) {
+		++lineno;
+
+		char *str = line + strspn(line, WHITESPACE);
+		if ((*str == '\0') || (*str == '#'))
+			continue;
+
+		argc = vrrp_options_split(str, &argv);
+		if (argc < 0) {
+			status = -1;
+			break;
+		}
+
+		inst = vrrp_instance_new();
+		if (inst == NULL) {
+			status = -1;
+			break;
+		}
+
+		list_add_tail(&inst->list, instances);
+
+		/* reset getopt */
+		argv[0] = "uvrrpd";
+		optind = 0;
+
+		if (vrrp_options(&inst->vrrp, &inst->vnet, argc, argv) != 0) {
+			fprintf(stderr, "%s:%d: invalid VRRP instance\n",
+				filename, lineno);
+			status = -1;
+			break;
+		}
+	}
+
+	if ((status == 0) && list_empty(instances)) {
+		fprintf(stderr, "%s: no VRRP instance found\n", filename);
+		status = -1;
+	}
+
+	config_line = 0;
+
+	free(argv);
+	free(line);
+	fclose(fp);
+
+	return status;
+}
@@ -24,5 +24,6 @@
 
 int vrrp_options(struct vrrp *vrrp, struct vrrp_net *vnet, int argc,
 		 char *argv[]);
+int vrrp_options_config(struct list_head *instances, const char *filename);
 
 #endif /* _VRRP_OPTIONS_H_ */
@@ -0,0 +1,60 @@
+/*
+ * vrrp_probe.h - USDT static tracepoints
+ *
+ * Copyright (C) 2017 Arnaud Andre 
+ *
+ * This file is part of uvrrpd.
+ *
+ * uvrrpd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * uvrrpd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with uvrrpd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _VRRP_PROBE_H_
+#define _VRRP_PROBE_H_
+
+/**
+ * VRRP_PROBEn() - USDT static tracepoint of provider uvrrpd
+ *
+ * With <sys/sdt.h> (systemtap-sdt-dev), a probe is a single nop and
+ * a note in the binary, a tracer (bpftrace, perf, stap) may attach
+ * to it at run-time:
+ *
+ *   bpftrace -e 'usdt:/usr/sbin/uvrrpd:uvrrpd:state_change
+ *                { printf("vrid %d %d -> %d\n", arg0, arg1, arg2); }'
+ *
+ * Without it, or with ./configure --disable-usdt, probes compile
+ * to nothing. Arguments must be integers or pointers.
+ */
+#ifdef HAVE_SYS_SDT_H
+
+#include <sys/sdt.h>
+
+#define VRRP_PROBE0(name)		DTRACE_PROBE(uvrrpd, name)
+#define VRRP_PROBE1(name, a)		DTRACE_PROBE1(uvrrpd, name, a)
+#define VRRP_PROBE2(name, a, b)		DTRACE_PROBE2(uvrrpd, name, a, b)
+#define VRRP_PROBE3(name, a, b, c)	DTRACE_PROBE3(uvrrpd, name, a, b, c)
+#define VRRP_PROBE4(name, a, b, c, d)	\
+	DTRACE_PROBE4(uvrrpd, name, a, b, c, d)
+
+#else
+
+#define VRRP_PROBE0(name)		do { } while (0)
+#define VRRP_PROBE1(name, a)		do { } while (0)
+#define VRRP_PROBE2(name, a, b)		do { } while (0)
+#define VRRP_PROBE3(name, a, b, c)	do { } while (0)
+#define VRRP_PROBE4(name, a, b, c, d)	do { } while (0)
+
+#endif /* HAVE_SYS_SDT_H */
+
+#endif /* _VRRP_PROBE_H_ */
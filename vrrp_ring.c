@@ -0,0 +1,254 @@
+/*
+ * vrrp_ring.c - PACKET_MMAP TX ring of xmit socket
+ *
+ * Copyright (C) 2017 Arnaud Andre 
+ *
+ * This file is part of uvrrpd.
+ *
+ * uvrrpd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * uvrrpd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with uvrrpd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Frames are written in the mmap'ed ring shared with the kernel, then
+ * a single send() asks the kernel to transmit all pending frames.
+ *
+ * Kernel transmits frames in ring order from its own head, and stops
+ * on the first frame which is not ready, so frames can't be pinned in
+ * a slot: each frame is copied in the next slot, and vrrp_ring keeps
+ * track of the kernel head.
+ *
+ * Once a TX ring is set, every send() on the socket goes through it, so
+ * the ring has its own socket and the plain xmit socket is kept for
+ * frames which don't fit in a slot.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include "vrrp_ring.h"
+#include "log.h"
+
+/* ring geometry, 256 frames of 2 KiB, enough for a burst of VIP_MAX
+ * topology pkt plus an advertisement */
+#define RING_FRAME_SIZE		2048
+#define RING_BLOCK_SIZE		(8 * RING_FRAME_SIZE)
+#define RING_FRAME_NR		256
+
+/* TPACKET_V2 frame data offset, without PACKET_TX_HAS_OFF */
+#define RING_DATA_OFFSET	TPACKET_ALIGN(sizeof(struct tpacket2_hdr))
+
+/**
+ * struct vrrp_ring - TX ring state
+ *
+ * @fd AF_PACKET socket of the ring
+ * @map mmap'ed ring, NULL if disabled
+ * @head next frame to fill, kernel head after a flush
+ * @queued frames filled since last flush
+ */
+static struct vrrp_ring {
+	int fd;
+	unsigned char *map;
+	unsigned int head;
+	unsigned int queued;
+} ring = {.fd = -1,.map = NULL };
+
+/**
+ * vrrp_ring_frame() - get frame header of slot @i
+ */
+static inline struct tpacket2_hdr *vrrp_ring_frame(unsigned int i)
+{
+	return (struct tpacket2_hdr *) (ring.map + (i % RING_FRAME_NR)
+					* RING_FRAME_SIZE);
+}
+
+/**
+ * vrrp_ring_init() - open xmit socket with a TX ring
+ *
+ * @return 0 if success, -1 else
+ */
+int vrrp_ring_init(void)
+{
+	struct tpacket_req req;
+	int version = TPACKET_V2;
+	int loss = 1;
+
+	/* xmit only, no protocol to receive */
+	ring.fd = socket(AF_PACKET, SOCK_RAW, 0);
+
+	if (ring.fd < 0) {
+		log_error("socket TX ring - %m");
+		return -1;
+	}
+
+	if (setsockopt(ring.fd, SOL_PACKET, PACKET_VERSION, &version,
+		       sizeof(version)) < 0) {
+		log_error("setsockopt PACKET_VERSION - %m");
+		goto err;
+	}
+
+	/* skip malformed frames instead of stopping on them */
+	if (setsockopt(ring.fd, SOL_PACKET, PACKET_LOSS, &loss,
+		       sizeof(loss)) < 0) {
+		log_error("setsockopt PACKET_LOSS - %m");
+		goto err;
+	}
+
+	req.tp_block_size = RING_BLOCK_SIZE;
+	req.tp_frame_size = RING_FRAME_SIZE;
+	req.tp_block_nr = RING_FRAME_NR * RING_FRAME_SIZE / RING_BLOCK_SIZE;
+	req.tp_frame_nr = RING_FRAME_NR;
+
+	if (setsockopt(ring.fd, SOL_PACKET, PACKET_TX_RING, &req,
+		       sizeof(req)) < 0) {
+		log_error("setsockopt PACKET_TX_RING - %m");
+		goto err;
+	}
+
+	ring.map = mmap(NULL, RING_FRAME_NR * RING_FRAME_SIZE,
+			PROT_READ | PROT_WRITE, MAP_SHARED, ring.fd, 0);
+
+	if (ring.map == MAP_FAILED) {
+		log_error("mmap - %m");
+		ring.map = NULL;
+		goto err;
+	}
+
+	ring.head = 0;
+	ring.queued = 0;
+
+	return 0;
+
+ err:
+	close(ring.fd);
+	ring.fd = -1;
+	return -1;
+}
+
+/**
+ * vrrp_ring_cleanup() - unmap TX ring and close its socket
+ */
+void vrrp_ring_cleanup(void)
+{
+	if (ring.map != NULL)
+		munmap(ring.map, RING_FRAME_NR * RING_FRAME_SIZE);
+
+	if (ring.fd != -1)
+		close(ring.fd);
+
+	ring.map = NULL;
+	ring.fd = -1;
+}
+
+/**
+ * vrrp_ring_enabled() - TX ring is used ?
+ */
+int vrrp_ring_enabled(void)
+{
+	return (ring.map != NULL);
+}
+
+/**
+ * vrrp_ring_queue() - copy a frame in the next slot of TX ring
+ *
+ * @return 0 if success, -1 if frame doesn't fit in a slot or
+ *         ring is full
+ */
+int vrrp_ring_queue(const struct iovec *iov, size_t len)
+{
+	struct tpacket2_hdr *hdr;
+	unsigned char *data;
+	size_t i, size = 0;
+
+	for (i = 0; i < len; ++i)
+		size += iov[i].iov_len;
+
+	if ((size > RING_FRAME_SIZE - RING_DATA_OFFSET)
+	    || (ring.queued == RING_FRAME_NR))
+		return -1;
+
+	hdr = vrrp_ring_frame(ring.head + ring.queued);
+
+	if (hdr->tp_status != TP_STATUS_AVAILABLE)
+		return -1;
+
+	data = (unsigned char *) hdr + RING_DATA_OFFSET;
+	for (i = 0; i < len; ++i) {
+		memcpy(data, iov[i].iov_base, iov[i].iov_len);
+		data += iov[i].iov_len;
+	}
+
+	hdr->tp_len = size;
+
+	/* frame must be written before kernel sees its status */
+	__sync_synchronize();
+	hdr->tp_status = TP_STATUS_SEND_REQUEST;
+
+	ring.queued++;
+
+	return 0;
+}
+
+/**
+ * vrrp_ring_flush() - transmit frames queued since last flush
+ *
+ * @device destination interface of all queued frames
+ * @status if not NULL, filled with 0 for each frame sent, -1 else
+ * @return count of frames sent
+ */
+int vrrp_ring_flush(const struct sockaddr_ll *device, int *status)
+{
+	struct tpacket2_hdr *hdr;
+	unsigned int i, queued = ring.queued, consumed = ring.queued;
+	int sent = 0;
+
+	if (queued == 0)
+		return 0;
+
+	/* blocking send, return once all frames are processed */
+	if (sendto(ring.fd, NULL, 0, 0, (const struct sockaddr *) device,
+		   sizeof(struct sockaddr_ll)) < 0)
+		log_error("sendto TX ring - %m");
+
+	for (i = 0; i < queued; ++i) {
+		hdr = vrrp_ring_frame(ring.head + i);
+		__sync_synchronize();
+
+		if (hdr->tp_status == TP_STATUS_AVAILABLE) {
+			sent++;
+			if (status != NULL)
+				status[i] = 0;
+			continue;
+		}
+
+		if (status != NULL)
+			status[i] = -1;
+
+		/* kernel head stops on the first frame not consumed */
+		if ((hdr->tp_status == TP_STATUS_SEND_REQUEST)
+		    && (consumed == queued))
+			consumed = i;
+
+		/* frame still being sent belongs to kernel */
+		if (hdr->tp_status != TP_STATUS_SENDING)
+			hdr->tp_status = TP_STATUS_AVAILABLE;
+	}
+
+	ring.head = (ring.head + consumed) % RING_FRAME_NR;
+	ring.queued = 0;
+
+	return sent;
+}
@@ -0,0 +1,34 @@
+/*
+ * vrrp_ring.h - PACKET_MMAP TX ring of xmit socket
+ *
+ * Copyright (C) 2017 Arnaud Andre 
+ *
+ * This file is part of uvrrpd.
+ *
+ * uvrrpd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * uvrrpd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with uvrrpd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _VRRP_RING_H_
+#define _VRRP_RING_H_
+
+#include <sys/uio.h>
+#include <linux/if_packet.h>
+
+int vrrp_ring_init(void);
+void vrrp_ring_cleanup(void);
+int vrrp_ring_enabled(void);
+int vrrp_ring_queue(const struct iovec *iov, size_t len);
+int vrrp_ring_flush(const struct sockaddr_ll *device, int *status);
+
+#endif /* _VRRP_RING_H_ */
@@ -27,19 +27,32 @@
 #include "vrrp_arp.h"
 #include "vrrp_na.h"
 #include "vrrp_exec.h"
+#include "vrrp_probe.h"
+#include "vrrp_ctrl_sock.h"
 
 #include "log.h"
 #include "bits.h"
 #include "uvrrpd.h"
 
-extern unsigned long reg;
-
 /**
  * switching state functions
  */
 static int vrrp_state_goto_master(struct vrrp *vrrp, struct vrrp_net *vnet);
 static int vrrp_state_goto_backup(struct vrrp *vrrp, struct vrrp_net *vnet);
 
+/**
+ * vrrp_state_set() - switch instance to state, account transition
+ */
+static inline void vrrp_state_set(struct vrrp *vrrp, struct vrrp_net *vnet,
+				  vrrp_state state)
+{
+	VRRP_PROBE3(state_change, vrrp->vrid, vrrp->state, state);
+	vrrp_timeline_begin(&vrrp->timeline, vrrp->state, state);
+	vrrp_ctrl_sock_event(vrrp, vnet, vrrp->state, state);
+	vrrp->state = state;
+	vrrp_stats_state(vnet, state);
+}
+
 /**
  * vrrp_state_init() - Initial state of VRRP instance
  *
@@ -69,13 +82,12 @@ int vrrp_state_init(struct vrrp *vrrp, struct vrrp_net *vnet)
 /**
  * vrrp_state_backup() - handle backup state
  */
-int vrrp_state_backup(struct vrrp *vrrp, struct vrrp_net *vnet)
+int vrrp_state_backup(struct vrrp *vrrp, struct vrrp_net *vnet,
+		      vrrp_event_t event)
 {
-	int event = vrrp_listen(vrrp, vnet);
-	char straddr[INET6_ADDRSTRLEN];
-
 	switch (event) {
 	case TIMER:	/* TIMER expired */
+		vrrp_timeline_trigger(&vrrp->timeline);
 		log_notice("vrid %d :: %s", vrrp->vrid,
 			   "masterdown_timer expired");
 
@@ -139,11 +151,17 @@ int vrrp_state_backup(struct vrrp *vrrp, struct vrrp_net *vnet)
 		log_debug("vrid %d :: signal", vrrp->vrid);
 	case CTRL_FIFO:
 		/* shutdown/reload event ? */
-		if (test_and_clear_bit(UVRRPD_RELOAD, &reg)) {
+		if (test_and_clear_bit(UVRRPD_RELOAD, &vrrp->reg)) {
 			vrrp_timer_clear(&vrrp->masterdown_timer);
-			vrrp->state = INIT;
+			vrrp_state_set(vrrp, vnet, INIT);
+			break;
 		}
 
+		/* configuration changed in place, the new priority and
+		 * preempt mode apply to the next adv received */
+		clear_bit(UVRRPD_RECONF, &vrrp->reg);
+		clear_bit(UVRRPD_RECONF_VIP, &vrrp->reg);
+
 		break;
 
 	case VRID_MISMATCH:
@@ -151,10 +169,7 @@ int vrrp_state_backup(struct vrrp *vrrp, struct vrrp_net *vnet)
 		break;
 
 	case INVALID:
-		log_warning("vrid %d :: %s %s, %s", vrrp->vrid,
-			    "receive an invalid advertisement packet from",
-			    vrrp_adv_addr_to_str(vnet, straddr), "ignore it");
-
+		/* already logged, rate limited by source */
 		break;
 
 	default:
@@ -166,12 +181,48 @@ int vrrp_state_backup(struct vrrp *vrrp, struct vrrp_net *vnet)
 	return event;
 }
 
+/**
+ * vrrp_state_master_reconf() - apply a configuration changed in place,
+ *                              staying master
+ *
+ * Advertise the new priority or interval at once. As in RFC5798, a
+ * master never resigns on its own priority change: a backup with
+ * preempt on and a greater priority discards our adv and takes over
+ * when its Master_Down_Timer expires.
+ */
+static void vrrp_state_master_reconf(struct vrrp *vrrp, struct vrrp_net *vnet)
+{
+	int reconf, vip;
+
+	reconf = test_and_clear_bit(UVRRPD_RECONF, &vrrp->reg);
+	vip = test_and_clear_bit(UVRRPD_RECONF_VIP, &vrrp->reg);
+
+	if (!reconf && !vip)
+		return;
+
+	vrrp->master_adv_int = vrrp->adv_int;
+
+	vrrp_adv_send(vnet);
+	VRRP_SET_ADV_TIMER(vrrp);
+
+	if (!vip)
+		return;
+
+	/* announce VIPs, an added one included */
+	if (vnet->family == AF_INET)
+		vrrp_arp_send(vnet);
+#ifdef HAVE_IP6
+	else if (vnet->family == AF_INET6)
+		vrrp_na_send(vnet);
+#endif /* HAVE_IP6 */
+}
+
 /**
  * vrrp_state_master() - handle master state
  */
-int vrrp_state_master(struct vrrp *vrrp, struct vrrp_net *vnet)
+int vrrp_state_master(struct vrrp *vrrp, struct vrrp_net *vnet,
+		      vrrp_event_t event)
 {
-	int event = vrrp_listen(vrrp, vnet);
 
 	switch (event) {
 	case TIMER:	/* TIMER expired */
@@ -251,14 +302,18 @@ int vrrp_state_master(struct vrrp *vrrp, struct vrrp_net *vnet)
 	case CTRL_FIFO:
 
 		/* shutdown/reload event ? */
-		if (test_and_clear_bit(UVRRPD_RELOAD, &reg)) {
+		if (test_and_clear_bit(UVRRPD_RELOAD, &vrrp->reg)) {
 			vrrp_timer_clear(&vrrp->adv_timer);
 			vrrp_adv_send_zero(vnet);
 			/* berk */
 			vrrp_exec(vrrp, vnet, BACKUP);
-			vrrp->state = INIT;
+			vrrp_state_set(vrrp, vnet, INIT);
+			break;
 		}
 
+		/* configuration changed in place */
+		vrrp_state_master_reconf(vrrp, vnet);
+
 		break;
 
 	case VRID_MISMATCH:
@@ -266,7 +321,7 @@ int vrrp_state_master(struct vrrp *vrrp, struct vrrp_net *vnet)
 		break;
 
 	case INVALID:
-		log_warning("vrid %d :: invalid event", vrrp->vrid);
+		/* already logged, rate limited by source */
 		break;
 
 	default:
@@ -287,9 +342,10 @@ static int vrrp_state_goto_master(struct vrrp *vrrp, struct vrrp_net *vnet)
 	log_notice("vrid %d :: %s -> %s", vrrp->vrid,
 		   STR_STATE(vrrp->state), "master");
 
-	vrrp->state = MASTER;
+	vrrp_state_set(vrrp, vnet, MASTER);
 
 	vrrp_adv_send(vnet);
+	vrrp_timeline_step(&vrrp->timeline, VRRP_TL_ADV);
 
 	if (vnet->family == AF_INET)
 		vrrp_arp_send(vnet);
@@ -297,9 +353,11 @@ static int vrrp_state_goto_master(struct vrrp *vrrp, struct vrrp_net *vnet)
 	else if (vnet->family == AF_INET6)
 		vrrp_na_send(vnet);
 #endif /* HAVE_IP6 */
+	vrrp_timeline_step(&vrrp->timeline, VRRP_TL_TOPOLOGY);
 
 	/* script */
 	vrrp_exec(vrrp, vnet, vrrp->state);
+	vrrp_timeline_step(&vrrp->timeline, VRRP_TL_HOOK);
 
 	/* reset masterdown_timer && set ADV timer */
 	vrrp_timer_clear(&vrrp->masterdown_timer);
@@ -318,13 +376,15 @@ static int vrrp_state_goto_backup(struct vrrp *vrrp, struct vrrp_net *vnet)
 		   STR_STATE(vrrp->state), "backup");
 
 	int previous_state = vrrp->state;
-	vrrp->state = BACKUP;
+	vrrp_state_set(vrrp, vnet, BACKUP);
 
 	log_debug("%s:%s", STR_STATE(previous_state), STR_STATE(vrrp->state));
 
 	/* script */
-	if (previous_state != INIT)
+	if (previous_state != INIT) {
 		vrrp_exec(vrrp, vnet, vrrp->state);
+		vrrp_timeline_step(&vrrp->timeline, VRRP_TL_HOOK);
+	}
 
 	/* RFC5798, use of master_adv_int */
 	if (vrrp->version == RFC5798) {
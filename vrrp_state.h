@@ -36,7 +36,9 @@ typedef enum {
                      ((s == BACKUP) ? "backup" : "master"))
 
 int vrrp_state_init(struct vrrp *vrrp, struct vrrp_net *vnet);
-int vrrp_state_master(struct vrrp *vrrp, struct vrrp_net *vnet);
-int vrrp_state_backup(struct vrrp *vrrp, struct vrrp_net *vnet);
+int vrrp_state_master(struct vrrp *vrrp, struct vrrp_net *vnet,
+		      vrrp_event_t event);
+int vrrp_state_backup(struct vrrp *vrrp, struct vrrp_net *vnet,
+		      vrrp_event_t event);
 
 #endif /* _VRRP_STATE_H_ */
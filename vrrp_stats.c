@@ -0,0 +1,312 @@
+/*
+ * vrrp_stats.c - shared memory statistics page
+ *
+ * Each instance maps a page under PATHRUN so external monitors read its
+ * counters without any syscall into uvrrpd.
+ *
+ * Copyright (C) 2017 Arnaud Andre 
+ *
+ * This file is part of uvrrpd.
+ *
+ * uvrrpd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * uvrrpd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with uvrrpd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "vrrp.h"
+#include "vrrp_stats.h"
+#include "log.h"
+
+/* vrrp_stats_invalid names */
+const char *const vrrp_stats_invalid_str[VRRP_INVALID_MAX] = {
+	"len", "proto", "version", "ttl", "checksum", "owner", "auth", "vip",
+	"advint", "flood"
+};
+
+/* 10ms to 10s, finer around the default 1s advert interval */
+const uint64_t vrrp_stats_bounds[VRRP_STATS_BUCKETS] = {
+	10000000, 25000000, 50000000, 100000000, 250000000, 500000000,
+	1000000000, 1100000000, 1500000000, 2000000000, 3000000000,
+	5000000000, 10000000000
+};
+
+/**
+ * vrrp_stats_now() - CLOCK_MONOTONIC time in ns
+ */
+uint64_t vrrp_stats_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * vrrp_stats_begin() - enter seqlock write section
+ */
+static inline void vrrp_stats_begin(struct vrrp_stats *stats)
+{
+	__atomic_store_n(&stats->seq, stats->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/**
+ * vrrp_stats_end() - leave seqlock write section
+ */
+static inline void vrrp_stats_end(struct vrrp_stats *stats)
+{
+	__atomic_store_n(&stats->seq, stats->seq + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * vrrp_stats_hist() - account a duration of ns in histogram of
+ *                     upper bounds bounds[VRRP_STATS_BUCKETS]
+ */
+void vrrp_stats_hist(struct vrrp_stats_hist *hist, const uint64_t *bounds,
+		     uint64_t ns)
+{
+	int i;
+
+	for (i = 0; (i < VRRP_STATS_BUCKETS) && (ns > bounds[i]); ++i);
+
+	vrrp_stats_inc(&hist->bucket[i]);
+	__atomic_store_n(&hist->sum, hist->sum + ns, __ATOMIC_RELAXED);
+}
+
+/**
+ * vrrp_stats_addr() - copy address of vnet family in stats
+ */
+static void vrrp_stats_addr(struct vrrp_stats *stats,
+			    const union vrrp_ipx_addr *addr)
+{
+#ifdef HAVE_IP6
+	if (stats->family == AF_INET6) {
+		memcpy(stats->master, &addr->addr6, sizeof(addr->addr6));
+		return;
+	}
+#endif /* HAVE_IP6 */
+	memcpy(stats->master, &addr->addr, sizeof(addr->addr));
+}
+
+/**
+ * vrrp_stats_init() - map statistics page of VRRP instance from file
+ *                     named after its control fifo
+ *
+ * If the file can't be mapped, statistics are kept in a private page
+ */
+int vrrp_stats_init(struct vrrp_net *vnet, const char *ctrl_name)
+{
+	struct vrrp_stats *stats = MAP_FAILED;
+	size_t len = strlen(ctrl_name) + sizeof(VRRP_STATS_SUFFIX);
+	int fd;
+
+	vnet->stats_name = malloc(len);
+	if (vnet->stats_name == NULL) {
+		log_error("vrid %d :: malloc - %m", vnet->vrid);
+		return -1;
+	}
+
+	snprintf(vnet->stats_name, len, "%s" VRRP_STATS_SUFFIX, ctrl_name);
+
+	unlink(vnet->stats_name);
+	fd = open(vnet->stats_name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+		  0644);
+
+	if (fd == -1)
+		log_error("vrid %d :: open %s - %m", vnet->vrid,
+			  vnet->stats_name);
+	else if (ftruncate(fd, sizeof(struct vrrp_stats)) != 0)
+		log_error("vrid %d :: ftruncate %s - %m", vnet->vrid,
+			  vnet->stats_name);
+	else {
+		stats = mmap(NULL, sizeof(struct vrrp_stats),
+			     PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (stats == MAP_FAILED)
+			log_error("vrid %d :: mmap %s - %m", vnet->vrid,
+				  vnet->stats_name);
+	}
+
+	if (fd != -1)
+		close(fd);
+
+	if (stats == MAP_FAILED) {
+		log_warning("vrid %d :: statistics not shared", vnet->vrid);
+
+		if (fd != -1)
+			unlink(vnet->stats_name);
+		free(vnet->stats_name);
+		vnet->stats_name = NULL;
+
+		stats = mmap(NULL, sizeof(struct vrrp_stats),
+			     PROT_READ | PROT_WRITE,
+			     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (stats == MAP_FAILED) {
+			log_error("vrid %d :: mmap - %m", vnet->vrid);
+			return -1;
+		}
+	}
+
+	stats->version = VRRP_STATS_VERSION;
+	stats->vrid = vnet->vrid;
+	stats->family = vnet->family;
+	stats->state = INIT;
+	stats->state_since = vrrp_stats_now();
+
+	/* page is valid once magic is set */
+	__atomic_store_n(&stats->magic, VRRP_STATS_MAGIC, __ATOMIC_RELEASE);
+
+	vnet->stats = stats;
+
+	return 0;
+}
+
+/**
+ * vrrp_stats_state() - account state transition
+ */
+void vrrp_stats_state(struct vrrp_net *vnet, int state)
+{
+	struct vrrp_stats *stats = vnet->stats;
+	uint64_t now = vrrp_stats_now();
+
+	vrrp_stats_begin(stats);
+
+	/* previous master was lost */
+	if ((state == MASTER) && (stats->state == BACKUP)
+	    && (stats->adv_last != 0))
+		vrrp_stats_hist(&stats->failover, vrrp_stats_bounds,
+				now - stats->adv_last);
+
+	/* no advert to wait for, next interval starts from scratch */
+	if (state != BACKUP)
+		__atomic_store_n(&stats->adv_last, 0, __ATOMIC_RELAXED);
+
+	stats->state_time[stats->state] += now - stats->state_since;
+	stats->state_since = now;
+	stats->state = state;
+	++stats->transitions;
+
+	/* we are the master now */
+	if (state == MASTER)
+		vrrp_stats_addr(stats, &vnet->vif.ipx);
+
+	vrrp_stats_end(stats);
+}
+
+/**
+ * vrrp_stats_recv() - account valid advert sent by master addr
+ */
+void vrrp_stats_recv(struct vrrp_net *vnet, const union vrrp_ipx_addr *addr)
+{
+	struct vrrp_stats *stats = vnet->stats;
+	struct vrrp_stats tmp;
+	uint64_t now = vrrp_stats_now();
+
+	vrrp_stats_inc(&stats->adv_recv);
+
+	if (stats->adv_last != 0)
+		vrrp_stats_hist(&stats->adv_interval, vrrp_stats_bounds,
+				now - stats->adv_last);
+	__atomic_store_n(&stats->adv_last, now, __ATOMIC_RELAXED);
+
+	/* adverts of the same master, nothing to write */
+	tmp.family = stats->family;
+	memset(tmp.master, 0, sizeof(tmp.master));
+	vrrp_stats_addr(&tmp, addr);
+
+	if (memcmp(tmp.master, stats->master, sizeof(tmp.master)) == 0)
+		return;
+
+	vrrp_stats_begin(stats);
+	memcpy(stats->master, tmp.master, sizeof(tmp.master));
+	vrrp_stats_end(stats);
+}
+
+/**
+ * vrrp_stats_snapshot() - read a consistent copy of statistics page
+ *
+ * Counters are read one by one, fields protected by seqlock are
+ * read all together.
+ */
+void vrrp_stats_snapshot(const struct vrrp_stats *stats,
+			 struct vrrp_stats *snap)
+{
+	uint32_t seq;
+	int i;
+
+	snap->magic = __atomic_load_n(&stats->magic, __ATOMIC_ACQUIRE);
+	snap->version = stats->version;
+	snap->vrid = stats->vrid;
+	snap->family = stats->family;
+
+	snap->adv_sent = __atomic_load_n(&stats->adv_sent, __ATOMIC_RELAXED);
+	snap->adv_recv = __atomic_load_n(&stats->adv_recv, __ATOMIC_RELAXED);
+	for (i = 0; i < VRRP_INVALID_MAX; ++i)
+		snap->invalid[i] =
+		    __atomic_load_n(&stats->invalid[i], __ATOMIC_RELAXED);
+	for (i = 0; i <= VRRP_STATS_BUCKETS; ++i) {
+		snap->adv_interval.bucket[i] =
+		    __atomic_load_n(&stats->adv_interval.bucket[i],
+				    __ATOMIC_RELAXED);
+		snap->failover.bucket[i] =
+		    __atomic_load_n(&stats->failover.bucket[i],
+				    __ATOMIC_RELAXED);
+	}
+	snap->adv_interval.sum =
+	    __atomic_load_n(&stats->adv_interval.sum, __ATOMIC_RELAXED);
+	snap->failover.sum =
+	    __atomic_load_n(&stats->failover.sum, __ATOMIC_RELAXED);
+	snap->adv_last = __atomic_load_n(&stats->adv_last, __ATOMIC_RELAXED);
+
+	do {
+		seq = __atomic_load_n(&stats->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+
+		snap->state = stats->state;
+		snap->transitions = stats->transitions;
+		snap->state_since = stats->state_since;
+		memcpy(snap->state_time, stats->state_time,
+		       sizeof(snap->state_time));
+		memcpy(snap->master, stats->master, sizeof(snap->master));
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((seq & 1)
+		 || (__atomic_load_n(&stats->seq, __ATOMIC_RELAXED) != seq));
+
+	snap->seq = seq;
+}
+
+/**
+ * vrrp_stats_cleanup() - unmap statistics page and remove its file
+ */
+void vrrp_stats_cleanup(struct vrrp_net *vnet)
+{
+	if (vnet->stats != NULL)
+		munmap(vnet->stats, sizeof(struct vrrp_stats));
+
+	if (vnet->stats_name != NULL) {
+		unlink(vnet->stats_name);
+		free(vnet->stats_name);
+	}
+
+	vnet->stats = NULL;
+	vnet->stats_name = NULL;
+}
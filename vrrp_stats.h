@@ -0,0 +1,134 @@
+/*
+ * vrrp_stats.h - shared memory statistics page
+ *
+ * Copyright (C) 2017 Arnaud Andre 
+ *
+ * This file is part of uvrrpd.
+ *
+ * uvrrpd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * uvrrpd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with uvrrpd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _VRRP_STATS_H_
+#define _VRRP_STATS_H_
+
+#include <stdint.h>
+
+/* from vrrp_net.h */
+struct vrrp_net;
+union vrrp_ipx_addr;
+
+#define VRRP_STATS_MAGIC	0x76727270	/* "vrrp" */
+#define VRRP_STATS_VERSION	3
+
+/* suffix appended to control fifo name to get stats file name */
+#define VRRP_STATS_SUFFIX	".stats"
+
+/**
+ * enum vrrp_stats_invalid - reasons for dropping a received adv
+ */
+enum vrrp_stats_invalid {
+	VRRP_INVALID_LEN,	/* pkt len or VRRP pkt size */
+	VRRP_INVALID_PROTO,	/* IP proto isn't VRRP */
+	VRRP_INVALID_VERSION,	/* VRRP version mismatch */
+	VRRP_INVALID_TTL,	/* TTL isn't 255 */
+	VRRP_INVALID_CHKSUM,	/* bad checksum */
+	VRRP_INVALID_OWNER,	/* adv received while IP address owner */
+	VRRP_INVALID_AUTH,	/* auth type or password mismatch */
+	VRRP_INVALID_VIP,	/* IP address(es) mismatch */
+	VRRP_INVALID_ADVINT,	/* advert interval mismatch */
+	VRRP_INVALID_FLOOD,	/* source blocked, see vrrp_flood.c */
+	VRRP_INVALID_MAX
+};
+
+extern const char *const vrrp_stats_invalid_str[VRRP_INVALID_MAX];
+
+/* histogram buckets, upper bounds in vrrp_stats_bounds[] */
+#define VRRP_STATS_BUCKETS	13
+
+/**
+ * struct vrrp_stats_hist - histogram of durations
+ * @bucket: count of durations in ]bound[i - 1], bound[i]], last
+ *          bucket is +Inf
+ * @sum: sum of durations, ns
+ */
+struct vrrp_stats_hist {
+	uint64_t bucket[VRRP_STATS_BUCKETS + 1];
+	uint64_t sum;
+};
+
+extern const uint64_t vrrp_stats_bounds[VRRP_STATS_BUCKETS];
+
+/**
+ * struct vrrp_stats - statistics of a VRRP instance, mapped from a
+ *                     file by uvrrpd and external monitors
+ *
+ * Counters are written by uvrrpd alone with relaxed atomic stores,
+ * each one can be read at any time with a relaxed atomic load.
+ *
+ * Fields below @seq form a snapshot, protected by @seq seqlock:
+ * @seq is odd while uvrrpd updates them. A reader copies them between
+ * two reads of @seq, and retries if @seq was odd or changed, see
+ * vrrp_stats_snapshot().
+ *
+ * Times are CLOCK_MONOTONIC ns. Time spent in current state is
+ * now - @state_since, not accounted in @state_time.
+ *
+ * @adv_interval is the inter-arrival time of valid adverts, @failover
+ * the time from the last advert of the previous master to the
+ * transition of this instance to master.
+ */
+struct vrrp_stats {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vrid;
+	uint32_t family;
+
+	/* counters */
+	uint64_t adv_sent;
+	uint64_t adv_recv;
+	uint64_t invalid[VRRP_INVALID_MAX];
+	struct vrrp_stats_hist adv_interval;
+	struct vrrp_stats_hist failover;
+	uint64_t adv_last;	/* last valid advert, 0 if none */
+
+	/* snapshot */
+	uint32_t seq;
+	uint32_t state;
+	uint64_t transitions;
+	uint64_t state_since;
+	uint64_t state_time[3];
+	uint8_t master[16];	/* last master address */
+};
+
+/**
+ * vrrp_stats_inc() - increment a counter, single writer
+ */
+static inline void vrrp_stats_inc(uint64_t *counter)
+{
+	__atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED)
+			 + 1, __ATOMIC_RELAXED);
+}
+
+uint64_t vrrp_stats_now(void);
+void vrrp_stats_hist(struct vrrp_stats_hist *hist, const uint64_t *bounds,
+		     uint64_t ns);
+int vrrp_stats_init(struct vrrp_net *vnet, const char *ctrl_name);
+void vrrp_stats_state(struct vrrp_net *vnet, int state);
+void vrrp_stats_recv(struct vrrp_net *vnet, const union vrrp_ipx_addr *addr);
+void vrrp_stats_snapshot(const struct vrrp_stats *stats,
+			 struct vrrp_stats *snap);
+void vrrp_stats_cleanup(struct vrrp_net *vnet);
+
+#endif /* _VRRP_STATS_H_ */
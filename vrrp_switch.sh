@@ -59,6 +59,14 @@ case "$state" in
 
         IFS=$OIFS
 
+        # run again after a VIP removed while master
+        for cur in $(ip -$family -o addr show dev $interface scope global | awk '{ print $4 }'); do
+            case ",$ips," in
+                *",${cur%/*},"*) ;;
+                *) ip -$family addr del $cur dev $interface ;;
+            esac
+        done
+
         ;;
 
     "backup" )
@@ -0,0 +1,174 @@
+/*
+ * vrrp_timeline.c - timestamps of the steps of state transitions
+ *
+ * Copyright (C) 2017 Arnaud Andre 
+ *
+ * This file is part of uvrrpd.
+ *
+ * uvrrpd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * uvrrpd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with uvrrpd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "vrrp.h"
+#include "vrrp_timeline.h"
+#include "log.h"
+
+/* vrrp_timeline_step names */
+const char *const vrrp_timeline_steps[VRRP_TL_MAX] = {
+	"trigger", "adv", "topology", "hook", "hook_done"
+};
+
+/* 10us to 10s, pkt are sent within microseconds, hooks take longer */
+const uint64_t vrrp_timeline_bounds[VRRP_STATS_BUCKETS] = {
+	10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000,
+	5000000, 10000000, 100000000, 1000000000, 10000000000
+};
+
+/**
+ * vrrp_timeline_init() - empty timeline
+ */
+void vrrp_timeline_init(struct vrrp_timeline *tl)
+{
+	bzero(tl, sizeof(struct vrrp_timeline));
+}
+
+/**
+ * vrrp_timeline_trigger() - event leading to a transition, the
+ *                           transition itself comes next
+ */
+void vrrp_timeline_trigger(struct vrrp_timeline *tl)
+{
+	tl->trigger = vrrp_stats_now();
+}
+
+/**
+ * vrrp_timeline_begin() - start a new transition in ring, overwrite
+ *                         the oldest one if full
+ */
+void vrrp_timeline_begin(struct vrrp_timeline *tl, int from, int to)
+{
+	struct vrrp_transition *tr = &tl->ring[tl->head];
+
+	memset(tr->t, 0, sizeof(tr->t));
+	tr->from = from;
+	tr->to = to;
+	tr->t[VRRP_TL_TRIGGER] = tl->trigger ? tl->trigger : vrrp_stats_now();
+	tl->trigger = 0;
+
+	tl->head = (tl->head + 1) % VRRP_TIMELINE_LEN;
+	if (tl->len < VRRP_TIMELINE_LEN)
+		++tl->len;
+}
+
+/**
+ * vrrp_timeline_set() - step of transition tr reached now
+ */
+static void vrrp_timeline_set(struct vrrp_timeline *tl,
+			      struct vrrp_transition *tr, int step)
+{
+	uint64_t now = vrrp_stats_now();
+
+	tr->t[step] = now;
+
+	if (tr->to == MASTER)
+		vrrp_stats_hist(&tl->hist[step - 1], vrrp_timeline_bounds,
+				now - tr->t[VRRP_TL_TRIGGER]);
+}
+
+/**
+ * vrrp_timeline_step() - step of current transition reached
+ */
+void vrrp_timeline_step(struct vrrp_timeline *tl, int step)
+{
+	if (tl->len == 0)
+		return;
+
+	vrrp_timeline_set(tl, &tl->ring[(tl->head + VRRP_TIMELINE_LEN - 1)
+					 % VRRP_TIMELINE_LEN], step);
+}
+
+/**
+ * vrrp_timeline_hook_done() - hook script of state exited, close the
+ *                             latest transition to state waiting for it
+ */
+void vrrp_timeline_hook_done(struct vrrp_timeline *tl, int state)
+{
+	struct vrrp_transition *tr;
+	unsigned int i;
+
+	for (i = 1; i <= tl->len; ++i) {
+		tr = &tl->ring[(tl->head + VRRP_TIMELINE_LEN - i)
+			       % VRRP_TIMELINE_LEN];
+
+		if ((tr->to == state) && (tr->t[VRRP_TL_HOOK] != 0)
+		    && (tr->t[VRRP_TL_HOOK_DONE] == 0)) {
+			vrrp_timeline_set(tl, tr, VRRP_TL_HOOK_DONE);
+			return;
+		}
+	}
+}
+
+/**
+ * vrrp_timeline_format() - print transition i, 0 being the oldest,
+ *                          with delay of each step after trigger
+ */
+void vrrp_timeline_format(const struct vrrp_timeline *tl, unsigned int i,
+			  uint64_t now, char *line, size_t size)
+{
+	const struct vrrp_transition *tr;
+	size_t len;
+	int step;
+
+	tr = &tl->ring[(tl->head + VRRP_TIMELINE_LEN - tl->len + i)
+		       % VRRP_TIMELINE_LEN];
+
+	len = snprintf(line, size, "%s -> %s %" PRIu64 " ms ago",
+		       STR_STATE(tr->from), STR_STATE(tr->to),
+		       (now - tr->t[VRRP_TL_TRIGGER]) / 1000000);
+
+	for (step = VRRP_TL_TRIGGER + 1; step < VRRP_TL_MAX; ++step) {
+		if (len >= size)
+			return;
+
+		if (tr->t[step] == 0)
+			continue;
+
+		len += snprintf(line + len, size - len, ", %s +%" PRIu64 " us",
+				vrrp_timeline_steps[step],
+				(tr->t[step] - tr->t[VRRP_TL_TRIGGER]) / 1000);
+	}
+}
+
+/**
+ * vrrp_timeline_dump() - log last transitions, oldest first, with
+ *                        delay of each step after trigger
+ */
+void vrrp_timeline_dump(const struct vrrp *vrrp)
+{
+	const struct vrrp_timeline *tl = &vrrp->timeline;
+	uint64_t now = vrrp_stats_now();
+	char line[256];
+	unsigned int i;
+
+	log_notice("vrid %d :: last %u transitions", vrrp->vrid, tl->len);
+
+	for (i = 0; i < tl->len; ++i) {
+		vrrp_timeline_format(tl, i, now, line, sizeof(line));
+		log_notice("vrid %d :: %s", vrrp->vrid, line);
+	}
+}
@@ -0,0 +1,86 @@
+/*
+ * vrrp_timeline.h - timestamps of the steps of state transitions
+ *
+ * Copyright (C) 2017 Arnaud Andre 
+ *
+ * This file is part of uvrrpd.
+ *
+ * uvrrpd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * uvrrpd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with uvrrpd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _VRRP_TIMELINE_H_
+#define _VRRP_TIMELINE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vrrp_stats.h"
+
+/* from vrrp.h */
+struct vrrp;
+
+/* transitions kept per instance */
+#define VRRP_TIMELINE_LEN	16
+
+/**
+ * enum vrrp_timeline_step - steps of a transition
+ */
+enum vrrp_timeline_step {
+	VRRP_TL_TRIGGER,	/* masterdown expiry, adv or control cmd */
+	VRRP_TL_ADV,		/* advertisement sent */
+	VRRP_TL_TOPOLOGY,	/* gratuitous ARP or unsolicited NA sent */
+	VRRP_TL_HOOK,		/* hook script spawned */
+	VRRP_TL_HOOK_DONE,	/* hook script exited */
+	VRRP_TL_MAX
+};
+
+/**
+ * struct vrrp_transition - timeline of a transition
+ * @t: CLOCK_MONOTONIC ns of each step, 0 if not reached
+ */
+struct vrrp_transition {
+	int from;
+	int to;
+	uint64_t t[VRRP_TL_MAX];
+};
+
+/**
+ * struct vrrp_timeline - last transitions of an instance
+ * @trigger: time of the event leading to next transition, 0 if the
+ *           transition starts with no prior event
+ * @hist: delay of each step after trigger, in transitions to master,
+ *        indexed by step - 1
+ */
+struct vrrp_timeline {
+	struct vrrp_transition ring[VRRP_TIMELINE_LEN];
+	unsigned int head;
+	unsigned int len;
+	uint64_t trigger;
+	struct vrrp_stats_hist hist[VRRP_TL_MAX - 1];
+};
+
+extern const char *const vrrp_timeline_steps[VRRP_TL_MAX];
+extern const uint64_t vrrp_timeline_bounds[VRRP_STATS_BUCKETS];
+
+void vrrp_timeline_init(struct vrrp_timeline *tl);
+void vrrp_timeline_trigger(struct vrrp_timeline *tl);
+void vrrp_timeline_begin(struct vrrp_timeline *tl, int from, int to);
+void vrrp_timeline_step(struct vrrp_timeline *tl, int step);
+void vrrp_timeline_hook_done(struct vrrp_timeline *tl, int state);
+void vrrp_timeline_format(const struct vrrp_timeline *tl, unsigned int i,
+			  uint64_t now, char *line, size_t size);
+void vrrp_timeline_dump(const struct vrrp *vrrp);
+
+#endif /* _VRRP_TIMELINE_H_ */
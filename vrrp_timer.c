@@ -19,81 +19,233 @@
  * along with uvrrpd.  If not, see <http://www.gnu.org/licenses/>.
  *
  *
- * These functions use clock_gettime() and CLOCK_MONOTONIC_RAW
- * which access to a raw hardware-based time that is not subject to
- * NTP adjustements.
+ * VRRP timers are kept in a hierarchical timer wheel, with a
+ * centisecond granularity (VRRPv3 adv_int unit). Arming or cancelling a
+ * timer is O(1), and a single CLOCK_MONOTONIC timerfd, registered in the
+ * event loop, is armed on the next deadline across all timers.
  */
 
 #include <stdio.h>
+#include <unistd.h>
 #include <errno.h>
+#include <stdint.h>
 #include <time.h>
 #include <sys/time.h>
+#include <sys/timerfd.h>
 
 #include "vrrp_timer.h"
+#include "vrrp_probe.h"
+#include "list.h"
 #include "log.h"
 
 /* 1s for timespec operations */
 #define NANOUL  1000000000
 #define CENTUL  10000000
 
+/* wheel geometry, 4 levels of 64 slots, 2^24 cs (~46h) */
+#define WHEEL_BITS	6
+#define WHEEL_SIZE	(1 << WHEEL_BITS)
+#define WHEEL_MASK	(WHEEL_SIZE - 1)
+#define WHEEL_LEVELS	4
+#define WHEEL_MAX	((1ULL << (WHEEL_BITS * WHEEL_LEVELS)) - 1)
+
+/**
+ * struct vrrp_wheel - hierarchical timer wheel
+ *
+ * @vec slots of each level, level n slot covers 64^n ticks
+ * @now next tick to process
+ * @next tick the timerfd is armed on, 0 if disarmed
+ * @base CLOCK_MONOTONIC time of tick 0
+ * @fd timerfd
+ */
+struct vrrp_wheel {
+	struct list_head vec[WHEEL_LEVELS][WHEEL_SIZE];
+	uint64_t now;
+	uint64_t next;
+	struct timespec base;
+	int fd;
+};
+
+static struct vrrp_wheel wheel = {.fd = -1 };
+
 /**
- * timespec_substract() - substract two timestamp
+ * vrrp_wheel_ticks() - current tick of timer wheel
  *
- * Subtract the `struct timespec' values X and Y,
- * The difference is stored in timespect result.
- * @return 1 if the difference is negative, otherwise 0.
+ * @return -1 if clock_gettime() fail
+ */
+static int64_t vrrp_wheel_ticks(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1) {
+		log_error("clock_gettime: %m");
+		return -1;
+	}
+
+	return ((int64_t) (ts.tv_sec - wheel.base.tv_sec) * NANOUL
+		+ ts.tv_nsec - wheel.base.tv_nsec) / CENTUL;
+}
+
+/**
+ * vrrp_wheel_add() - insert a timer in the slot matching its expiration
+ */
+static void vrrp_wheel_add(struct vrrp_timer *timer)
+{
+	uint64_t expires = timer->expires;
+	uint64_t idx;
+	int level;
+
+	/* already expired, run on next tick */
+	if (expires < wheel.now)
+		expires = wheel.now;
+
+	idx = expires - wheel.now;
+	if (idx > WHEEL_MAX) {
+		idx = WHEEL_MAX;
+		expires = wheel.now + WHEEL_MAX;
+	}
+
+	for (level = 0; level < WHEEL_LEVELS - 1; ++level) {
+		if (idx < (1ULL << (WHEEL_BITS * (level + 1))))
+			break;
+	}
+
+	list_add_tail(&timer->list, &wheel.vec[level]
+		      [(expires >> (WHEEL_BITS * level)) & WHEEL_MASK]);
+}
+
+/**
+ * vrrp_wheel_cascade() - move timers of a level slot to lower levels
+ *
+ * @return slot index
+ */
+static int vrrp_wheel_cascade(int level, int index)
+{
+	struct list_head slot;
+	struct vrrp_timer *timer, *n;
+
+	INIT_LIST_HEAD(&slot);
+	list_splice_init(&wheel.vec[level][index], &slot);
+
+	list_for_each_entry_safe(timer, n, &slot, list) {
+		list_del(&timer->list);
+		vrrp_wheel_add(timer);
+	}
+
+	return index;
+}
+
+/**
+ * vrrp_wheel_next() - next tick on which a timer expires or a slot
+ *                     must be cascaded
+ *
+ * @return 0 if no timer is running
+ */
+static uint64_t vrrp_wheel_next(void)
+{
+	uint64_t next = 0, t, period;
+	int level, k, start;
+
+	for (level = 0; level < WHEEL_LEVELS; ++level) {
+		period = 1ULL << (WHEEL_BITS * level);
+
+		/* current slot of an upper level is already cascaded
+		 * unless now is on its boundary */
+		start = ((level == 0) || ((wheel.now & (period - 1)) == 0)) ? 0 : 1;
+
+		for (k = start; k < start + WHEEL_SIZE; ++k) {
+			t = ((wheel.now >> (WHEEL_BITS * level)) + k)
+			    << (WHEEL_BITS * level);
+
+			if (list_empty(&wheel.vec[level]
+				       [(t >> (WHEEL_BITS * level)) & WHEEL_MASK]))
+				continue;
+
+			if (t < wheel.now)
+				t = wheel.now;
+
+			if ((next == 0) || (t < next))
+				next = t;
+			break;
+		}
+	}
+
+	return next;
+}
+
+/**
+ * vrrp_wheel_arm() - arm timerfd on tick @next, 0 disarms it
  */
-static inline int timespec_substract(struct timespec *result,
-				     struct timespec *x, struct timespec *y)
+static void vrrp_wheel_arm(uint64_t next)
 {
-	/* Perform the carry for the later subtraction by updating y. */
-	if (x->tv_nsec < y->tv_nsec) {
-		time_t nsec = (y->tv_nsec - x->tv_nsec) / NANOUL + 1;
-		y->tv_nsec -= NANOUL * nsec;
-		y->tv_sec += nsec;
+	struct itimerspec its;
+
+	if (wheel.fd == -1)
+		return;
+
+	its.it_interval.tv_sec = 0;
+	its.it_interval.tv_nsec = 0;
+	its.it_value.tv_sec = 0;
+	its.it_value.tv_nsec = 0;
+
+	if (next != 0) {
+		its.it_value.tv_sec = wheel.base.tv_sec + next / 100;
+		its.it_value.tv_nsec = wheel.base.tv_nsec + (next % 100) * CENTUL;
+		if (its.it_value.tv_nsec >= NANOUL) {
+			its.it_value.tv_sec++;
+			its.it_value.tv_nsec -= NANOUL;
+		}
 	}
-	if (x->tv_nsec - y->tv_nsec > NANOUL) {
-		time_t nsec = (x->tv_nsec - y->tv_nsec) / NANOUL;
-		y->tv_nsec += NANOUL * nsec;
-		y->tv_sec -= nsec;
+
+	if (timerfd_settime(wheel.fd, TFD_TIMER_ABSTIME, &its, NULL) == -1) {
+		log_error("timerfd_settime - %m");
+		return;
 	}
 
-	/* Compute the time remaining to wait.
-	   tv_nsec is certainly positive. */
-	result->tv_sec = x->tv_sec - y->tv_sec;
-	result->tv_nsec = x->tv_nsec - y->tv_nsec;
+	wheel.next = next;
+}
 
-	/* Return 1 if result is negative. */
-	return x->tv_sec < y->tv_sec;
+/**
+ * vrrp_timer_init() - init timer and its expiration callback
+ */
+void vrrp_timer_init(struct vrrp_timer *timer, vrrp_timer_cb cb, void *data)
+{
+	timer->expires = 0;
+	timer->cb = cb;
+	timer->data = data;
+	INIT_LIST_HEAD(&timer->list);
 }
 
 /**
- * vrrp_timer_set() - set timer and reset delta
+ * vrrp_timer_set() - (re)arm timer
  *
  * @delay
  * @return -1 if clock_gettime() fail, 0 else
  */
 int vrrp_timer_set(struct vrrp_timer *timer, time_t delay, long delay_cs)
 {
-	if (clock_gettime(CLOCK_MONOTONIC_RAW, &timer->ts) == -1) {
-		log_error("clock_gettime: %m");
+	int64_t now = vrrp_wheel_ticks();
+
+	if (now < 0)
 		return -1;
-	}
 
-	timer->ts.tv_sec += delay;
-	timer->ts.tv_nsec += delay_cs * CENTUL;
+	/* +1, never expire before delay */
+	timer->expires = now + 1 + delay * 100 + delay_cs;
 
 #ifdef DEBUG
 	log_debug("delay %ld", delay);
 	log_debug("delay_cs %ld", delay_cs);
-
-	log_debug("timer->ts.tv_sec %ld", timer->ts.tv_sec);
-	log_debug("timer->ts.tv_nsec %ld", timer->ts.tv_nsec);
+	log_debug("timer->expires %lu", (unsigned long) timer->expires);
 #endif /* DEBUG */
 
-	/* reset delta */
-	timer->delta.tv_sec = 0;
-	timer->delta.tv_nsec = 0;
+	VRRP_PROBE3(timer_arm, timer, timer->data, timer->expires - now);
+
+	list_del_init(&timer->list);
+	vrrp_wheel_add(timer);
+
+	/* new first deadline */
+	if ((wheel.next == 0) || (timer->expires < wheel.next))
+		vrrp_wheel_arm(vrrp_wheel_next());
 
 	return 0;
 }
@@ -106,10 +258,8 @@ void vrrp_timer_clear(struct vrrp_timer *timer)
 	if (timer == NULL)
 		return;
 
-	timer->ts.tv_sec = 0;
-	timer->ts.tv_nsec = 0;
-	timer->delta.tv_sec = 0;
-	timer->delta.tv_nsec = 0;
+	list_del_init(&timer->list);
+	timer->expires = 0;
 }
 
 /**
@@ -120,53 +270,95 @@ void vrrp_timer_clear(struct vrrp_timer *timer)
  */
 int vrrp_timer_is_running(struct vrrp_timer *timer)
 {
-	if ((timer->ts.tv_sec != 0) || (timer->ts.tv_nsec != 0))
-		return 1;
-
-	return 0;
+	return !list_empty(&timer->list);
 }
 
 /**
- * vrrp_timer_update() - update a timer
+ * vrrp_timer_wheel_init() - init timer wheel and its timerfd
  *
- * @return -1 if clock_gettime() failed
- * @return ETIME if timer is expired
- * @return 0 if timer is successfully updated
+ * @return timerfd to register in event loop, -1 on error
  */
-int vrrp_timer_update(struct vrrp_timer *timer)
+int vrrp_timer_wheel_init(void)
 {
-	struct timespec ts;
+	int level, i;
 
-	if (clock_gettime(CLOCK_MONOTONIC_RAW, &ts) == -1) {
+	for (level = 0; level < WHEEL_LEVELS; ++level)
+		for (i = 0; i < WHEEL_SIZE; ++i)
+			INIT_LIST_HEAD(&wheel.vec[level][i]);
+
+	wheel.now = 0;
+	wheel.next = 0;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &wheel.base) == -1) {
 		log_error("clock_gettime: %m");
-		return -1;	/* TODO die() */
+		return -1;
 	}
 
-	if (timespec_substract(&timer->delta, &timer->ts, &ts)) {
-		log_debug("current timer expired");
-		return 1;
-	}
+	wheel.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (wheel.fd == -1)
+		log_error("timerfd_create - %m");
 
-	timer->ts.tv_sec = ts.tv_sec + timer->delta.tv_sec;
-	timer->ts.tv_nsec = ts.tv_nsec + timer->delta.tv_nsec;
+	return wheel.fd;
+}
 
-#ifdef DEBUG
-	log_debug("timer->ts.tv_sec %ld", timer->ts.tv_sec);
-	log_debug("timer->ts.tv_nsec %ld", timer->ts.tv_nsec);
-#endif /* DEBUG */
+/**
+ * vrrp_timer_wheel_run() - run callbacks of expired timers,
+ *                          and arm timerfd on the next deadline
+ */
+void vrrp_timer_wheel_run(void)
+{
+	struct list_head expired;
+	struct vrrp_timer *timer;
+	uint64_t expirations;
+	int64_t now;
+	int idx, level;
 
-	return 0;
+	/* consume timerfd expiration */
+	if ((read(wheel.fd, &expirations, sizeof(expirations)) == -1)
+	    && (errno != EAGAIN))
+		log_error("read timerfd - %m");
+
+	now = vrrp_wheel_ticks();
+	if (now < 0)
+		return;
+
+	INIT_LIST_HEAD(&expired);
+
+	while ((int64_t) wheel.now <= now) {
+		idx = wheel.now & WHEEL_MASK;
+
+		/* cascade upper levels on boundaries */
+		for (level = 1; (idx == 0) && (level < WHEEL_LEVELS); ++level)
+			idx = vrrp_wheel_cascade(level,
+						 (wheel.now >>
+						  (WHEEL_BITS * level)) &
+						 WHEEL_MASK);
+
+		list_splice_init(&wheel.vec[0][wheel.now & WHEEL_MASK],
+				 expired.prev);
+		wheel.now++;
+	}
+
+	/* callbacks may set or clear any timer */
+	while (!list_empty(&expired)) {
+		timer = list_first_entry(&expired, struct vrrp_timer, list);
+		list_del_init(&timer->list);
+		VRRP_PROBE3(timer_expire, timer, timer->data,
+			    now - timer->expires);
+		if (timer->cb != NULL)
+			timer->cb(timer, timer->data);
+	}
+
+	vrrp_wheel_arm(vrrp_wheel_next());
 }
 
 /**
- * vrrp_timer_is_expired() - check if a timer is expired
- *
+ * vrrp_timer_wheel_cleanup() - close timerfd
  */
-int vrrp_timer_is_expired(struct vrrp_timer *timer)
+void vrrp_timer_wheel_cleanup(void)
 {
-	if (vrrp_timer_update(timer)
-	    || ((timer->ts.tv_sec <= 0) && (timer->ts.tv_nsec <= 0)))
-		return 1;
+	if (wheel.fd != -1)
+		close(wheel.fd);
 
-	return 0;
+	wheel.fd = -1;
 }
@@ -27,25 +27,42 @@
 #ifndef _VRRP_TIMER_H_
 #define _VRRP_TIMER_H_
 
+#include <stdint.h>
 #include <sys/time.h>
 
+#include "list.h"
+
+struct vrrp_timer;
+
+/**
+ * vrrp_timer_cb - callback run when a timer expires
+ */
+typedef void (*vrrp_timer_cb) (struct vrrp_timer *timer, void *data);
+
 /**
  * struct vrrp_timer
  *
- * @ts timestamp in ns
- * @delta time since the last update
+ * @expires expiration time, in centiseconds (timer wheel ticks)
+ * @cb callback run on expiration
+ * @data callback data
+ * @list timer wheel slot
  */
 struct vrrp_timer {
-	struct timespec ts;
-	struct timespec delta;
+	uint64_t expires;
+	vrrp_timer_cb cb;
+	void *data;
+	struct list_head list;
 };
 
 /* prototype functions */
+void vrrp_timer_init(struct vrrp_timer *timer, vrrp_timer_cb cb, void *data);
 int vrrp_timer_set(struct vrrp_timer *timer, time_t delay, long delay_cs);
 void vrrp_timer_clear(struct vrrp_timer *timer);
 int vrrp_timer_is_running(struct vrrp_timer *timer);
-int vrrp_timer_update(struct vrrp_timer *timer);
-int vrrp_timer_is_expired(struct vrrp_timer *timer);
+
+int vrrp_timer_wheel_init(void);
+void vrrp_timer_wheel_run(void);
+void vrrp_timer_wheel_cleanup(void);
 
 /* Specific VRRP timer macros */
 #define SKEW_TIME( v )      \
@@ -0,0 +1,585 @@
+/*
+ * vrrp_vmac.c - rtnetlink backend, create VMAC macvlan interface and
+ *               set VIPs while changing state, instead of running
+ *               vrrp_switch.sh
+ *
+ * Copyright (C) 2017 Arnaud Andre 
+ *
+ * This file is part of uvrrpd.
+ *
+ * uvrrpd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * uvrrpd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with uvrrpd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_addr.h>
+#include <linux/if_link.h>
+
+#include "vrrp.h"
+#include "vrrp_net.h"
+#include "vrrp_vmac.h"
+
+#include "common.h"
+
+#include "list.h"
+#include "log.h"
+
+/* rtnetlink socket, shared by all instances */
+static int vrrp_vmac_fd = -1;
+static int vrrp_vmac_refcnt = 0;
+static uint32_t vrrp_vmac_seq = 0;
+
+/* one request per VIP, plus link requests */
+#define VRRP_VMAC_NREQ		(VIP_MAX + 3)
+#define VRRP_VMAC_BUFSIZE	32768
+
+/**
+ * struct vrrp_vmac_batch - rtnetlink requests sent in a single
+ *                          sendmsg(), acknowledged one by one
+ */
+struct vrrp_vmac_batch {
+	char buf[VRRP_VMAC_BUFSIZE] __attribute__ ((aligned(NLMSG_ALIGNTO)));
+	size_t len;
+
+	/* seq of first request */
+	uint32_t seq;
+	int n;
+
+	/* errno of each request, 0 if acknowledged */
+	int err[VRRP_VMAC_NREQ];
+
+	/* ifindex of VMAC interface, from RTM_GETLINK reply */
+	int ifindex;
+};
+
+static struct vrrp_vmac_batch vrrp_vmac_batch;
+
+/* sysctl set on init, as vrrp_switch.sh does */
+static const char *vrrp_vmac_sysctl[] = {
+	"ipv4/conf/all/rp_filter=0",
+	"ipv4/conf/all/arp_ignore=1",
+	"ipv4/conf/all/arp_announce=2",
+	"ipv4/conf/default/rp_filter=0",
+	"ipv4/conf/default/arp_ignore=1",
+	"ipv4/conf/default/arp_announce=2",
+#ifdef HAVE_IP6
+	"ipv6/conf/all/autoconf=0",
+	"ipv6/conf/all/accept_ra=0",
+	"ipv6/conf/all/forwarding=1",
+	"ipv6/conf/default/autoconf=0",
+	"ipv6/conf/default/accept_ra=0",
+	"ipv6/conf/default/forwarding=1",
+#endif /* HAVE_IP6 */
+};
+
+/**
+ * vrrp_vmac_begin() - reset batch
+ */
+static void vrrp_vmac_begin(struct vrrp_vmac_batch *b)
+{
+	b->len = 0;
+	b->n = 0;
+	b->seq = vrrp_vmac_seq + 1;
+	b->ifindex = 0;
+}
+
+/**
+ * vrrp_vmac_msg() - append a request to batch
+ *
+ * @size: size of request family header
+ */
+static struct nlmsghdr *vrrp_vmac_msg(struct vrrp_vmac_batch *b, int type,
+				      int flags, size_t size)
+{
+	struct nlmsghdr *nh = (struct nlmsghdr *) (b->buf + b->len);
+
+	if ((b->n == VRRP_VMAC_NREQ)
+	    || (b->len + NLMSG_SPACE(size) > sizeof(b->buf)))
+		return NULL;
+
+	memset(nh, 0, NLMSG_SPACE(size));
+	nh->nlmsg_len = NLMSG_LENGTH(size);
+	nh->nlmsg_type = type;
+	nh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
+	nh->nlmsg_seq = ++vrrp_vmac_seq;
+
+	b->err[b->n++] = ETIMEDOUT;
+
+	return nh;
+}
+
+/**
+ * vrrp_vmac_attr() - append an attribute to the last request
+ */
+static struct rtattr *vrrp_vmac_attr(struct vrrp_vmac_batch *b,
+				     struct nlmsghdr *nh, int type,
+				     const void *data, size_t len)
+{
+	struct rtattr *rta;
+
+	rta = (struct rtattr *) ((char *) nh + NLMSG_ALIGN(nh->nlmsg_len));
+
+	if ((char *) rta + RTA_SPACE(len) > b->buf + sizeof(b->buf))
+		return NULL;
+
+	rta->rta_type = type;
+	rta->rta_len = RTA_LENGTH(len);
+	if (len != 0)
+		memcpy(RTA_DATA(rta), data, len);
+
+	nh->nlmsg_len = NLMSG_ALIGN(nh->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+
+	return rta;
+}
+
+/**
+ * vrrp_vmac_nest_end() - close a nested attribute
+ */
+static void vrrp_vmac_nest_end(struct nlmsghdr *nh, struct rtattr *nest)
+{
+	nest->rta_len = (char *) nh + nh->nlmsg_len - (char *) nest;
+}
+
+/**
+ * vrrp_vmac_end() - last request is complete
+ */
+static void vrrp_vmac_end(struct vrrp_vmac_batch *b, struct nlmsghdr *nh)
+{
+	b->len += NLMSG_ALIGN(nh->nlmsg_len);
+}
+
+/**
+ * vrrp_vmac_commit() - send batch and wait for the acknowledgement
+ *                      of each request
+ *
+ * @return 0 if the batch is sent, b->err[] holds the result of
+ *         each request, -1 on error
+ */
+static int vrrp_vmac_commit(struct vrrp_vmac_batch *b)
+{
+	struct nlmsghdr *nh;
+	struct nlmsgerr *err;
+	struct ifinfomsg *ifi;
+	ssize_t len;
+	int nack = 0;
+	uint32_t i;
+
+	if (send(vrrp_vmac_fd, b->buf, b->len, 0) < 0) {
+		log_error("send - %m");
+		return -1;
+	}
+
+	while (nack < b->n) {
+		len = recv(vrrp_vmac_fd, b->buf, sizeof(b->buf), 0);
+
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			log_error("recv - %m");
+			return -1;
+		}
+
+		for (nh = (struct nlmsghdr *) b->buf; NLMSG_OK(nh, len);
+		     nh = NLMSG_NEXT(nh, len)) {
+
+			/* replies of a previous batch timed out */
+			i = nh->nlmsg_seq - b->seq;
+			if (i >= (uint32_t) b->n)
+				continue;
+
+			if (nh->nlmsg_type == RTM_NEWLINK) {
+				ifi = NLMSG_DATA(nh);
+				b->ifindex = ifi->ifi_index;
+			}
+			else if (nh->nlmsg_type == NLMSG_ERROR) {
+				err = NLMSG_DATA(nh);
+				b->err[i] = -err->error;
+				++nack;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * vrrp_vmac_ifname() - VMAC interface name, <ifname>_<vrid>
+ */
+static int vrrp_vmac_ifname(const struct vrrp_net *vnet, char *ifname)
+{
+	if (snprintf(ifname, IFNAMSIZ, "%s_%d", vnet->vif.ifname, vnet->vrid)
+	    >= IFNAMSIZ) {
+		log_error("vrid %d :: %s_%d - VMAC interface name too long",
+			  vnet->vrid, vnet->vif.ifname, vnet->vrid);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * vrrp_vmac_link_del() - append RTM_DELLINK request of VMAC interface
+ */
+static int vrrp_vmac_link_del(struct vrrp_vmac_batch *b, const char *ifname)
+{
+	struct nlmsghdr *nh;
+
+	nh = vrrp_vmac_msg(b, RTM_DELLINK, 0, sizeof(struct ifinfomsg));
+	if ((nh == NULL)
+	    || (vrrp_vmac_attr(b, nh, IFLA_IFNAME, ifname,
+			       strlen(ifname) + 1) == NULL))
+		return -1;
+
+	vrrp_vmac_end(b, nh);
+
+	return 0;
+}
+
+/**
+ * vrrp_vmac_link_add() - append requests creating VMAC macvlan
+ *                        interface and getting its ifindex
+ */
+static int vrrp_vmac_link_add(struct vrrp_vmac_batch *b,
+			      const struct vrrp_net *vnet, const char *ifname)
+{
+	unsigned char vmac[ETH_ALEN] = { 0x00, 0x00, 0x5e, 0x00, 0x01, 0x00 };
+	uint32_t link = vnet->vif.ifindex;
+	struct nlmsghdr *nh;
+	struct ifinfomsg *ifi;
+	struct rtattr *linkinfo;
+
+	vmac[5] = vnet->vrid;
+
+	nh = vrrp_vmac_msg(b, RTM_NEWLINK, NLM_F_CREATE | NLM_F_EXCL,
+			   sizeof(struct ifinfomsg));
+	if (nh == NULL)
+		return -1;
+
+	ifi = NLMSG_DATA(nh);
+	ifi->ifi_family = AF_UNSPEC;
+	ifi->ifi_flags = IFF_UP;
+	ifi->ifi_change = IFF_UP;
+
+	if ((vrrp_vmac_attr(b, nh, IFLA_LINK, &link, sizeof(link)) == NULL)
+	    || (vrrp_vmac_attr(b, nh, IFLA_IFNAME, ifname,
+			       strlen(ifname) + 1) == NULL)
+	    || (vrrp_vmac_attr(b, nh, IFLA_ADDRESS, vmac, ETH_ALEN) == NULL))
+		return -1;
+
+	linkinfo = vrrp_vmac_attr(b, nh, IFLA_LINKINFO, NULL, 0);
+	if ((linkinfo == NULL)
+	    || (vrrp_vmac_attr(b, nh, IFLA_INFO_KIND, "macvlan",
+			       sizeof("macvlan")) == NULL))
+		return -1;
+	vrrp_vmac_nest_end(nh, linkinfo);
+
+	vrrp_vmac_end(b, nh);
+
+	/* ifindex of the new interface */
+	nh = vrrp_vmac_msg(b, RTM_GETLINK, 0, sizeof(struct ifinfomsg));
+	if ((nh == NULL)
+	    || (vrrp_vmac_attr(b, nh, IFLA_IFNAME, ifname,
+			       strlen(ifname) + 1) == NULL))
+		return -1;
+
+	vrrp_vmac_end(b, nh);
+
+	return 0;
+}
+
+/**
+ * vrrp_vmac_addr() - append RTM_NEWADDR or RTM_DELADDR request of a VIP
+ */
+static int vrrp_vmac_addr(struct vrrp_vmac_batch *b, int type,
+			  const struct vrrp_net *vnet,
+			  const struct vrrp_ip *vip, int ifindex)
+{
+	struct nlmsghdr *nh;
+	struct ifaddrmsg *ifa;
+	size_t len = sizeof(struct in_addr);
+
+	nh = vrrp_vmac_msg(b, type, (type == RTM_NEWADDR ?
+				     NLM_F_CREATE | NLM_F_REPLACE : 0),
+			   sizeof(struct ifaddrmsg));
+	if (nh == NULL)
+		return -1;
+
+	ifa = NLMSG_DATA(nh);
+	ifa->ifa_family = vnet->family;
+	ifa->ifa_prefixlen = vip->netmask ? vip->netmask : 32;
+	ifa->ifa_scope = RT_SCOPE_UNIVERSE;
+	ifa->ifa_index = ifindex;
+
+#ifdef HAVE_IP6
+	if (vnet->family == AF_INET6) {
+		len = sizeof(struct in6_addr);
+		ifa->ifa_prefixlen = vip->netmask ? vip->netmask : 128;
+		/* VIP is usable at once, peer router owned it before */
+		ifa->ifa_flags = IFA_F_NODAD;
+	}
+#endif /* HAVE_IP6 */
+
+	if ((vrrp_vmac_attr(b, nh, IFA_LOCAL, &vip->ipx, len) == NULL)
+	    || (vrrp_vmac_attr(b, nh, IFA_ADDRESS, &vip->ipx, len) == NULL))
+		return -1;
+
+	vrrp_vmac_end(b, nh);
+
+	return 0;
+}
+
+/**
+ * vrrp_vmac_master() - create VMAC interface and set all VIPs on it
+ *
+ * VIP requests need the ifindex of the new interface: link is
+ * created first, then all VIPs are set by a single batch.
+ */
+static int vrrp_vmac_master(const struct vrrp_net *vnet, const char *ifname)
+{
+	struct vrrp_vmac_batch *b = &vrrp_vmac_batch;
+	struct vrrp_ip *vip_ptr = NULL;
+	char straddr[INET6_ADDRSTRLEN];
+	int i, ret = 0;
+
+	/* remove a previous VMAC interface, create a new one */
+	vrrp_vmac_begin(b);
+
+	if ((vrrp_vmac_link_del(b, ifname) != 0)
+	    || (vrrp_vmac_link_add(b, vnet, ifname) != 0)) {
+		log_error("vrid %d :: rtnetlink batch too large", vnet->vrid);
+		return -1;
+	}
+
+	if (vrrp_vmac_commit(b) != 0)
+		return -1;
+
+	if ((b->err[1] != 0) || (b->ifindex == 0)) {
+		errno = b->err[1] ? b->err[1] : b->err[2];
+		log_error("vrid %d :: create %s - %m", vnet->vrid, ifname);
+		return -1;
+	}
+
+	/* VIPs */
+	int ifindex = b->ifindex;
+
+	vrrp_vmac_begin(b);
+
+	list_for_each_entry_reverse(vip_ptr, &vnet->vip_list, iplist) {
+		if (vrrp_vmac_addr(b, RTM_NEWADDR, vnet, vip_ptr,
+				   ifindex) != 0) {
+			log_error("vrid %d :: rtnetlink batch too large",
+				  vnet->vrid);
+			return -1;
+		}
+	}
+
+	if (vrrp_vmac_commit(b) != 0)
+		return -1;
+
+	/* report failed VIPs */
+	i = 0;
+	list_for_each_entry_reverse(vip_ptr, &vnet->vip_list, iplist) {
+		if (b->err[i] != 0) {
+			errno = b->err[i];
+			log_error("vrid %d :: set %s on %s - %m", vnet->vrid,
+				  vnet->ipx_to_str(&vip_ptr->ipx, straddr),
+				  ifname);
+			ret = -1;
+		}
+		++i;
+	}
+
+	return ret;
+}
+
+/**
+ * vrrp_vmac_backup() - remove VMAC interface, and its VIPs with it
+ */
+static int vrrp_vmac_backup(const struct vrrp_net *vnet, const char *ifname)
+{
+	struct vrrp_vmac_batch *b = &vrrp_vmac_batch;
+
+	vrrp_vmac_begin(b);
+
+	if ((vrrp_vmac_link_del(b, ifname) != 0) || (vrrp_vmac_commit(b) != 0))
+		return -1;
+
+	/* not created yet */
+	if (b->err[0] == ENODEV)
+		return 0;
+
+	if (b->err[0] != 0) {
+		errno = b->err[0];
+		log_error("vrid %d :: delete %s - %m", vnet->vrid, ifname);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * vrrp_vmac_init_sysctl() - adjust sysctl for VMAC interfaces
+ */
+static int vrrp_vmac_init_sysctl(const struct vrrp_net *vnet)
+{
+	char path[PATH_MAX];
+	const char *value;
+	int fd, ret = 0;
+
+	for (size_t i = 0; i < ARRAY_SIZE(vrrp_vmac_sysctl); ++i) {
+		value = strchr(vrrp_vmac_sysctl[i], '=');
+		snprintf(path, sizeof(path), "/proc/sys/net/%.*s",
+			 (int) (value - vrrp_vmac_sysctl[i]),
+			 vrrp_vmac_sysctl[i]);
+		++value;
+
+		fd = open(path, O_WRONLY | O_CLOEXEC);
+		if ((fd < 0) || (write(fd, value, strlen(value)) < 0)) {
+			log_error("vrid %d :: %s - %m", vnet->vrid, path);
+			ret = -1;
+		}
+
+		if (fd >= 0)
+			close(fd);
+	}
+
+	return ret;
+}
+
+/**
+ * vrrp_vmac() - apply state change through rtnetlink
+ */
+int vrrp_vmac(struct vrrp *vrrp, const struct vrrp_net *vnet, vrrp_state state)
+{
+	char ifname[IFNAMSIZ];
+	struct timespec start, end;
+	int ret = 0;
+
+	if (vrrp_vmac_ifname(vnet, ifname) != 0)
+		return -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	switch (state) {
+	case INIT:
+		ret = vrrp_vmac_init_sysctl(vnet);
+		break;
+
+	case MASTER:
+		ret = vrrp_vmac_master(vnet, ifname);
+		break;
+
+	case BACKUP:
+		ret = vrrp_vmac_backup(vnet, ifname);
+		break;
+
+	default:
+		break;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	log_info("vrid %d :: %s %s in %ld us", vrrp->vrid, STR_STATE(state),
+		 ifname, (end.tv_sec - start.tv_sec) * 1000000
+		 + (end.tv_nsec - start.tv_nsec) / 1000);
+
+	return ret;
+}
+
+/**
+ * vrrp_vmac_vip() - set or remove a single VIP on VMAC interface, VIP
+ *                   set changed while master
+ */
+int vrrp_vmac_vip(const struct vrrp_net *vnet, struct vrrp_ip *vip,
+		  int add)
+{
+	struct vrrp_vmac_batch *b = &vrrp_vmac_batch;
+	char ifname[IFNAMSIZ];
+	char straddr[INET6_ADDRSTRLEN];
+	int ifindex;
+
+	if (vrrp_vmac_ifname(vnet, ifname) != 0)
+		return -1;
+
+	ifindex = if_nametoindex(ifname);
+	if (ifindex == 0) {
+		log_error("vrid %d :: %s - %m", vnet->vrid, ifname);
+		return -1;
+	}
+
+	vrrp_vmac_begin(b);
+
+	if (vrrp_vmac_addr(b, (add ? RTM_NEWADDR : RTM_DELADDR), vnet, vip,
+			   ifindex) != 0)
+		return -1;
+
+	if (vrrp_vmac_commit(b) != 0)
+		return -1;
+
+	if (b->err[0] != 0) {
+		errno = b->err[0];
+		log_error("vrid %d :: %s %s on %s - %m", vnet->vrid,
+			  (add ? "set" : "remove"),
+			  vnet->ipx_to_str(&vip->ipx, straddr), ifname);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * vrrp_vmac_init() - open rtnetlink socket
+ */
+int vrrp_vmac_init(struct vrrp *vrrp)
+{
+	struct timeval tv = {.tv_sec = 1,.tv_usec = 0 };
+
+	if (vrrp_vmac_refcnt == 0) {
+		vrrp_vmac_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC,
+				      NETLINK_ROUTE);
+
+		if (vrrp_vmac_fd < 0) {
+			log_error("vrid %d :: socket - %m", vrrp->vrid);
+			return -1;
+		}
+
+		/* don't wait forever for an acknowledgement */
+		setsockopt(vrrp_vmac_fd, SOL_SOCKET, SO_RCVTIMEO, &tv,
+			   sizeof(tv));
+	}
+
+	++vrrp_vmac_refcnt;
+
+	return 0;
+}
+
+/**
+ * vrrp_vmac_cleanup() - close rtnetlink socket
+ */
+void vrrp_vmac_cleanup(__attribute__ ((unused)) struct vrrp *vrrp)
+{
+	if ((vrrp_vmac_refcnt > 0) && (--vrrp_vmac_refcnt == 0)) {
+		close(vrrp_vmac_fd);
+		vrrp_vmac_fd = -1;
+	}
+}
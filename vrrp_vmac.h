@@ -0,0 +1,33 @@
+/*
+ * vrrp_vmac.h - rtnetlink backend, manage VMAC interface and VIPs
+ *
+ * Copyright (C) 2017 Arnaud Andre 
+ *
+ * This file is part of uvrrpd.
+ *
+ * uvrrpd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * uvrrpd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with uvrrpd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _VRRP_VMAC_H_
+#define _VRRP_VMAC_H_
+
+#include "vrrp.h"
+
+int vrrp_vmac(struct vrrp *vrrp, const struct vrrp_net *vnet, vrrp_state state);
+int vrrp_vmac_vip(const struct vrrp_net *vnet, struct vrrp_ip *vip,
+		  int add);
+int vrrp_vmac_init(struct vrrp *vrrp);
+void vrrp_vmac_cleanup(struct vrrp *vrrp);
+
+#endif /* _VRRP_VMAC_H_ */
@@ -0,0 +1,451 @@
+/*
+ * vrrp_worker.c - hook worker process, spawn hook scripts on behalf
+ *                 of uvrrpd
+ *
+ * Copyright (C) 2017 Arnaud Andre 
+ *
+ * This file is part of uvrrpd.
+ *
+ * uvrrpd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * uvrrpd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with uvrrpd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <sched.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/signalfd.h>
+#include <sys/prctl.h>
+
+#include "vrrp_worker.h"
+#include "list.h"
+#include "log.h"
+
+/* worker msg types */
+#define VRRP_WORKER_SPAWN	1	/* uvrrpd -> worker */
+#define VRRP_WORKER_KILL	2	/* uvrrpd -> worker */
+#define VRRP_WORKER_DONE	3	/* worker -> uvrrpd */
+
+/* max size of a worker msg, and max args of a script */
+#define VRRP_WORKER_MSG_MAX	65536
+#define VRRP_WORKER_ARGS	16
+
+/**
+ * vrrp_worker_msg - msg exchanged on worker socketpair
+ *
+ * @cookie identifies the script in both directions, SPAWN msg
+ * carries script path then its argv, NUL separated
+ */
+struct vrrp_worker_msg {
+	uint32_t type;
+	int32_t status;
+	uint64_t cookie;
+	char args[];
+};
+
+/**
+ * vrrp_worker_job - script running in worker
+ */
+struct vrrp_worker_job {
+	uint64_t cookie;
+	pid_t pid;
+	struct list_head list;
+};
+
+/* uvrrpd side of socketpair */
+static int vrrp_worker_sock = -1;
+static pid_t vrrp_worker_pid = 0;
+
+static char vrrp_worker_buf[VRRP_WORKER_MSG_MAX + 1]
+    __attribute__ ((aligned(8)));
+
+/**
+ * vrrp_worker_exec() - spawn a script, don't wait for it
+ *
+ * Script doesn't inherit SCHED_RR nor signal mask of its parent,
+ * it runs in its own process group.
+ */
+int vrrp_worker_exec(pid_t *pid, const char *path, char *const argv[])
+{
+	char *const envp[] = { NULL };
+	posix_spawnattr_t attr;
+	struct sched_param param = { 0 };
+	sigset_t mask;
+	int err;
+
+	posix_spawnattr_init(&attr);
+
+	sigemptyset(&mask);
+	posix_spawnattr_setsigmask(&attr, &mask);
+	sigfillset(&mask);
+	posix_spawnattr_setsigdefault(&attr, &mask);
+
+	posix_spawnattr_setschedpolicy(&attr, SCHED_OTHER);
+	posix_spawnattr_setschedparam(&attr, &param);
+
+	posix_spawnattr_setpgroup(&attr, 0);
+
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK
+				 | POSIX_SPAWN_SETSIGDEF
+				 | POSIX_SPAWN_SETSCHEDULER
+				 | POSIX_SPAWN_SETPGROUP);
+
+	err = posix_spawn(pid, path, NULL, &attr, argv, envp);
+
+	posix_spawnattr_destroy(&attr);
+
+	if (err != 0) {
+		errno = err;
+		log_error("posix_spawn %s - %m", path);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * vrrp_worker_reply() - send exit status of a script to uvrrpd
+ */
+static void vrrp_worker_reply(int fd, uint64_t cookie, int status)
+{
+	struct vrrp_worker_msg msg;
+
+	msg.type = VRRP_WORKER_DONE;
+	msg.status = status;
+	msg.cookie = cookie;
+
+	if (send(fd, &msg, sizeof(msg), MSG_NOSIGNAL) == -1)
+		log_error("send - %m");
+}
+
+/**
+ * vrrp_worker_request() - spawn or kill a script
+ */
+static void vrrp_worker_request(int fd, struct list_head *jobs,
+				struct vrrp_worker_msg *msg, size_t len)
+{
+	struct vrrp_worker_job *job;
+	char *argv[VRRP_WORKER_ARGS + 1];
+	char *path, *p, *end;
+	int argc = 0;
+
+	if (msg->type == VRRP_WORKER_KILL) {
+		list_for_each_entry(job, jobs, list) {
+			if (job->cookie == msg->cookie)
+				kill(-job->pid, SIGKILL);
+		}
+		return;
+	}
+
+	/* VRRP_WORKER_SPAWN, msg is NUL terminated by caller */
+	path = msg->args;
+	end = (char *) msg + len;
+
+	for (p = path + strlen(path) + 1;
+	     (p < end) && (argc < VRRP_WORKER_ARGS); p += strlen(p) + 1)
+		argv[argc++] = p;
+
+	argv[argc] = NULL;
+
+	job = malloc(sizeof(struct vrrp_worker_job));
+	if (job == NULL) {
+		log_error("malloc - %m");
+		vrrp_worker_reply(fd, msg->cookie, W_EXITCODE(127, 0));
+		return;
+	}
+
+	if (vrrp_worker_exec(&job->pid, path, argv) != 0) {
+		vrrp_worker_reply(fd, msg->cookie, W_EXITCODE(127, 0));
+		free(job);
+		return;
+	}
+
+	job->cookie = msg->cookie;
+	list_add_tail(&job->list, jobs);
+}
+
+/**
+ * vrrp_worker_reap() - reap terminated scripts
+ */
+static void vrrp_worker_reap(int fd, struct list_head *jobs)
+{
+	struct vrrp_worker_job *job, *n;
+	pid_t pid;
+	int status;
+
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+		list_for_each_entry_safe(job, n, jobs, list) {
+			if (job->pid != pid)
+				continue;
+
+			vrrp_worker_reply(fd, job->cookie, status);
+			list_del(&job->list);
+			free(job);
+		}
+	}
+}
+
+/**
+ * vrrp_worker_main() - worker process, run until uvrrpd closes its
+ *                      side of socketpair
+ */
+static void vrrp_worker_main(int fd)
+{
+	struct signalfd_siginfo si;
+	struct pollfd pfd[2];
+	sigset_t mask;
+	ssize_t len;
+	int i, max;
+
+	LIST_HEAD(jobs);
+
+	prctl(PR_SET_NAME, "uvrrpd-hook");
+
+	/* don't hold sockets, fifos, ... of uvrrpd */
+	log_close();
+	max = sysconf(_SC_OPEN_MAX);
+	for (i = STDERR_FILENO + 1; i < max; ++i) {
+		if (i != fd)
+			close(i);
+	}
+	log_open("uvrrpd-hook", NULL);
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+
+	pfd[0].fd = fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = signalfd(-1, &mask, SFD_CLOEXEC);
+	pfd[1].events = POLLIN;
+
+	if (pfd[1].fd == -1) {
+		log_error("signalfd - %m");
+		_exit(EXIT_FAILURE);
+	}
+
+	for (;;) {
+		if (poll(pfd, 2, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			log_error("poll - %m");
+			break;
+		}
+
+		if (pfd[1].revents & POLLIN) {
+			while (read(pfd[1].fd, &si, sizeof(si)) == -1
+			       && errno == EINTR);
+			vrrp_worker_reap(fd, &jobs);
+		}
+
+		if (pfd[0].revents == 0)
+			continue;
+
+		len = recv(fd, vrrp_worker_buf, VRRP_WORKER_MSG_MAX, 0);
+
+		/* uvrrpd exited */
+		if (len == 0)
+			break;
+
+		if (len == -1) {
+			if (errno == EINTR)
+				continue;
+			log_error("recv - %m");
+			break;
+		}
+
+		if ((size_t) len < sizeof(struct vrrp_worker_msg))
+			continue;
+
+		vrrp_worker_buf[len] = '\0';
+		vrrp_worker_request(fd, &jobs,
+				    (struct vrrp_worker_msg *) vrrp_worker_buf,
+				    len);
+	}
+
+	/* running scripts are left to init */
+	_exit(EXIT_SUCCESS);
+}
+
+/**
+ * vrrp_worker_init() - fork hook worker
+ *
+ * Must be called before mlockall() and SCHED_RR, so that uvrrpd
+ * never forks once locked in memory.
+ */
+int vrrp_worker_init(void)
+{
+	int sv[2];
+	pid_t pid;
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1) {
+		log_error("socketpair - %m");
+		return -1;
+	}
+
+	pid = fork();
+
+	if (pid == -1) {
+		log_error("fork - %m");
+		close(sv[0]);
+		close(sv[1]);
+		return -1;
+	}
+
+	if (pid == 0) {
+		close(sv[0]);
+		vrrp_worker_main(sv[1]);
+	}
+
+	close(sv[1]);
+
+	/* never block uvrrpd on a busy worker */
+	fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+
+	vrrp_worker_sock = sv[0];
+	vrrp_worker_pid = pid;
+
+	log_info("hook worker started, pid %d", pid);
+
+	return 0;
+}
+
+/**
+ * vrrp_worker_fd() - uvrrpd side of worker socketpair, -1 if no
+ *                    worker
+ */
+int vrrp_worker_fd(void)
+{
+	return vrrp_worker_sock;
+}
+
+/**
+ * vrrp_worker_spawn() - ask worker to spawn a script
+ */
+int vrrp_worker_spawn(uint64_t cookie, const char *path, char *const argv[])
+{
+	struct vrrp_worker_msg *msg = (struct vrrp_worker_msg *) vrrp_worker_buf;
+	size_t len, n;
+
+	if (vrrp_worker_sock == -1)
+		return -1;
+
+	msg->type = VRRP_WORKER_SPAWN;
+	msg->status = 0;
+	msg->cookie = cookie;
+
+	len = sizeof(struct vrrp_worker_msg);
+
+	for (int i = -1; (i == -1) || (argv[i] != NULL); ++i) {
+		const char *s = (i == -1) ? path : argv[i];
+
+		n = strlen(s) + 1;
+		if ((len + n > VRRP_WORKER_MSG_MAX) || (i >= VRRP_WORKER_ARGS)) {
+			log_error("hook worker :: script args too long");
+			return -1;
+		}
+
+		memcpy(vrrp_worker_buf + len, s, n);
+		len += n;
+	}
+
+	if (send(vrrp_worker_sock, msg, len, MSG_NOSIGNAL) == -1) {
+		log_error("hook worker :: send - %m");
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * vrrp_worker_kill() - ask worker to kill a script and its children
+ */
+int vrrp_worker_kill(uint64_t cookie)
+{
+	struct vrrp_worker_msg msg;
+
+	if (vrrp_worker_sock == -1)
+		return -1;
+
+	msg.type = VRRP_WORKER_KILL;
+	msg.status = 0;
+	msg.cookie = cookie;
+
+	if (send(vrrp_worker_sock, &msg, sizeof(msg), MSG_NOSIGNAL) == -1) {
+		log_error("hook worker :: send - %m");
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * vrrp_worker_read() - read exit status of a script
+ *
+ * @return 1 if a script terminated, 0 if none, -1 if worker is gone
+ *         (socketpair is then closed)
+ */
+int vrrp_worker_read(uint64_t *cookie, int *status)
+{
+	struct vrrp_worker_msg msg;
+	ssize_t len;
+
+	if (vrrp_worker_sock == -1)
+		return -1;
+
+	len = recv(vrrp_worker_sock, &msg, sizeof(msg), 0);
+
+	if (len == -1) {
+		if ((errno == EAGAIN) || (errno == EINTR))
+			return 0;
+		log_error("hook worker :: recv - %m");
+	}
+
+	if (len <= 0) {
+		log_error("hook worker exited");
+		vrrp_worker_cleanup();
+		return -1;
+	}
+
+	if (((size_t) len != sizeof(msg)) || (msg.type != VRRP_WORKER_DONE))
+		return 0;
+
+	*cookie = msg.cookie;
+	*status = msg.status;
+
+	return 1;
+}
+
+/**
+ * vrrp_worker_cleanup() - stop hook worker
+ */
+void vrrp_worker_cleanup(void)
+{
+	if (vrrp_worker_sock == -1)
+		return;
+
+	/* worker exits on EOF */
+	close(vrrp_worker_sock);
+	vrrp_worker_sock = -1;
+
+	while ((waitpid(vrrp_worker_pid, NULL, 0) == -1) && (errno == EINTR));
+	vrrp_worker_pid = 0;
+}
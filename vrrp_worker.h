@@ -0,0 +1,36 @@
+/*
+ * vrrp_worker.h - hook worker process
+ *
+ * Copyright (C) 2017 Arnaud Andre 
+ *
+ * This file is part of uvrrpd.
+ *
+ * uvrrpd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * uvrrpd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with uvrrpd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _VRRP_WORKER_H_
+#define _VRRP_WORKER_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+int vrrp_worker_exec(pid_t *pid, const char *path, char *const argv[]);
+int vrrp_worker_init(void);
+int vrrp_worker_fd(void);
+int vrrp_worker_spawn(uint64_t cookie, const char *path, char *const argv[]);
+int vrrp_worker_kill(uint64_t cookie);
+int vrrp_worker_read(uint64_t *cookie, int *status);
+void vrrp_worker_cleanup(void);
+
+#endif /* _VRRP_WORKER_H_ */